@@ -0,0 +1,291 @@
+/*
+ * Offscreen rendering stage benchmark.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "egl_device.h"
+#include "gl_extensions.h"
+
+using namespace std;
+
+
+double percentile(std::vector<double> samples, double p) {
+	if (samples.empty()) {
+		return 0.0;
+	}
+	std::sort(samples.begin(), samples.end());
+	// Nearest rank.
+	size_t rank = (size_t)(p / 100.0 * samples.size() + 0.999999);
+	rank = std::max<size_t>(1, std::min(rank, samples.size()));
+	return samples[rank - 1];
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+ * CPU and optional GPU samples of one stage at one resolution.
+ */
+struct StageSamples {
+	std::string stage;
+	size_t width, height;
+	size_t bytes;	/* bytes moved per repetition, 0 if not meaningful */
+	std::vector<double> cpu;
+	std::vector<double> gpu;
+};
+
+void dropWarmup(StageSamples& samples) {
+	samples.cpu.erase(samples.cpu.begin());
+	if (!samples.gpu.empty()) {
+		samples.gpu.erase(samples.gpu.begin());
+	}
+}
+
+/*
+ * Times one repetition of a stage on the CPU around glFinish and, if query
+ * is non-zero, on the GPU with GL_TIME_ELAPSED.
+ */
+class RepetitionTimer {
+public:
+	RepetitionTimer(StageSamples& samples, GLuint query) : samples(samples), query(query), start(Clock::now()) {
+		if (query) {
+			glBeginQuery(GL_TIME_ELAPSED, query);
+		}
+	}
+
+	~RepetitionTimer() {
+		if (query) {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+		glFinish();
+		samples.cpu.push_back(millisecondsSince(start));
+		if (query) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			samples.gpu.push_back(elapsed / 1e6);
+		}
+	}
+
+private:
+	StageSamples& samples;
+	GLuint query;
+	Clock::time_point start;
+};
+
+class Results {
+public:
+	Results(const std::string& path, const std::string& renderer, const std::string& version)
+		: path(path), renderer(renderer), version(version) {
+		const char* threads = getenv("LP_NUM_THREADS");
+		lpThreads = threads ? threads : "";
+	}
+
+	void add(const StageSamples& samples) {
+		rows.push_back(samples);
+
+		const double p50 = percentile(samples.cpu, 50), p99 = percentile(samples.cpu, 99);
+		printf("%-16s %6zux%-6zu cpu p50 %9.3f ms  p99 %9.3f ms", samples.stage.c_str(), samples.width,
+			   samples.height, p50, p99);
+		if (!samples.gpu.empty()) {
+			printf("  gpu p50 %9.3f ms", percentile(samples.gpu, 50));
+		}
+		if (samples.bytes && p50 > 0) {
+			printf("  %9.1f MB/s", samples.bytes / 1e6 / (p50 / 1e3));
+		}
+		printf("\n");
+	}
+
+	void write() const {
+		if (path.empty()) {
+			return;
+		}
+		struct stat info;
+		const bool exists = stat(path.c_str(), &info) == 0 && info.st_size > 0;
+		FILE* file = fopen(path.c_str(), "a");
+		if (!file) {
+			throw runtime_error("Could not open " + path);
+		}
+		if (!exists) {
+			fprintf(file, "renderer,version,lp_num_threads,stage,width,height,repetitions,"
+						  "cpu_p50_ms,cpu_p99_ms,gpu_p50_ms,gpu_p99_ms,mb_per_s\n");
+		}
+		for (size_t i = 0; i < rows.size(); i++) {
+			const StageSamples& row = rows[i];
+			const double p50 = percentile(row.cpu, 50);
+			fprintf(file, "\"%s\",\"%s\",%s,%s,%zu,%zu,%zu,%.6f,%.6f,", renderer.c_str(), version.c_str(),
+					lpThreads.c_str(), row.stage.c_str(), row.width, row.height, row.cpu.size(), p50,
+					percentile(row.cpu, 99));
+			if (!row.gpu.empty()) {
+				fprintf(file, "%.6f,%.6f,", percentile(row.gpu, 50), percentile(row.gpu, 99));
+			} else {
+				fprintf(file, ",,");
+			}
+			if (row.bytes && p50 > 0) {
+				fprintf(file, "%.3f\n", row.bytes / 1e6 / (p50 / 1e3));
+			} else {
+				fprintf(file, "\n");
+			}
+		}
+		if (fclose(file) != 0) {
+			throw runtime_error("Could not write " + path);
+		}
+		std::cout << "Results appended to " << path << std::endl;
+	}
+
+private:
+	std::string path, renderer, version, lpThreads;
+	std::vector<StageSamples> rows;
+};
+
+std::string glString(GLenum name) {
+	const GLubyte* value = glGetString(name);
+	return value ? (const char*)value : "";
+}
+
+}
+
+
+int RunBenchmark(const BenchmarkOptions& options) {
+	const size_t repetitions = std::max<size_t>(1, options.repetitions);
+
+	/*
+	 * Display initialization; the first sample is the cold start, the others
+	 * re-initialize the same display after eglTerminate.
+	 */
+	StageSamples initialize = {"egl_initialize", 0, 0, 0, {}, {}};
+	Clock::time_point start = Clock::now();
+	EGLDisplay display = openEglDisplay(options.platform, options.device);
+	initialize.cpu.push_back(millisecondsSince(start));
+	for (size_t i = 1; i < repetitions; i++) {
+		eglTerminate(display);
+		start = Clock::now();
+		eglInitialize(display, nullptr, nullptr);
+		initialize.cpu.push_back(millisecondsSince(start));
+		assertEGLError("eglInitialize");
+	}
+
+	const EGLConfig config = chooseEglConfig(display, EglConfigRequirements()).config;
+	eglBindAPI(EGL_OPENGL_API);
+	assertEGLError("eglBindAPI");
+
+	/*
+	 * Context creation, including making it current.
+	 */
+	StageSamples createContext = {"egl_context", 0, 0, 0, {}, {}};
+	EGLContext context = EGL_NO_CONTEXT;
+	for (size_t i = 0; i < repetitions; i++) {
+		if (context != EGL_NO_CONTEXT) {
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(display, context);
+		}
+		start = Clock::now();
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+		createContext.cpu.push_back(millisecondsSince(start));
+		assertEGLError("eglCreateContext");
+	}
+	glExtensionIndex().load();
+
+	Results results(options.output, glString(GL_RENDERER), glString(GL_VERSION));
+	std::cout << "RENDERER: " << glString(GL_RENDERER) << std::endl;
+	const char* lpThreads = getenv("LP_NUM_THREADS");
+	std::cout << "LP_NUM_THREADS: " << (lpThreads ? lpThreads : "(default)") << std::endl << std::endl;
+	results.add(initialize);
+	results.add(createContext);
+
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	size_t maxSize = (size_t)maxTextureSize;
+	if (options.maxSize && options.maxSize < maxSize) {
+		maxSize = options.maxSize;
+	}
+
+	GLuint query = 0;
+	if (isGlextSupported("GL_ARB_timer_query")) {
+		glGenQueries(1, &query);
+	}
+
+	std::vector<unsigned char> pixels;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	for (size_t size = options.minSize; size <= maxSize; size *= 2) {
+		const GLsizei dimension = (GLsizei)size;
+		const size_t bytes = size * size * 4;
+		pixels.resize(bytes);
+
+		StageSamples framebuffer = {"fbo_create", size, size, 0, {}, {}};
+		StageSamples clear = {"clear", size, size, bytes, {}, {}};
+		StageSamples readback = {"readback", size, size, bytes, {}, {}};
+
+		// One extra warm-up repetition, dropped below.
+		for (size_t i = 0; i <= repetitions; i++) {
+			GLuint frameBuffer, texture;
+			{
+				RepetitionTimer timer(framebuffer, query);
+				glGenFramebuffers(1, &frameBuffer);
+				glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+				glGenTextures(1, &texture);
+				glBindTexture(GL_TEXTURE_2D, texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimension, dimension, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+					throw runtime_error("Benchmark framebuffer incomplete at " + std::to_string(size));
+				}
+			}
+			assertOpenGLError("benchmark framebuffer");
+
+			glViewport(0, 0, dimension, dimension);
+			{
+				RepetitionTimer timer(clear, query);
+				glClearColor(0.9f, 0.8f, 0.5f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT);
+			}
+			{
+				RepetitionTimer timer(readback, query);
+				glReadBuffer(GL_COLOR_ATTACHMENT0);
+				glReadPixels(0, 0, dimension, dimension, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			}
+			assertOpenGLError("benchmark clear/readback");
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glDeleteFramebuffers(1, &frameBuffer);
+			glDeleteTextures(1, &texture);
+		}
+
+		dropWarmup(framebuffer);
+		dropWarmup(clear);
+		dropWarmup(readback);
+		results.add(framebuffer);
+		results.add(clear);
+		results.add(readback);
+	}
+
+	if (query) {
+		glDeleteQueries(1, &query);
+	}
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+
+	results.write();
+	return EXIT_SUCCESS;
+}
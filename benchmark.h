@@ -0,0 +1,38 @@
+/*
+ * Benchmark of the offscreen rendering stages: display initialization,
+ * context creation, framebuffer creation, clear and readback, swept over
+ * render target resolutions.
+ *
+ * Every stage is timed on the CPU (around a glFinish) and, where
+ * GL_ARB_timer_query is available, on the GPU with GL_TIME_ELAPSED queries.
+ * The p50/p99 latencies and throughput are printed and appended as CSV rows
+ * to a results file, so runs on different drivers can be compared.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_BENCHMARK_H
+#define EGL_OFFSCREEN_BENCHMARK_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct BenchmarkOptions {
+	std::string platform = "auto";
+	std::string device;
+	std::string output = "bench_results.csv";	/* appended to, empty to skip */
+	size_t repetitions = 10;
+	size_t minSize = 64;
+	size_t maxSize = 4096;	/* capped by GL_MAX_TEXTURE_SIZE, 0 for no extra cap */
+};
+
+int RunBenchmark(const BenchmarkOptions& options);
+
+/*
+ * Nearest-rank percentile p (0-100) of samples, 0 if there are none.
+ */
+double percentile(std::vector<double> samples, double p);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * On-disk capability cache.
+ *
+ * File layout, native endianness:
+ *
+ *	char     magic[8]		"GLCAPS\0\1"
+ *	uint64_t tableSignature
+ *	uint32_t fingerprintLength, supportedCount, integerCount, floatCount
+ *	char     fingerprint[fingerprintLength]
+ *	uint8_t  supported[supportedCount]
+ *	GLint64  integers[integerCount]
+ *	GLfloat  floats[floatCount]
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "capability_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+namespace {
+
+const char cacheMagic[8] = {'G', 'L', 'C', 'A', 'P', 'S', '\0', '\1'};
+
+struct CacheHeader {
+	char magic[8];
+	uint64_t tableSignature;
+	uint32_t fingerprintLength;
+	uint32_t supportedCount;
+	uint32_t integerCount;
+	uint32_t floatCount;
+};
+
+std::string glString(GLenum name) {
+	const GLubyte* value = glGetString(name);
+	return value ? (const char*)value : "";
+}
+
+}
+
+
+std::string capabilityFingerprint(EGLDisplay display) {
+	const char* vendor = eglQueryString(display, EGL_VENDOR);
+	return glString(GL_RENDERER) + "\n" + glString(GL_VERSION) + "\n" + (vendor ? vendor : "");
+}
+
+std::string defaultCacheDirectory() {
+	const char* cacheHome = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	if (cacheHome && *cacheHome) {
+		return cacheHome;
+	} else if (home && *home) {
+		return std::string(home) + "/.cache";
+	}
+	return ".";
+}
+
+std::string defaultCapabilityCachePath() {
+	return defaultCacheDirectory() + "/egl_opengl_test_capabilities.bin";
+}
+
+bool loadCapabilityCache(const std::string& path, const std::string& fingerprint, uint64_t tableSignature,
+						 const CapabilityCounts& counts, CapabilityReport& report) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+
+	CacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, cacheMagic, 8) == 0 &&
+				 header.tableSignature == tableSignature && header.fingerprintLength == fingerprint.size() &&
+				 header.supportedCount == counts.supported && header.integerCount == counts.integers &&
+				 header.floatCount == counts.floats;
+
+	if (valid) {
+		std::string stored(header.fingerprintLength, '\0');
+		valid = fread(&stored[0], 1, stored.size(), file) == stored.size() && stored == fingerprint;
+	}
+	if (valid) {
+		report.supported.resize(header.supportedCount);
+		report.integers.resize(header.integerCount);
+		report.floats.resize(header.floatCount);
+		valid = fread(report.supported.data(), 1, report.supported.size(), file) == report.supported.size() &&
+				fread(report.integers.data(), sizeof(GLint64), report.integers.size(), file) ==
+					report.integers.size() &&
+				fread(report.floats.data(), sizeof(GLfloat), report.floats.size(), file) == report.floats.size();
+	}
+
+	fclose(file);
+	return valid;
+}
+
+bool saveCapabilityCache(const std::string& path, const std::string& fingerprint, uint64_t tableSignature,
+						 const CapabilityReport& report) {
+	const size_t slash = path.rfind('/');
+	if (slash != std::string::npos && slash > 0) {
+		mkdir(path.substr(0, slash).c_str(), 0755);
+	}
+
+	// Write to a temporary file and rename, so concurrent readers never see a partial cache.
+	const std::string temporary = path + ".tmp." + std::to_string(getpid());
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(header.magic, cacheMagic, 8);
+	header.tableSignature = tableSignature;
+	header.fingerprintLength = (uint32_t)fingerprint.size();
+	header.supportedCount = (uint32_t)report.supported.size();
+	header.integerCount = (uint32_t)report.integers.size();
+	header.floatCount = (uint32_t)report.floats.size();
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+				   fwrite(fingerprint.data(), 1, fingerprint.size(), file) == fingerprint.size() &&
+				   fwrite(report.supported.data(), 1, report.supported.size(), file) == report.supported.size() &&
+				   fwrite(report.integers.data(), sizeof(GLint64), report.integers.size(), file) ==
+					   report.integers.size() &&
+				   fwrite(report.floats.data(), sizeof(GLfloat), report.floats.size(), file) == report.floats.size();
+	written = fclose(file) == 0 && written;
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * On-disk cache of the probed OpenGL capability values.
+ *
+ * The cache is a small binary file holding a fingerprint of the driver
+ * (GL_RENDERER, GL_VERSION, EGL vendor), a signature of the capability table
+ * the values belong to, and the values themselves in table order. It is only
+ * used when both the fingerprint and the table signature match; otherwise the
+ * capabilities are probed again and the file is rewritten.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_CAPABILITY_CACHE_H
+#define EGL_OFFSCREEN_CAPABILITY_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gl_common.h"
+
+/*
+ * Probed values of the capability table, every entry in table order. Values
+ * of unsupported extensions are present but zero.
+ */
+struct CapabilityReport {
+	std::vector<uint8_t> supported;	/* one flag per extension */
+	std::vector<GLint64> integers;	/* 32-bit (nrValues each) and 64-bit queries */
+	std::vector<GLfloat> floats;
+};
+
+/*
+ * Entries a report of the current capability table holds.
+ */
+struct CapabilityCounts {
+	size_t supported, integers, floats;
+};
+
+/*
+ * Fingerprint of the current context's driver: GL_RENDERER, GL_VERSION and
+ * the EGL vendor of display.
+ */
+std::string capabilityFingerprint(EGLDisplay display);
+
+/*
+ * Directory for cache files, $XDG_CACHE_HOME or ~/.cache.
+ */
+std::string defaultCacheDirectory();
+
+/*
+ * Default capability cache file in defaultCacheDirectory().
+ */
+std::string defaultCapabilityCachePath();
+
+/*
+ * Load the report if the file exists and matches fingerprint, tableSignature
+ * and exactly the counts of the table. Returns false on any mismatch or read
+ * error.
+ */
+bool loadCapabilityCache(const std::string& path, const std::string& fingerprint, uint64_t tableSignature,
+						 const CapabilityCounts& counts, CapabilityReport& report);
+
+/*
+ * Atomically (re)write the cache file. Returns false if it could not be written.
+ */
+bool saveCapabilityCache(const std::string& path, const std::string& fingerprint, uint64_t tableSignature,
+						 const CapabilityReport& report);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Damage tracking and partial readback.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "damage_tracker.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "pbo_readback.h"
+
+using namespace std;
+
+
+namespace {
+
+bool overlaps(const DamageRect& a, const DamageRect& b) {
+	return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+DamageRect bounds(const DamageRect& a, const DamageRect& b) {
+	const GLint x = std::min(a.x, b.x), y = std::min(a.y, b.y);
+	const DamageRect result = {x, y, std::max(a.x + a.width, b.x + b.width) - x,
+							   std::max(a.y + a.height, b.y + b.height) - y};
+	return result;
+}
+
+void appendWord(std::vector<unsigned char>& out, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		out.push_back((unsigned char)(value >> (8 * i)));
+	}
+}
+
+}
+
+
+DamageTracker::DamageTracker(GLsizei width, GLsizei height) : width(width), height(height) {
+	if (width <= 0 || height <= 0) {
+		throw runtime_error("DamageTracker: empty frame");
+	}
+}
+
+void DamageTracker::add(const DamageRect& rect) {
+	const GLint x0 = std::max(rect.x, 0), y0 = std::max(rect.y, 0);
+	const GLint x1 = std::min(rect.x + rect.width, width), y1 = std::min(rect.y + rect.height, height);
+	if (x1 <= x0 || y1 <= y0) {
+		return;
+	}
+	const DamageRect clipped = {x0, y0, x1 - x0, y1 - y0};
+	rects.push_back(clipped);
+	coalesce();
+}
+
+void DamageTracker::addAll() {
+	const DamageRect all = {0, 0, width, height};
+	rects.assign(1, all);
+}
+
+void DamageTracker::reset() {
+	rects.clear();
+}
+
+std::vector<DamageRect> DamageTracker::regions() const {
+	return rects;
+}
+
+size_t DamageTracker::area() const {
+	size_t pixels = 0;
+	for (const DamageRect& rect : rects) {
+		pixels += (size_t)rect.width * rect.height;
+	}
+	return pixels;
+}
+
+/*
+ * Merge overlapping rectangles into their bounds until all are disjoint, and
+ * fall back to a single bounding rectangle when there are too many or they
+ * cover most of the frame anyway.
+ */
+void DamageTracker::coalesce() {
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; i < rects.size() && !merged; i++) {
+			for (size_t j = i + 1; j < rects.size(); j++) {
+				if (overlaps(rects[i], rects[j])) {
+					rects[i] = bounds(rects[i], rects[j]);
+					rects.erase(rects.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	if (rects.size() > maxRects || area() * 4 > (size_t)width * height * 3) {
+		DamageRect all = rects.front();
+		for (const DamageRect& rect : rects) {
+			all = bounds(all, rect);
+		}
+		rects.assign(1, all);
+	}
+}
+
+size_t readDamage(const std::vector<DamageRect>& rects, GLenum format, GLenum type, GLsizei width,
+				  unsigned char* frame) {
+	const size_t pixelBytes = pixelSize(format, type);
+	size_t bytes = 0;
+
+	// Each rectangle lands at its own place in the full-width frame.
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, width);
+	for (const DamageRect& rect : rects) {
+		glPixelStorei(GL_PACK_SKIP_PIXELS, rect.x);
+		glPixelStorei(GL_PACK_SKIP_ROWS, rect.y);
+		glReadPixels(rect.x, rect.y, rect.width, rect.height, format, type, frame);
+		bytes += (size_t)rect.width * rect.height * pixelBytes;
+	}
+	glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	assertOpenGLError("readDamage glReadPixels");
+	return bytes;
+}
+
+void appendDeltaRecords(const std::vector<DamageRect>& rects, const unsigned char* frame, GLsizei width,
+						GLsizei height, size_t pixelBytes, std::vector<unsigned char>& out) {
+	const size_t stride = (size_t)width * pixelBytes;
+	for (const DamageRect& rect : rects) {
+		// Top-down like the full frames the server sends.
+		const GLint top = height - rect.y - rect.height;
+		appendWord(out, (uint32_t)rect.x);
+		appendWord(out, (uint32_t)top);
+		appendWord(out, (uint32_t)rect.width);
+		appendWord(out, (uint32_t)rect.height);
+
+		const size_t rowBytes = (size_t)rect.width * pixelBytes;
+		for (GLsizei row = rect.height - 1; row >= 0; row--) {
+			const unsigned char* source = frame + (size_t)(rect.y + row) * stride + rect.x * pixelBytes;
+			out.insert(out.end(), source, source + rowBytes);
+		}
+	}
+}
@@ -0,0 +1,91 @@
+/*
+ * Damage tracking for frames that change only in places.
+ *
+ * The draws of a frame report the rectangles they touch; the tracker clips
+ * and coalesces them. Only those rectangles are read back, straight into
+ * their place in the host copy of the frame: glReadPixels with
+ * GL_PACK_ROW_LENGTH set to the frame width and GL_PACK_SKIP_PIXELS/ROWS to
+ * the rectangle origin writes a sub-rectangle into a full-size buffer. The
+ * same rectangles can be sent as delta records against the previous frame.
+ *
+ * Delta records, one per rectangle, all integers little-endian uint32:
+ *
+ *   x y width height      origin in top-down image coordinates
+ *   height rows of width pixels, top row first
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_DAMAGE_TRACKER_H
+#define EGL_OFFSCREEN_DAMAGE_TRACKER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "gl_common.h"
+
+struct DamageRect {
+	GLint x, y;		/* bottom-left corner in GL window coordinates */
+	GLsizei width, height;
+};
+
+class DamageTracker {
+public:
+	/*
+	 * Above this many rectangles, or once they cover most of the frame, the
+	 * damage collapses into one bounding rectangle: fewer, larger reads beat
+	 * many small ones.
+	 */
+	static const size_t maxRects = 16;
+
+	DamageTracker(GLsizei width, GLsizei height);
+
+	/*
+	 * Mark rect as changed; the part outside the frame is ignored.
+	 */
+	void add(const DamageRect& rect);
+	void addAll();
+
+	/*
+	 * Forget the damage, for the next frame.
+	 */
+	void reset();
+
+	/*
+	 * The coalesced damage: disjoint rectangles, empty if nothing changed.
+	 */
+	std::vector<DamageRect> regions() const;
+
+	/*
+	 * Pixels covered by regions().
+	 */
+	size_t area() const;
+
+	GLsizei frameWidth() const { return width; }
+	GLsizei frameHeight() const { return height; }
+
+private:
+	void coalesce();
+
+	GLsizei width, height;
+	std::vector<DamageRect> rects;
+};
+
+/*
+ * Read rects of the bound read framebuffer in format/type into frame, a
+ * bottom-up copy of the whole width-pixel-wide framebuffer, leaving the rest
+ * of frame untouched. Restores the pack row length and skips. Returns the
+ * bytes read.
+ */
+size_t readDamage(const std::vector<DamageRect>& rects, GLenum format, GLenum type, GLsizei width,
+				  unsigned char* frame);
+
+/*
+ * Append the delta records of rects, taken from the bottom-up frame of
+ * width x height pixels of pixelBytes each, to out.
+ */
+void appendDeltaRecords(const std::vector<DamageRect>& rects, const unsigned char* frame, GLsizei width,
+						GLsizei height, size_t pixelBytes, std::vector<unsigned char>& out);
+
+#endif
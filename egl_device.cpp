@@ -0,0 +1,283 @@
+/*
+ * EGL device enumeration and platform display selection.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "egl_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+namespace {
+
+bool hasExtension(const char* extensions, const char* name) {
+	if (!extensions) {
+		return false;
+	}
+	const size_t length = strlen(name);
+	for (const char* p = extensions; (p = strstr(p, name)) != nullptr; p += length) {
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* clientExtensions() {
+	// Client extensions are queried on EGL_NO_DISPLAY; fails (with EGL_BAD_DISPLAY) on EGL 1.4 without EGL_EXT_client_extensions.
+	const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	eglGetError();
+	return extensions;
+}
+
+/*
+ * Logs the duration of one initialization phase when it goes out of scope.
+ */
+class PhaseTimer {
+public:
+	explicit PhaseTimer(const char* phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+	~PhaseTimer() {
+		const double ms =
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "EGL init: " << phase << " " << ms << " ms" << std::endl;
+	}
+
+private:
+	const char* phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+EGLDisplay getPlatformDisplay(EGLenum platform, void* nativeDisplay) {
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplayEXT =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!getPlatformDisplayEXT) {
+		throw runtime_error("eglGetPlatformDisplayEXT is not available");
+	}
+	EGLDisplay display = getPlatformDisplayEXT(platform, nativeDisplay, nullptr);
+	assertEGLError("eglGetPlatformDisplayEXT");
+	return display;
+}
+
+const EglDeviceInfo& findDevice(const std::vector<EglDeviceInfo>& devices, const std::string& device) {
+	char* end = nullptr;
+	const unsigned long index = strtoul(device.c_str(), &end, 10);
+	if (!device.empty() && *end == '\0') {
+		if (index >= devices.size()) {
+			throw runtime_error("EGL device index " + device + " out of range");
+		}
+		return devices[index];
+	}
+
+	for (size_t i = 0; i < devices.size(); i++) {
+		const EglDeviceInfo& info = devices[i];
+		if (info.name.find(device) != std::string::npos || info.drmDevice.find(device) != std::string::npos ||
+			info.renderNode.find(device) != std::string::npos) {
+			return info;
+		}
+	}
+	throw runtime_error("No EGL device matches \"" + device + "\"");
+}
+
+}
+
+
+std::vector<EglDeviceInfo> enumerateEglDevices() {
+	std::vector<EglDeviceInfo> result;
+
+	const char* extensions = clientExtensions();
+	if (!hasExtension(extensions, "EGL_EXT_device_enumeration") && !hasExtension(extensions, "EGL_EXT_device_base")) {
+		return result;
+	}
+
+	PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	PFNEGLQUERYDEVICESTRINGEXTPROC queryDeviceString =
+		(PFNEGLQUERYDEVICESTRINGEXTPROC)eglGetProcAddress("eglQueryDeviceStringEXT");
+	if (!queryDevices || !queryDeviceString) {
+		return result;
+	}
+
+	EGLint count = 0;
+	if (!queryDevices(0, nullptr, &count) || count <= 0) {
+		eglGetError();
+		return result;
+	}
+	std::vector<EGLDeviceEXT> devices(count);
+	queryDevices(count, devices.data(), &count);
+	assertEGLError("eglQueryDevicesEXT");
+
+	for (EGLint i = 0; i < count; i++) {
+		EglDeviceInfo info;
+		info.index = i;
+		info.device = devices[i];
+
+		const char* deviceExtensions = queryDeviceString(devices[i], EGL_EXTENSIONS);
+		info.extensions = deviceExtensions ? deviceExtensions : "";
+		if (hasExtension(deviceExtensions, "EGL_EXT_device_drm")) {
+			const char* file = queryDeviceString(devices[i], EGL_DRM_DEVICE_FILE_EXT);
+			info.drmDevice = file ? file : "";
+		}
+		if (hasExtension(deviceExtensions, "EGL_EXT_device_drm_render_node")) {
+			const char* file = queryDeviceString(devices[i], EGL_DRM_RENDER_NODE_FILE_EXT);
+			info.renderNode = file ? file : "";
+		}
+		eglGetError();
+
+		if (!info.renderNode.empty()) {
+			info.name = info.renderNode;
+		} else if (!info.drmDevice.empty()) {
+			info.name = info.drmDevice;
+		} else if (hasExtension(deviceExtensions, "EGL_MESA_device_software")) {
+			info.name = "software";
+		} else {
+			info.name = "unknown";
+		}
+		result.push_back(info);
+	}
+	return result;
+}
+
+EGLDisplay openEglDisplay(const std::string& platform, const std::string& device) {
+	std::string selected = device.empty() ? platform : "device";
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	const char* extensions;
+	{
+		PhaseTimer timer("client extensions");
+		extensions = clientExtensions();
+	}
+	const bool surfaceless = hasExtension(extensions, "EGL_MESA_platform_surfaceless");
+	const bool platformDevice = hasExtension(extensions, "EGL_EXT_platform_device");
+
+	if (selected == "auto") {
+		selected = surfaceless ? "surfaceless" : platformDevice ? "device" : "default";
+	}
+
+	if (selected == "surfaceless") {
+		if (!surfaceless) {
+			throw runtime_error("EGL_MESA_platform_surfaceless is not supported");
+		}
+		PhaseTimer timer("eglGetPlatformDisplay(surfaceless)");
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY);
+		std::cout << "EGL platform: surfaceless" << std::endl;
+	} else if (selected == "device") {
+		if (!platformDevice) {
+			throw runtime_error("EGL_EXT_platform_device is not supported");
+		}
+		std::vector<EglDeviceInfo> devices;
+		{
+			PhaseTimer timer("device enumeration");
+			devices = enumerateEglDevices();
+		}
+		if (devices.empty()) {
+			throw runtime_error("No EGL devices found");
+		}
+		const EglDeviceInfo& info = device.empty() ? devices[0] : findDevice(devices, device);
+		{
+			PhaseTimer timer("eglGetPlatformDisplay(device)");
+			display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, info.device);
+		}
+		std::cout << "EGL platform: device " << info.index << " (" << info.name << ")" << std::endl;
+	} else if (selected == "default") {
+		PhaseTimer timer("eglGetDisplay(EGL_DEFAULT_DISPLAY)");
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		assertEGLError("eglGetDisplay");
+		std::cout << "EGL platform: default display" << std::endl;
+	} else {
+		throw runtime_error("Unknown EGL platform \"" + platform + "\"");
+	}
+
+	if (display == EGL_NO_DISPLAY) {
+		throw runtime_error("No EGL display for platform " + selected);
+	}
+
+	{
+		PhaseTimer timer("eglInitialize");
+		eglInitialize(display, nullptr, nullptr);
+		assertEGLError("eglInitialize");
+	}
+	return display;
+}
+
+EglConfigInfo chooseEglConfig(EGLDisplay display, const EglConfigRequirements& requirements, size_t* matching) {
+	const EGLint attributes[] = {
+		EGL_SURFACE_TYPE, requirements.surfaceType,
+		EGL_RENDERABLE_TYPE, requirements.renderableType,
+		EGL_RED_SIZE, requirements.redSize,
+		EGL_GREEN_SIZE, requirements.greenSize,
+		EGL_BLUE_SIZE, requirements.blueSize,
+		EGL_ALPHA_SIZE, requirements.alphaSize,
+		EGL_DEPTH_SIZE, requirements.depthSize,
+		EGL_STENCIL_SIZE, requirements.stencilSize,
+		EGL_SAMPLES, requirements.samples,
+		EGL_NONE
+	};
+
+	EGLint count = 0;
+	eglChooseConfig(display, attributes, nullptr, 0, &count);
+	assertEGLError("eglChooseConfig");
+	std::vector<EGLConfig> configs(count);
+	if (count > 0) {
+		eglChooseConfig(display, attributes, configs.data(), count, &count);
+		assertEGLError("eglChooseConfig");
+		configs.resize(count);
+	}
+	if (configs.empty()) {
+		throw runtime_error("eglChooseConfig: no matching config");
+	}
+	if (matching) {
+		*matching = configs.size();
+	}
+
+	EglConfigInfo best = EglConfigInfo();
+	bool found = false;
+	for (EGLConfig config : configs) {
+		EglConfigInfo info;
+		info.config = config;
+		eglGetConfigAttrib(display, config, EGL_CONFIG_ID, &info.id);
+		eglGetConfigAttrib(display, config, EGL_RED_SIZE, &info.redSize);
+		eglGetConfigAttrib(display, config, EGL_GREEN_SIZE, &info.greenSize);
+		eglGetConfigAttrib(display, config, EGL_BLUE_SIZE, &info.blueSize);
+		eglGetConfigAttrib(display, config, EGL_ALPHA_SIZE, &info.alphaSize);
+		eglGetConfigAttrib(display, config, EGL_DEPTH_SIZE, &info.depthSize);
+		eglGetConfigAttrib(display, config, EGL_STENCIL_SIZE, &info.stencilSize);
+		eglGetConfigAttrib(display, config, EGL_SAMPLES, &info.samples);
+		eglGetConfigAttrib(display, config, EGL_CONFIG_CAVEAT, &info.caveat);
+		assertEGLError("eglGetConfigAttrib");
+
+		const EGLint bits = info.redSize + info.greenSize + info.blueSize + info.alphaSize + info.depthSize +
+							info.stencilSize;
+		info.bytesPerPixel = (size_t)(bits + 7) / 8 * std::max<EGLint>(info.samples, 1);
+
+		// No caveat, then the smallest footprint, then the lowest id for a stable choice.
+		const bool clean = info.caveat == EGL_NONE, bestClean = best.caveat == EGL_NONE;
+		const bool better = !found || (clean && !bestClean) ||
+							(clean == bestClean && (info.bytesPerPixel < best.bytesPerPixel ||
+													(info.bytesPerPixel == best.bytesPerPixel && info.id < best.id)));
+		if (better) {
+			best = info;
+			found = true;
+		}
+	}
+	return best;
+}
+
+std::string describeEglConfig(const EglConfigInfo& info) {
+	std::ostringstream s;
+	s << "id " << info.id << ", rgba " << info.redSize << info.greenSize << info.blueSize << info.alphaSize
+	  << ", depth " << info.depthSize << ", stencil " << info.stencilSize << ", " << info.samples << " samples, "
+	  << info.bytesPerPixel << " bytes/pixel";
+	if (info.caveat != EGL_NONE) {
+		s << (info.caveat == EGL_SLOW_CONFIG ? ", slow" : ", non-conformant");
+	}
+	return s.str();
+}
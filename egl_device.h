@@ -0,0 +1,85 @@
+/*
+ * Explicit EGL display selection for headless nodes.
+ *
+ * Instead of letting eglGetDisplay(EGL_DEFAULT_DISPLAY) probe the native
+ * platforms (which may go through X11), the display is created on an
+ * explicitly chosen platform: a device from EGL_EXT_device_enumeration via
+ * EGL_EXT_platform_device, or EGL_MESA_platform_surfaceless.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_EGL_DEVICE_H
+#define EGL_OFFSCREEN_EGL_DEVICE_H
+
+#include <string>
+#include <vector>
+
+#include "gl_common.h"
+#include <EGL/eglext.h>
+
+struct EglDeviceInfo {
+	size_t index;
+	EGLDeviceEXT device;
+	std::string name;			/* render node, primary node or "software" */
+	std::string drmDevice;		/* EGL_DRM_DEVICE_FILE_EXT, if any */
+	std::string renderNode;		/* EGL_DRM_RENDER_NODE_FILE_EXT, if any */
+	std::string extensions;
+};
+
+/*
+ * List the devices exposed through EGL_EXT_device_enumeration. Returns an
+ * empty list when the extension is missing.
+ */
+std::vector<EglDeviceInfo> enumerateEglDevices();
+
+/*
+ * Create and initialize a display.
+ *
+ * platform is one of "auto", "surfaceless", "device" or "default". "auto"
+ * prefers EGL_MESA_platform_surfaceless, then the first enumerated device,
+ * then EGL_DEFAULT_DISPLAY. A non-empty device (an index, or a substring of
+ * the device name/node path) implies the "device" platform.
+ *
+ * The time spent in each initialization phase is logged to stdout.
+ */
+EGLDisplay openEglDisplay(const std::string& platform, const std::string& device);
+
+/*
+ * What a job needs from the EGL config. Sizes are minimums in bits, 0 for
+ * "not needed".
+ */
+struct EglConfigRequirements {
+	EGLint surfaceType = EGL_PBUFFER_BIT;
+	EGLint renderableType = EGL_OPENGL_BIT;
+	EGLint redSize = 0, greenSize = 0, blueSize = 0, alphaSize = 0;
+	EGLint depthSize = 0, stencilSize = 0;
+	EGLint samples = 0;
+};
+
+struct EglConfigInfo {
+	EGLConfig config;
+	EGLint id;
+	EGLint redSize, greenSize, blueSize, alphaSize;
+	EGLint depthSize, stencilSize, samples;
+	EGLint caveat;
+	size_t bytesPerPixel;	/* color, depth and stencil, times the samples */
+};
+
+/*
+ * Choose the config meeting requirements without a caveat if there is one,
+ * and among those the one with the smallest per-pixel footprint, instead of the first one
+ * eglChooseConfig returns, which sorts the deepest color buffers first.
+ * matching receives the number of candidates if given. Throws if no config
+ * matches.
+ */
+EglConfigInfo chooseEglConfig(EGLDisplay display, const EglConfigRequirements& requirements,
+							  size_t* matching = nullptr);
+
+/*
+ * "id 5, rgba 8888, depth 24, stencil 8, 0 samples, 8 bytes/pixel"
+ */
+std::string describeEglConfig(const EglConfigInfo& info);
+
+#endif
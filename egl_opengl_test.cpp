@@ -25,63 +25,45 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
-#include <map>
 #include <vector>
 #include <string>
+#include <thread>
 #include <string.h>
+#include <stdlib.h>
 
 /*
- * OpenCV for saving the render target as an image file.
+ * EGL and OpenGL headers.
  */
-//#include <opencv2/opencv.hpp>
-
-/*
- * EGL headers.
- */
-#include <EGL/egl.h>
-
-/*
- * OpenGL headers.
- */
-#define GL_GLEXT_PROTOTYPES 1
-#include <GL/gl.h>
-#include <GL/glext.h>
+#include "gl_common.h"
+#include "egl_device.h"
+#include "frame_ring.h"
+#include "gpu_convert.h"
+#include "gl_extensions.h"
+#include "gl_debug.h"
+#include "capability_cache.h"
+#include "benchmark.h"
+#include "image_writer.h"
+#include "layered_renderer.h"
+#include "metrics.h"
+#include "pbo_readback.h"
+#include "raw_frame_sink.h"
+#include "readback_format.h"
+#include "render_pool.h"
+#include "render_server.h"
+#include "render_target_pool.h"
+#include "shader_cache.h"
+#include "texture_uploader.h"
+#include "tiled_renderer.h"
 
 using namespace std;
 
 
-//test added comment
-
-bool isGlextSupported(const char extension[])
-{
-	GLubyte *where, *terminator;
-
-	// Extension names should not have spaces.
-	where = (GLubyte*) strchr(extension, ' ');
-	if (where || extension[0] == '\0') return false;
-
-	const GLubyte* extensions = glGetString(GL_EXTENSIONS);
-	if (!extensions) return false;  //glGetString did not return a string
-
-	// It takes a bit of care to be fool-proof about parsing the
-	// OpenGL extensions string. Don't be fooled by sub-strings, etc.
-	const GLubyte* start = extensions;
-	for (;;)
-	{
-		where = (GLubyte*)strstr((const char*)start, extension);
-		if (!where)	return false;
-		terminator = where + strlen(extension);
-		if ((where == start || *(where - 1) == ' ') && (*terminator == ' ' || *terminator == '\0'))
-			return true;
-		start = terminator;
-	}
-}
-
-
-
 /*
  *	Converting character into a constant string in the precompiling stage.
  */
@@ -106,286 +88,248 @@ GLfloat glGetFloatvtmp;
 	glGetFloatv(glenum, &glGetFloatvtmp);                                                                              \
 	printf(#glenum " : %f\n", glGetFloatvtmp);
 
+/*
+ * The capability table is a constexpr flat array of POD rows in .rodata, so
+ * nothing is allocated before main(). Each extension owns a contiguous index
+ * range of capabilityRows, preceded by a header row carrying its name.
+ */
+typedef enum capability_type_t {
+	GLIF_HEADER,	/* first row of an extension group, not a capability */
+	GLIF_INT32,
+	GLIF_INT64,
+	GLIF_FLOAT
+} CapabilityType;
+
 typedef struct capability_entry_t {
+	const char* name;
 	GLenum capability;
-	size_t nrValues;
+	unsigned char nrValues;
+	CapabilityType type;
 } CapabilityEntry;
 
-// TODO add support for multie dim
 typedef struct extension_entry_t {
-	std::string name;							  /*	*/
-	std::map<std::string, CapabilityEntry> Int32; /*	*/
-	std::map<std::string, CapabilityEntry> Int64; /*	*/
-	std::map<std::string, CapabilityEntry> Float; /*	*/
+	const char* name;
+	unsigned short first;	/* index of the first capability in capabilityRows */
+	unsigned short count;
 } ExtensionEntry;
 
-#define GLIF_MACRON(glenum, x)                                                                                         \
-	{                                                                                                                  \
-#glenum, { glenum, x }                                                                                         \
-	}
-
-#define GLIF_MACRO(glenum)                                                                                             \
-	{                                                                                                                  \
-#glenum, { glenum, 1 }                                                                                         \
-	}
-
-std::vector<ExtensionEntry> extensionList = {
-	{"GL_VERSION_1_1",
-	 {
-		 GLIF_MACRO(GL_MAX_LIST_NESTING),
-		 GLIF_MACRO(GL_MAX_EVAL_ORDER),
-		 GLIF_MACRO(GL_MAX_LIGHTS),
-		 GLIF_MACRO(GL_MAX_TEXTURE_SIZE),
-		 GLIF_MACRO(GL_MAX_PIXEL_MAP_TABLE),
-		 GLIF_MACRO(GL_MAX_ATTRIB_STACK_DEPTH),
-		 GLIF_MACRO(GL_MAX_MODELVIEW_STACK_DEPTH),
-		 GLIF_MACRO(GL_MAX_NAME_STACK_DEPTH),
-		 GLIF_MACRO(GL_MAX_PROJECTION_STACK_DEPTH),
-		 GLIF_MACRO(GL_MAX_TEXTURE_STACK_DEPTH),
-		 GLIF_MACRO(GL_MAX_VIEWPORT_DIMS),
-		 GLIF_MACRO(GL_MAX_CLIENT_ATTRIB_STACK_DEPTH),
-	 },
-	 {},
-	 {}},
-	{"GL_VERSION_1_2",
-	 {
-		 GLIF_MACRO(GL_MAX_3D_TEXTURE_SIZE),
-		 GLIF_MACRO(GL_MAX_ELEMENTS_VERTICES),
-		 GLIF_MACRO(GL_MAX_ELEMENTS_INDICES),
-	 },
-	 {},
-	 {}},
-	{"GL_VERSION_1_3", {GLIF_MACRO(GL_MAX_TEXTURE_UNITS), GLIF_MACRO(GL_MAX_CUBE_MAP_TEXTURE_SIZE)}, {}, {}},
-	{"GL_VERSION_1_4", {}, {}, {GLIF_MACRO(GL_MAX_TEXTURE_LOD_BIAS)}},
-	{"GL_VERSION_2_0",
-	 {
-		 GLIF_MACRO(GL_MAX_DRAW_BUFFERS),
-		 GLIF_MACRO(GL_MAX_VERTEX_ATTRIBS),
-		 GLIF_MACRO(GL_MAX_TEXTURE_COORDS),
-		 GLIF_MACRO(GL_MAX_TEXTURE_IMAGE_UNITS),
-		 GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_VARYING_FLOATS),
-		 GLIF_MACRO(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS),
-		 GLIF_MACRO(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS),
-	 },
-	 {},
-	 {}},
-	{"GL_VERSION_3_0",
-	 {GLIF_MACRO(GL_MAX_CLIP_DISTANCES), GLIF_MACRO(GL_MAX_CLIP_PLANES), GLIF_MACRO(GL_MAX_VARYING_COMPONENTS),
-	  GLIF_MACRO(GL_MAX_VARYING_FLOATS), GLIF_MACRO(GL_NUM_EXTENSIONS), GLIF_MACRO(GL_MAX_ARRAY_TEXTURE_LAYERS),
-	  GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_COMPONENTS),
-	  GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS),
-	  GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_ATTRIBS), GLIF_MACRO(GL_MAX_PROGRAM_TEXEL_OFFSET),
-	  GLIF_MACRO(GL_MIN_PROGRAM_TEXEL_OFFSET)},
-	 {},
-	 {}},
-	{"GL_VERSION_3_1", {GLIF_MACRO(GL_MAX_RECTANGLE_TEXTURE_SIZE)}, {}, {}},
-	{"GL_VERSION_3_2",
-	 {
-		 GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_VERTEX_OUTPUT_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_INPUT_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_COMPONENTS),
-		 GLIF_MACRO(GL_MAX_FRAGMENT_INPUT_COMPONENTS),
-	 },
-	 {},
-	 {}},
-	{"GL_VERSION_4_4", {GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_STRIDE)}, {}, {}},
-	{"GL_VERSION_4_6", {GLIF_MACRO(GL_NUM_SPIR_V_EXTENSIONS)}, {}, {}},
-	{"GL_ARB_ES2_compatibility",
-	 {
-		 GLIF_MACRO(GL_NUM_SHADER_BINARY_FORMATS),
-		 GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_VECTORS),
-		 GLIF_MACRO(GL_MAX_VARYING_VECTORS),
-		 GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_VECTORS),
-	 },
-	 {},
-	 {}},
-	{"GL_AMD_debug_output",
-	 {GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH_AMD), GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES_AMD)},
-	 {},
-	 {}},
-	{"GL_ARB_debug_output",
-	 {GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH_ARB), GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES_ARB)},
-	 {},
-	 {}},
-	{"GL_ARB_texture_multisample",
-	 {GLIF_MACRO(GL_MAX_SAMPLE_MASK_WORDS), GLIF_MACRO(GL_MAX_COLOR_TEXTURE_SAMPLES),
-	  GLIF_MACRO(GL_MAX_DEPTH_TEXTURE_SAMPLES), GLIF_MACRO(GL_MAX_INTEGER_SAMPLES)},
-	 {},
-	 {}},
-
-	{"GL_AMD_sparse_texture",
-	 {GLIF_MACRO(GL_MAX_SPARSE_TEXTURE_SIZE_AMD), GLIF_MACRO(GL_MAX_SPARSE_ARRAY_TEXTURE_LAYERS)},
-	 {GLIF_MACRO(GL_MAX_SPARSE_3D_TEXTURE_SIZE_AMD)},
-	 {}},
-	{"GL_ARB_sparse_texture",
-	 {GLIF_MACRO(GL_MAX_SPARSE_TEXTURE_SIZE_ARB), GLIF_MACRO(GL_MAX_SPARSE_3D_TEXTURE_SIZE_ARB),
-	  GLIF_MACRO(GL_MAX_SPARSE_ARRAY_TEXTURE_LAYERS_ARB)},
-	 {},
-	 {}},
-	{"GL_ARB_ES2_compatibility",
-	 {GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_VECTORS), GLIF_MACRO(GL_MAX_VARYING_VECTORS),
-	  GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_VECTORS)},
-	 {},
-	 {}},
-	{"GL_ARB_ES3_compatibility", {GLIF_MACRO(GL_MAX_ELEMENT_INDEX)}, {}, {}},
-	{"GL_ARB_blend_func_extended", {GLIF_MACRO(GL_MAX_DUAL_SOURCE_DRAW_BUFFERS)}, {}, {}},
-	{"GL_ARB_compute_shader",
-	 {GLIF_MACRO(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE), GLIF_MACRO(GL_MAX_COMPUTE_UNIFORM_COMPONENTS),
-	  GLIF_MACRO(GL_MAX_COMPUTE_ATOMIC_COUNTER_BUFFERS), GLIF_MACRO(GL_MAX_COMPUTE_ATOMIC_COUNTERS),
-	  GLIF_MACRO(GL_MAX_COMBINED_COMPUTE_UNIFORM_COMPONENTS), GLIF_MACRO(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS),
-	  GLIF_MACRO(GL_MAX_COMPUTE_UNIFORM_BLOCKS), GLIF_MACRO(GL_MAX_COMPUTE_TEXTURE_IMAGE_UNITS),
-	  GLIF_MACRO(GL_MAX_COMPUTE_IMAGE_UNIFORMS), GLIF_MACRON(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 3),
-	  GLIF_MACRON(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 3)},
-	 {},
-	 {}},
-	{"GL_ARB_compute_variable_group_size",
-	 {GLIF_MACRO(GL_MAX_COMPUTE_FIXED_GROUP_INVOCATIONS_ARB), GLIF_MACRON(GL_MAX_COMPUTE_FIXED_GROUP_SIZE_ARB, 3),
-	  GLIF_MACRO(GL_MAX_COMPUTE_VARIABLE_GROUP_INVOCATIONS_ARB),
-	  GLIF_MACRON(GL_MAX_COMPUTE_VARIABLE_GROUP_SIZE_ARB, 3)},
-	 {},
-	 {}},
-	{"GL_ARB_cull_distance",
-	 {GLIF_MACRO(GL_MAX_CULL_DISTANCES), GLIF_MACRO(GL_MAX_COMBINED_CLIP_AND_CULL_DISTANCES)},
-	 {},
-	 {}},
-	{"GL_ARB_draw_buffers", {GLIF_MACRO(GL_MAX_DRAW_BUFFERS_ARB)}, {}, {}},
-	{"GL_ARB_explicit_uniform_location", {GLIF_MACRO(GL_MAX_UNIFORM_LOCATIONS)}, {}, {}},
-	{"GL_ARB_fragment_program",
-	 {GLIF_MACRO(GL_MAX_TEXTURE_COORDS_ARB), GLIF_MACRO(GL_MAX_TEXTURE_IMAGE_UNITS_ARB)},
-	 {},
-	 {}},
-	{"GL_ARB_fragment_shader", {GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS_ARB)}, {}, {}},
-	{"GL_ARB_framebuffer_no_attachments",
-	 {GLIF_MACRO(GL_MAX_FRAMEBUFFER_WIDTH), GLIF_MACRO(GL_MAX_FRAMEBUFFER_HEIGHT),
-	  GLIF_MACRO(GL_MAX_FRAMEBUFFER_LAYERS), GLIF_MACRO(GL_MAX_FRAMEBUFFER_SAMPLES)},
-	 {},
-	 {}},
-
-	{"GL_EXT_framebuffer_multisample", {GLIF_MACRO(GL_MAX_SAMPLES_EXT)}, {}, {}},
-	{"GL_ARB_framebuffer_object",
-	 {GLIF_MACRO(GL_MAX_RENDERBUFFER_SIZE), GLIF_MACRO(GL_MAX_COLOR_ATTACHMENTS), GLIF_MACRO(GL_MAX_SAMPLES)},
-	 {},
-	 {}},
-	{"GL_ARB_geometry_shader4",
-	 {GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS_ARB), GLIF_MACRO(GL_MAX_GEOMETRY_VARYING_COMPONENTS_ARB),
-	  GLIF_MACRO(GL_MAX_VERTEX_VARYING_COMPONENTS_ARB), GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS_ARB),
-	  GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES_ARB), GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS_ARB)},
-	 {},
-	 {}},
-	{"GL_ARB_gpu_shader5",
-	 {GLIF_MACRO(GL_MAX_GEOMETRY_SHADER_INVOCATIONS), GLIF_MACRO(GL_MAX_FRAGMENT_INTERPOLATION_OFFSET),
-	  GLIF_MACRO(GL_MAX_VERTEX_STREAMS)},
-	 {},
-	 {}},
-	{"GL_ARB_matrix_palette",
-	 {GLIF_MACRO(GL_MAX_MATRIX_PALETTE_STACK_DEPTH_ARB), GLIF_MACRO(GL_MAX_PALETTE_MATRICES_ARB)},
-	 {},
-	 {}},
-	{"GL_ARB_multitexture", {GLIF_MACRO(GL_MAX_TEXTURE_UNITS_ARB)}, {}, {}},
-	{"GL_ARB_parallel_shader_compile", {GLIF_MACRO(GL_MAX_SHADER_COMPILER_THREADS_ARB)}, {}, {}},
-	{"GL_ARB_shader_atomic_counters",
-	 {GLIF_MACRO(GL_MAX_VERTEX_ATOMIC_COUNTER_BUFFERS), GLIF_MACRO(GL_MAX_TESS_CONTROL_ATOMIC_COUNTER_BUFFERS),
-	  GLIF_MACRO(GL_MAX_TESS_EVALUATION_ATOMIC_COUNTER_BUFFERS), GLIF_MACRO(GL_MAX_GEOMETRY_ATOMIC_COUNTER_BUFFERS),
-	  GLIF_MACRO(GL_MAX_FRAGMENT_ATOMIC_COUNTER_BUFFERS), GLIF_MACRO(GL_MAX_COMBINED_ATOMIC_COUNTER_BUFFERS),
-	  GLIF_MACRO(GL_MAX_VERTEX_ATOMIC_COUNTERS), GLIF_MACRO(GL_MAX_TESS_CONTROL_ATOMIC_COUNTERS),
-	  GLIF_MACRO(GL_MAX_TESS_EVALUATION_ATOMIC_COUNTERS), GLIF_MACRO(GL_MAX_GEOMETRY_ATOMIC_COUNTERS),
-	  GLIF_MACRO(GL_MAX_FRAGMENT_ATOMIC_COUNTERS), GLIF_MACRO(GL_MAX_COMBINED_ATOMIC_COUNTERS),
-	  GLIF_MACRO(GL_MAX_ATOMIC_COUNTER_BUFFER_SIZE), GLIF_MACRO(GL_MAX_ATOMIC_COUNTER_BUFFER_BINDINGS)},
-	 {},
-	 {}},
-	{"GL_ARB_shader_image_load_store",
-	 {GLIF_MACRO(GL_MAX_IMAGE_UNITS), GLIF_MACRO(GL_MAX_COMBINED_IMAGE_UNITS_AND_FRAGMENT_OUTPUTS),
-	  GLIF_MACRO(GL_MAX_IMAGE_SAMPLES), GLIF_MACRO(GL_MAX_VERTEX_IMAGE_UNIFORMS),
-	  GLIF_MACRO(GL_MAX_TESS_CONTROL_IMAGE_UNIFORMS), GLIF_MACRO(GL_MAX_TESS_EVALUATION_IMAGE_UNIFORMS),
-	  GLIF_MACRO(GL_MAX_GEOMETRY_IMAGE_UNIFORMS), GLIF_MACRO(GL_MAX_FRAGMENT_IMAGE_UNIFORMS),
-	  GLIF_MACRO(GL_MAX_COMBINED_IMAGE_UNIFORMS)},
-	 {},
-	 {}},
-	{"GL_ARB_uniform_buffer_object",
-	 {GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_BLOCKS), GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_BLOCKS),
-	  GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_BLOCKS), GLIF_MACRO(GL_MAX_COMBINED_UNIFORM_BLOCKS),
-	  GLIF_MACRO(GL_MAX_UNIFORM_BUFFER_BINDINGS), GLIF_MACRO(GL_MAX_UNIFORM_BLOCK_SIZE),
-	  GLIF_MACRO(GL_MAX_COMBINED_VERTEX_UNIFORM_COMPONENTS), GLIF_MACRO(GL_MAX_COMBINED_GEOMETRY_UNIFORM_COMPONENTS),
-	  GLIF_MACRO(GL_MAX_COMBINED_FRAGMENT_UNIFORM_COMPONENTS), GLIF_MACRO(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)},
-
-	 {},
-	 {}},
-	{"GL_ARB_shader_storage_buffer_object",
-	 {GLIF_MACRO(GL_MAX_COMBINED_SHADER_OUTPUT_RESOURCES), GLIF_MACRO(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS),
-	  GLIF_MACRO(GL_MAX_GEOMETRY_SHADER_STORAGE_BLOCKS), GLIF_MACRO(GL_MAX_TESS_CONTROL_SHADER_STORAGE_BLOCKS),
-	  GLIF_MACRO(GL_MAX_TESS_EVALUATION_SHADER_STORAGE_BLOCKS), GLIF_MACRO(GL_MAX_FRAGMENT_SHADER_STORAGE_BLOCKS),
-	  GLIF_MACRO(GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS), GLIF_MACRO(GL_MAX_COMBINED_SHADER_STORAGE_BLOCKS),
-	  GLIF_MACRO(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS), GLIF_MACRO(GL_MAX_SHADER_STORAGE_BLOCK_SIZE),
-	  GLIF_MACRO(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT)},
-	 {},
-	 {}},
-	{"GL_ARB_shader_subroutine",
-	 {GLIF_MACRO(GL_MAX_SUBROUTINES), GLIF_MACRO(GL_MAX_SUBROUTINE_UNIFORM_LOCATIONS)},
-	 {},
-	 {}},
-	{"GL_ARB_map_buffer_alignment", {GLIF_MACRO(GL_MIN_MAP_BUFFER_ALIGNMENT)}, {}, {}},
-	{"GL_EXT_bindable_uniform",
-	 {GLIF_MACRO(GL_MAX_VERTEX_BINDABLE_UNIFORMS_EXT), GLIF_MACRO(GL_MAX_FRAGMENT_BINDABLE_UNIFORMS_EXT),
-	  GLIF_MACRO(GL_MAX_GEOMETRY_BINDABLE_UNIFORMS_EXT), GLIF_MACRO(GL_MAX_BINDABLE_UNIFORM_SIZE_EXT)},
-	 {},
-	 {}},
-	{"GL_EXT_geometry_shader4",
-	 {
-		 GLIF_MACRO(GL_MAX_VARYING_COMPONENTS_EXT),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS_EXT),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_VARYING_COMPONENTS_EXT),
-		 GLIF_MACRO(GL_MAX_VERTEX_VARYING_COMPONENTS_EXT),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS_EXT),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES_EXT),
-		 GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS_EXT),
-	 },
-	 {},
-	 {}},
-	{"GL_EXT_framebuffer_object",
-	 {
-		 GLIF_MACRO(GL_MAX_RENDERBUFFER_SIZE_EXT),
-		 GLIF_MACRO(GL_MAX_COLOR_ATTACHMENTS_EXT),
-	 },
-	 {},
-	 {}},
-	{"GL_EXT_texture3D", {GLIF_MACRO(GL_MAX_3D_TEXTURE_SIZE_EXT)}, {}, {}},
-	{"GL_ARB_texture_compression", {GLIF_MACRO(GL_NUM_COMPRESSED_TEXTURE_FORMATS_ARB)}, {}, {}},
-	{"GL_ARB_vertex_attrib_binding",
-	 {GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_RELATIVE_OFFSET), GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_BINDINGS)},
-	 {},
-	 {}},
-	{"GL_ARB_texture_buffer_range", {GLIF_MACRO(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT)}, {}, {}},
-	{"GL_ARB_vertex_program",
-	 {
-		 GLIF_MACRO(GL_MAX_PROGRAM_MATRIX_STACK_DEPTH_ARB),
-		 GLIF_MACRO(GL_MAX_PROGRAM_MATRICES_ARB),
-		 GLIF_MACRO(GL_MAX_VERTEX_ATTRIBS_ARB),
-	 },
-	 {},
-	 {}},
-	{"GL_EXT_raster_multisample", {}, {GLIF_MACRO(GL_MAX_RASTER_SAMPLES_EXT)}, {}},
-	{"GL_OVR_multiview", {}, {GLIF_MACRO(GL_MAX_VIEWS_OVR)}, {}},
-	{"GL_KHR_debug",
-	 {GLIF_MACRO(GL_MAX_DEBUG_GROUP_STACK_DEPTH), GLIF_MACRO(GL_MAX_LABEL_LENGTH),
-	  GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH), GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES)},
-	 {},
-	 {}},
-
-	{"GL_ARB_sync", {}, {GLIF_MACRO(GL_MAX_SERVER_WAIT_TIMEOUT)}, {}},
-
-	{"GL_SGIX_async_histogram", {}, {GLIF_MACRO(GL_MAX_ASYNC_HISTOGRAM_SGIX)}, {}},
-	{"GL_ARB_polygon_offset_clamp", {}, {}, {GLIF_MACRO(GL_POLYGON_OFFSET_CLAMP)}},
+#define GLIF_EXTENSION(name) {#name, 0, 0, GLIF_HEADER},
+#define GLIF_MACRON(glenum, x) {#glenum, glenum, x, GLIF_INT32},
+#define GLIF_MACRO(glenum) {#glenum, glenum, 1, GLIF_INT32},
+#define GLIF_MACRO64(glenum) {#glenum, glenum, 1, GLIF_INT64},
+#define GLIF_MACROF(glenum) {#glenum, glenum, 1, GLIF_FLOAT},
+constexpr CapabilityEntry capabilityRows[] = {
+#include "gl_capability_table.h"
+};
+#undef GLIF_EXTENSION
+#undef GLIF_MACRON
+#undef GLIF_MACRO
+#undef GLIF_MACRO64
+#undef GLIF_MACROF
+
+constexpr size_t capabilityRowCount = sizeof(capabilityRows) / sizeof(capabilityRows[0]);
+
+/*
+ * One enumerator per extension: listing an extension twice in the table is a
+ * redeclaration and does not compile.
+ */
+#define GLIF_EXTENSION(name) GLIF_EXTENSION_##name,
+#define GLIF_MACRON(glenum, x)
+#define GLIF_MACRO(glenum)
+#define GLIF_MACRO64(glenum)
+#define GLIF_MACROF(glenum)
+enum ExtensionId {
+#include "gl_capability_table.h"
+	GLIF_EXTENSION_COUNT
 };
+#undef GLIF_EXTENSION
+
+/*
+ * Row index of the header of the extension-th group, capabilityRowCount past
+ * the last group.
+ */
+constexpr unsigned headerRow(unsigned extension, unsigned row = 0) {
+	return row == capabilityRowCount ? row
+		   : capabilityRows[row].type != GLIF_HEADER ? headerRow(extension, row + 1)
+		   : extension == 0 ? row
+		   : headerRow(extension - 1, row + 1);
+}
 
+#define GLIF_EXTENSION(name)                                                                                           \
+	{#name, (unsigned short)(headerRow(GLIF_EXTENSION_##name) + 1),                                                    \
+	 (unsigned short)(headerRow(GLIF_EXTENSION_##name + 1) - headerRow(GLIF_EXTENSION_##name) - 1)},
+constexpr ExtensionEntry extensionList[] = {
+#include "gl_capability_table.h"
+};
+#undef GLIF_EXTENSION
+#undef GLIF_MACRON
+#undef GLIF_MACRO
+#undef GLIF_MACRO64
+#undef GLIF_MACROF
 
+constexpr size_t extensionCount = GLIF_EXTENSION_COUNT;
 
-int TestOpenGLCapabilities() {
+/*
+ * Compile-time check that no capability is listed twice within a group.
+ */
+constexpr bool sameName(const char* a, const char* b) {
+	return *a != *b ? false : *a == '\0' ? true : sameName(a + 1, b + 1);
+}
+
+constexpr bool uniqueInGroup(unsigned row, unsigned other) {
+	return other == capabilityRowCount || capabilityRows[other].type == GLIF_HEADER
+			   ? true
+			   : !sameName(capabilityRows[row].name, capabilityRows[other].name) && uniqueInGroup(row, other + 1);
+}
+
+constexpr bool uniqueCapabilities(unsigned row = 0) {
+	return row == capabilityRowCount
+			   ? true
+			   : (capabilityRows[row].type == GLIF_HEADER || uniqueInGroup(row, row + 1)) &&
+					 uniqueCapabilities(row + 1);
+}
+
+/*
+ * Values a report holds for the table: the integers of every 32-bit row
+ * (nrValues each) and 64-bit row, and the floats.
+ */
+constexpr size_t integerValueCount(unsigned row = 0) {
+	return row == capabilityRowCount ? 0
+		   : (capabilityRows[row].type == GLIF_INT32 ? capabilityRows[row].nrValues
+			  : capabilityRows[row].type == GLIF_INT64 ? 1
+			  : 0) + integerValueCount(row + 1);
+}
+
+constexpr size_t floatValueCount(unsigned row = 0) {
+	return row == capabilityRowCount ? 0
+		   : (capabilityRows[row].type == GLIF_FLOAT ? 1 : 0) + floatValueCount(row + 1);
+}
+
+static_assert(capabilityRows[0].type == GLIF_HEADER, "capability table must start with GLIF_EXTENSION");
+static_assert(uniqueCapabilities(), "capability listed twice in one extension of gl_capability_table.h");
+
+
+
+/*
+ * Signature of extensionList, so a cache written by a build with a different
+ * table is never reused.
+ */
+uint64_t CapabilityTableSignature() {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < capabilityRowCount; i++) {
+		const CapabilityEntry &row = capabilityRows[i];
+		for (const char* c = row.name; *c; c++) {
+			hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+		}
+		hash = (hash ^ (row.type * 256u + row.nrValues)) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Query every capability of extensionList on the current context.
+ */
+CapabilityReport ProbeOpenGLCapabilities() {
+	GlDebugGroup group("capability probe");
+	// The queries are not all valid on every context; don't leak their errors to the caller.
+	GlExpectedErrors expected;
+	CapabilityReport report;
+
+	for (size_t i = 0; i < extensionCount; i++) {
+		const ExtensionEntry &extension = extensionList[i];
+
+		// Check if supported
+		const bool supported = isGlextSupported(extension.name);
+		report.supported.push_back(supported ? 1 : 0);
+
+		for (size_t row = extension.first; row < extension.first + extension.count; row++) {
+			const CapabilityEntry &entry = capabilityRows[row];
+			GLenum enumV = entry.capability;
+
+			if (entry.type == GLIF_FLOAT) {
+				GLfloat Floatvtmp = 0;
+				if (supported) {
+					glGetFloatv(enumV, &Floatvtmp);
+				}
+				report.floats.push_back(Floatvtmp);
+			} else if (entry.type == GLIF_INT64) {
+				GLint64 Integervtmp = 0;
+				if (supported) {
+					glGetInteger64v(enumV, &Integervtmp);
+				}
+				report.integers.push_back(Integervtmp);
+			} else if (entry.nrValues > 1) {
+				for (GLuint i = 0; i < entry.nrValues; i++) {
+					GLint Integervtmp = 0;
+					if (supported) {
+						glGetIntegeri_v(enumV, i, &Integervtmp);
+					}
+					report.integers.push_back(Integervtmp);
+				}
+			} else {
+				GLint Integervtmp = 0;
+				if (supported) {
+					glGetIntegerv(enumV, &Integervtmp);
+				}
+				report.integers.push_back(Integervtmp);
+			}
+		}
+	}
+
+	return report;
+}
+
+void PrintOpenGLCapabilities(const CapabilityReport& report) {
+	size_t integer = 0, real = 0;
+
+	for (size_t i = 0; i < extensionCount; i++) {
+		const ExtensionEntry &extension = extensionList[i];
+
+		if (report.supported[i]) {
+			/*	*/
+			std::cout << extension.name << std::endl;
+		} else {
+			std::cout << extension.name << " : Not supported" << std::endl << std::endl;
+		}
+
+		// Values of unsupported extensions are stored as zeros, skip over them.
+		for (size_t row = extension.first; row < extension.first + extension.count; row++) {
+			const CapabilityEntry &entry = capabilityRows[row];
+
+			if (entry.type == GLIF_FLOAT) {
+				if (report.supported[i]) {
+					std::cout << "\t" << entry.name << " : " << report.floats[real] << std::endl;
+				}
+				real++;
+				continue;
+			}
+
+			if (report.supported[i]) {
+				std::cout << "\t" << entry.name << " : ";
+				for (size_t v = 0; v < entry.nrValues; v++) {
+					std::cout << report.integers[integer + v];
+					if (v < entry.nrValues - 1u) {
+						std::cout << ",";
+					}
+				}
+				std::cout << std::endl;
+			}
+			integer += entry.nrValues;
+		}
+
+		if (report.supported[i]) {
+			std::cout << std::endl;
+		}
+	}
+}
+
+/*
+ * Print the capabilities of the current context. The values come from the
+ * cache at cachePath when its renderer/driver fingerprint matches, and are
+ * probed (and the cache rewritten) otherwise or when refresh is set. An
+ * empty cachePath disables the cache.
+ */
+int TestOpenGLCapabilities(EGLDisplay display, const std::string& cachePath, bool refresh) {
 	try {
 		/*	Display information.	*/
 		std::cout << "RENDERER: " << glGetString(GL_RENDERER) << std::endl;
@@ -393,69 +337,48 @@ int TestOpenGLCapabilities() {
 		std::cout << "VERSION: " << glGetString(GL_VERSION) << std::endl;
 		std::cout << "SHADING_LANGUAGE_VERSION: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 		std::cout << std::endl;
-		std::cout << "GL_EXTENSIONS: " << glGetString(GL_EXTENSIONS) << std::endl;
-		std::cout << std::endl;
-		/*	*/
-		for (size_t i = 0; i < extensionList.size(); i++) {
-			const ExtensionEntry &extension = extensionList[i];
-
-			// Check if supported
-			if (isGlextSupported(extension.name.c_str())) {
-
-				/*	*/
-				std::cout << extension.name << std::endl;
-
-				for (auto it = extension.Int32.cbegin(); it != extension.Int32.cend(); it++) {
-					const std::string &attributeName = (*it).first;
-					const size_t nrParams = (*it).second.nrValues;
-					GLenum enumV = (*it).second.capability;
-					GLint Integervtmp;
-
-					/*	*/
-					std::cout << "\t" << attributeName << " : ";
-
-					if (nrParams > 1) {
-						for (size_t i = 0; i < nrParams; i++) {
-							glGetIntegeri_v(enumV, i, &Integervtmp);
-							std::cout << Integervtmp;
-							if (i < nrParams - 1) {
-								std::cout << ",";
-							}
-						}
-						std::cout << std::endl;
-					} else {
-						glGetIntegerv(enumV, &Integervtmp);
-						std::cout << Integervtmp << std::endl;
-					}
-				}
 
-				for (auto it = extension.Int64.cbegin(); it != extension.Int64.cend(); it++) {
-					const std::string &attributeName = (*it).first;
-					GLenum enumV = (*it).second.capability;
-					GLint64 Integervtmp;
-					glGetInteger64v(enumV, &Integervtmp);
-					std::cout << "\t" << attributeName << " : " << Integervtmp << std::endl;
-				}
-				for (auto it = extension.Float.cbegin(); it != extension.Float.cend(); it++) {
-					const std::string &attributeName = (*it).first;
-					GLenum enumV = (*it).second.capability;
-					GLfloat Integervtmp;
-					glGetFloatv(enumV, &Integervtmp);
-					std::cout << "\t" << attributeName << " : " << Integervtmp << std::endl;
-				}
-				std::cout << std::endl;
-			} else {
-				std::cout << extension.name << " : Not supported" << std::endl << std::endl;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const std::string fingerprint = capabilityFingerprint(display);
+		const uint64_t signature = CapabilityTableSignature();
+
+		CapabilityReport report;
+		const char* source = "probed";
+		const CapabilityCounts counts = {extensionCount, integerValueCount(), floatValueCount()};
+		if (!cachePath.empty() && !refresh && loadCapabilityCache(cachePath, fingerprint, signature, counts, report)) {
+			source = "loaded from cache";
+		} else {
+			report = ProbeOpenGLCapabilities();
+			if (!cachePath.empty() && !saveCapabilityCache(cachePath, fingerprint, signature, report)) {
+				std::cerr << "Could not write capability cache " << cachePath << std::endl;
 			}
 		}
+		const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		PrintOpenGLCapabilities(report);
+		std::cout << "Capabilities " << source << " in " << us << " us" << std::endl;
+
+		/*
+		 * Readback pair for each render target format, and what the driver
+		 * reported through GL_ARB_internalformat_query2 and the implementation
+		 * read format.
+		 */
+		std::cout << std::endl << "Readback formats:" << std::endl;
+		for (const ReadbackFormat& format : queryReadbackFormats()) {
+			std::cout << "\t" << renderFormat(format.internalFormat).name << " : " << glEnumName(format.format) << "/"
+					  << glEnumName(format.type) << " (" << format.source << "), read pixels "
+					  << glEnumName(format.readSupport) << " " << glEnumName(format.queryFormat) << "/"
+					  << glEnumName(format.queryType) << ", implementation "
+					  << glEnumName(format.implementationFormat) << "/" << glEnumName(format.implementationType)
+					  << ", texture image " << glEnumName(format.textureFormat) << "/"
+					  << glEnumName(format.textureType) << std::endl;
+		}
 
-		GLint nrExtensions;
-		glGetIntegerv(GL_NUM_EXTENSIONS, &nrExtensions);
-
-		std::cout << std::endl << "Device Extensions: " << nrExtensions << std::endl;
-		for (GLint i = 0; i < nrExtensions; i++) {
+		const GlExtensionIndex& index = glExtensionIndex();
+		std::cout << std::endl << "Device Extensions: " << index.size() << std::endl;
+		for (size_t i = 0; i < index.size(); i++) {
 
-			std::cout << "\t" << glGetStringi(GL_EXTENSIONS, i) << std::endl;
+			std::cout << "\t" << index.name(i) << std::endl;
 		}
 
 	} catch (const std::exception &ex) {
@@ -469,27 +392,762 @@ int TestOpenGLCapabilities() {
 
 
 
-void assertOpenGLError(const std::string& msg) {
-	GLenum error = glGetError();
+/*
+ * Micro-benchmark of the extension lookup: run every extensionList entry
+ * through the hashed index and through the original glGetString + strstr
+ * scan, and report the average time per lookup.
+ */
+int BenchmarkExtensionLookup() {
+	const int passes = 2000;
+	size_t lookups = 0, indexHits = 0, scanHits = 0;
+
+	const std::chrono::steady_clock::time_point indexStart = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < extensionCount; i++) {
+			indexHits += isGlextSupported(extensionList[i].name) ? 1 : 0;
+		}
+	}
+	const std::chrono::steady_clock::time_point scanStart = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < extensionCount; i++) {
+			scanHits += isGlextSupportedScan(extensionList[i].name) ? 1 : 0;
+			lookups++;
+		}
+	}
+	const std::chrono::steady_clock::time_point scanEnd = std::chrono::steady_clock::now();
+
+	const double indexNs = std::chrono::duration<double, std::nano>(scanStart - indexStart).count() / lookups;
+	const double scanNs = std::chrono::duration<double, std::nano>(scanEnd - scanStart).count() / lookups;
+
+	std::cout << "Extension lookup: " << extensionCount << " table entries, " << glExtensionIndex().size()
+			  << " extensions, " << passes << " passes" << std::endl;
+	std::cout << "\thash index  : " << indexNs << " ns/lookup" << std::endl;
+	std::cout << "\tstrstr scan : " << scanNs << " ns/lookup" << std::endl;
+	std::cout << "\tspeed-up    : " << (indexNs > 0 ? scanNs / indexNs : 0.0) << "x" << std::endl;
+
+	if (indexHits != scanHits) {
+		std::cerr << "Extension lookup mismatch: index found " << indexHits << ", scan found " << scanHits << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+
+
+/*
+ * Print how long every program took from submit to ready, and the wall time
+ * of all of them against the sum, which shows the gain of compiling in
+ * parallel.
+ */
+void printShaderReport(const ShaderProgramCache& shaders) {
+	const ShaderProgramCache::Statistics& stats = shaders.statistics();
+	std::cout << "Shader programs: " << stats.loaded << " loaded (" << stats.loadMs << " ms), " << stats.compiled
+			  << " compiled, " << stats.rejected << " stale binaries rejected, "
+			  << (shaders.parallel() ? "parallel" : "serial") << " compile"
+			  << (shaders.persistent() ? "" : ", not cached") << std::endl;
+
+	double summed = 0;
+	const std::vector<ShaderProgramCache::ProgramTiming> timings = shaders.timings();
+	for (const ShaderProgramCache::ProgramTiming& timing : timings) {
+		std::cout << "\t" << timing.name << " : " << (timing.cached ? "cached" : "compiled") << ", ready after "
+				  << timing.ms << " ms" << std::endl;
+		summed += timing.ms;
+	}
+	std::cout << "\twall " << stats.wallMs << " ms, summed " << summed << " ms" << std::endl;
+}
+
+/*
+ * Compile count variants of a fragment-heavy program, first one after the
+ * other, then all submitted up front with GL_ARB_parallel_shader_compile.
+ */
+int BenchmarkShaderCompile(EGLDisplay display, size_t count) {
+	// Vary the sources between runs, or the driver's own shader cache would answer.
+	const long long nonce = (long long)std::chrono::steady_clock::now().time_since_epoch().count();
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		ShaderProgramCache shaders("", display, parallel ? 0xFFFFFFFF : 0);
+		if (parallel && !shaders.parallel()) {
+			std::cout << "GL_ARB_parallel_shader_compile not supported" << std::endl;
+			break;
+		}
+
+		std::vector<ShaderProgramCache::Handle> handles;
+		for (size_t i = 0; i < count; i++) {
+			std::vector<ShaderSource> sources = sceneShaderSources();
+			std::ostringstream fragment;
+			fragment << "#version 120\n"
+					 << "// " << nonce << " " << parallel << "\n"
+					 << "void main() {\n"
+					 << "	vec4 c = gl_Color;\n"
+					 << "	for (int i = 0; i < 64; i++) {\n"
+					 << "		c = fract(sin(c * float(i + " << i << ")) * 43758.5453 + c.yzwx);\n"
+					 << "	}\n"
+					 << "	gl_FragColor = c;\n"
+					 << "}\n";
+			sources[1].source = fragment.str();
+
+			handles.push_back(shaders.submit("variant " + std::to_string(i), sources));
+			if (!parallel) {
+				shaders.program(handles.back());
+			}
+		}
+
+		// Poll like a render loop would, drawing with whatever is ready.
+		size_t pending = handles.size();
+		while (pending > 0) {
+			pending = 0;
+			for (ShaderProgramCache::Handle handle : handles) {
+				pending += shaders.ready(handle) ? 0 : 1;
+			}
+			std::this_thread::yield();
+		}
+		for (ShaderProgramCache::Handle handle : handles) {
+			shaders.program(handle);
+		}
+
+		const ShaderProgramCache::Statistics& stats = shaders.statistics();
+		std::cout << (parallel ? "Parallel" : "Serial") << " compile of " << count << " programs: wall "
+				  << stats.wallMs << " ms, summed " << stats.compileMs << " ms" << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
+
+struct ReadbackTiming {
+	double readMs;		/* glReadPixels per frame */
+	double expandMs;	/* expandPixelsToRgba8 per frame, 0 for RGBA8 */
+
+	double total() const { return readMs + expandMs; }
+};
+
+/*
+ * Time a synchronous glReadPixels of the bound framebuffer in format/type,
+ * and the expansion to RGBA8 where the pair is not already RGBA8.
+ */
+ReadbackTiming timeReadback(GLsizei width, GLsizei height, GLenum format, GLenum type, size_t repetitions) {
+	typedef std::chrono::steady_clock Clock;
+	std::vector<unsigned char> pixels((size_t)width * height * pixelSize(format, type));
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	const bool expand = format != GL_RGBA || type != GL_UNSIGNED_BYTE;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, format, type, pixels.data());	// warm up
+	double read = 0, expanded = 0;
+	for (size_t i = 0; i < repetitions; i++) {
+		const Clock::time_point start = Clock::now();
+		glReadPixels(0, 0, width, height, format, type, pixels.data());
+		const Clock::time_point readDone = Clock::now();
+		if (expand) {
+			expandPixelsToRgba8(format, type, pixels.data(), (size_t)width * height, rgba.data());
+		}
+		read += std::chrono::duration<double>(readDone - start).count();
+		expanded += std::chrono::duration<double>(Clock::now() - readDone).count();
+	}
+	assertOpenGLError("timeReadback");
+	const ReadbackTiming timing = {read * 1000.0 / repetitions, expanded * 1000.0 / repetitions};
+	return timing;
+}
+
+/*
+ * For every render target format, compare reading back in the driver's
+ * preferred pair against the naive GL_RGBA/GL_UNSIGNED_BYTE, both ending in
+ * RGBA8 on the host.
+ */
+int BenchmarkReadbackFormats(GLsizei width, GLsizei height, size_t repetitions) {
+	RenderTargetPool targets;
+	const double megabytes = (double)width * height * 4 / (1024 * 1024);
+
+	std::cout << "Readback of " << width << "x" << height << ", " << repetitions << " repetitions:" << std::endl;
+	for (const RenderFormat& render : renderFormatList()) {
+		const ReadbackFormat format = readbackFormat(render.internalFormat);
+		const RenderTargetKey key = renderTargetKey(width, height, render.internalFormat);
+		RenderTarget* target = targets.acquire(key);
+		glViewport(0, 0, width, height);
+		glClearColor(0.9f, 0.5f, 0.25f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		const ReadbackTiming preferred = timeReadback(width, height, format.format, format.type, repetitions);
+		const ReadbackTiming naive = timeReadback(width, height, GL_RGBA, GL_UNSIGNED_BYTE, repetitions);
+		std::cout << "\t" << render.name << " : " << glEnumName(format.format) << "/" << glEnumName(format.type)
+				  << " read " << preferred.readMs << " ms + expand " << preferred.expandMs << " ms ("
+				  << megabytes / preferred.total() * 1000.0 << " MB/s), GL_RGBA/GL_UNSIGNED_BYTE " << naive.readMs
+				  << " ms (" << megabytes / naive.total() * 1000.0 << " MB/s), " << naive.total() / preferred.total()
+				  << "x" << std::endl;
+
+		// The BGRA orders some drivers prefer for 8 bit targets.
+		if (render.internalFormat == GL_RGBA8) {
+			const ReadbackTiming bgra = timeReadback(width, height, GL_BGRA, GL_UNSIGNED_BYTE, repetitions);
+			const ReadbackTiming bgra8888 =
+				timeReadback(width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, repetitions);
+			std::cout << "\t\tGL_BGRA/GL_UNSIGNED_BYTE read " << bgra.readMs << " ms + expand " << bgra.expandMs
+					  << " ms, GL_BGRA/GL_UNSIGNED_INT_8_8_8_8_REV read " << bgra8888.readMs << " ms + expand "
+					  << bgra8888.expandMs << " ms" << std::endl;
+		}
+		targets.release(target);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Command line options.
+ */
+struct Options {
+	size_t frames = 1;			/* number of frames to render and read back */
+	size_t readbackDepth = 3;	/* number of PBOs in the readback ring */
+	size_t workers = 0;			/* render worker threads, 0 renders on the main thread */
+	std::string platform = "auto";	/* EGL platform, see openEglDisplay() */
+	std::string device;			/* EGL device index or name */
+	bool listDevices = false;
+	bool benchExtensions = false;	/* time isGlextSupported against the strstr scan */
+	size_t benchShaders = 0;	/* compile this many programs serially and in parallel, then exit */
+	size_t benchReadback = 0;	/* time each render format's readback this many times, then exit */
+	std::string capabilityCache = defaultCapabilityCachePath();
+	bool refreshCapabilities = false;
+	std::string shaderCache = defaultShaderCacheDirectory();	/* program binaries, empty to disable */
+	std::string output = "img.png";	/* image of the last frame, empty to skip */
+	ImageWriterOptions image;
+	GlErrorMode glErrors = GL_ERRORS_STRICT;
+	bool bench = false;			/* run the stage benchmark instead of rendering */
+	BenchmarkOptions benchmark;
+	size_t targetBudget = 0;	/* render target memory in bytes, 0 for half of the available memory */
+	size_t width = 500, height = 500;	/* image size */
+	size_t tileSize = 0;		/* render in tiles of at most this edge, 0 only when too large */
+	std::string shmRing;		/* publish frames to this shared memory ring, empty to skip */
+	size_t shmSlots = 4;
+	FrameRingPolicy shmPolicy = FRAME_RING_DROP;
+	size_t shmWaitMs = 5000;	/* block policy: wait this long for a consumer before the first frame */
+	std::string rawOutput;		/* write every frame to this raw sequence file, empty to skip */
+	size_t rawQueueDepth = 8;	/* raw frame writes in flight */
+	RawFrameIo rawIo = RAW_IO_AUTO;
+	GpuConvertFormat gpuConvert = GPU_CONVERT_NONE;	/* compute pass applied before readback */
+	GLenum targetFormat = GL_RGBA8;	/* internal format of the render targets */
+	bool upload = false;		/* draw a source image per frame, uploaded on a separate thread */
+	size_t batchViews = 0;		/* frames rendered as layers of one target per pass, 0 for one at a time */
+	std::string metricsFile;	/* Prometheus text file, empty to disable metrics */
+	size_t metricsInterval = 10;	/* seconds between rewrites of the metrics file */
+	bool serve = false;			/* run the batch render server */
+	std::string serveSocket;	/* Unix socket of the server, empty for stdin/stdout */
+	bool sparseCanvases = false;	/* server canvases commit memory per page */
+};
+
+void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+			  << "\t--frames=N          number of frames to render (default 1)" << std::endl
+			  << "\t--readback-depth=N  PBOs in the asynchronous readback ring (default 3)" << std::endl
+			  << "\t--workers=N         render the frames on a pool of N threads (default 0)" << std::endl
+			  << "\t--platform=P        EGL platform: auto, surfaceless, device or default (default auto)" << std::endl
+			  << "\t--device=D          EGL device by index or name (implies --platform=device)" << std::endl
+			  << "\t--list-devices      list the EGL devices and exit" << std::endl
+			  << "\t--bench-extensions  benchmark the extension lookup against the string scan" << std::endl
+			  << "\t--bench-shaders=N   compile N programs serially and in parallel and exit" << std::endl
+			  << "\t--bench-readback=N  time N readbacks per render format, preferred pair against GL_RGBA, and exit"
+			  << std::endl
+			  << "\t--capability-cache=FILE  capability cache file, empty to disable" << std::endl
+			  << "\t                    (default " << defaultCapabilityCachePath() << ")" << std::endl
+			  << "\t--refresh-capabilities  probe the capabilities even if the cache matches" << std::endl
+			  << "\t--shader-cache=DIR  shader program binary cache, empty to disable" << std::endl
+			  << "\t                    (default " << defaultShaderCacheDirectory() << ")" << std::endl
+			  << "\t--output=FILE       save the last frame as .png, .ppm or .raw (default img.png)" << std::endl
+			  << "\t--png-level=N       PNG compression level 0-9 (default 1)" << std::endl
+			  << "\t--raw-layout=L      pixel layout of .raw output: rgb, bgr or rgba (default rgb)" << std::endl
+			  << "\t--encode-threads=N  image encoder threads (default one per core)" << std::endl
+			  << "\t--size=WxH          image size (default 500x500), tiled beyond the render target limits" << std::endl
+			  << "\t--tile-size=N       render in tiles of at most N pixels per edge" << std::endl
+			  << "\t--shm-ring=NAME     publish every frame to a shared memory ring, /name or memfd" << std::endl
+			  << "\t--shm-slots=N       frames in the shared memory ring (default 4)" << std::endl
+			  << "\t--shm-policy=P      when the ring is full: drop the oldest frame or block (default drop)" << std::endl
+			  << "\t--shm-wait=MS       with block, wait up to MS for a consumer before rendering (default 5000)"
+			  << std::endl
+			  << "\t--raw-output=FILE   write every frame uncompressed to a raw sequence file" << std::endl
+			  << "\t--raw-queue-depth=N raw frame writes in flight, frames beyond are dropped (default 8)" << std::endl
+			  << "\t--raw-io=I          raw frame writes: auto, io_uring or pwritev (default auto)" << std::endl
+			  << "\t--gpu-convert=F     convert on the GPU before readback: rgb24, yuv420 or thumbnail" << std::endl
+			  << "\t--target-format=F   render target format: rgba8, r8, rg8, rgb565, rgba16f, ... (default rgba8)"
+			  << std::endl
+			  << "\t--upload            upload a source image per frame on a shared upload context" << std::endl
+			  << "\t--batch-views=K     render K frames per pass as layers of one target, one readback each"
+			  << std::endl
+			  << "\t--serve[=SOCKET]    serve render jobs from stdin, or from a Unix socket" << std::endl
+			  << "\t--sparse-canvases   back server canvases with sparse textures where supported" << std::endl
+			  << "\t--metrics-file=FILE write stage histograms and counters in Prometheus text format" << std::endl
+			  << "\t--metrics-interval=S  seconds between rewrites of the metrics file (default 10)" << std::endl
+			  << "\t--target-budget=MB render target pool memory budget (default half of the free memory)" << std::endl
+			  << "\t--gl-errors=M       GL error checking: off, debug (KHR_debug) or strict (default)" << std::endl
+			  << "\t--bench             benchmark context setup, FBO creation, clear and readback" << std::endl
+			  << "\t--bench-output=FILE append benchmark results as CSV (default bench_results.csv)" << std::endl
+			  << "\t--bench-repetitions=N  samples per stage and resolution (default 10)" << std::endl
+			  << "\t--bench-max-size=N  largest resolution, 0 for GL_MAX_TEXTURE_SIZE (default 4096)" << std::endl;
+}
+
+size_t parseCount(const std::string& name, const std::string& value) {
+	char* end = nullptr;
+	unsigned long long n = strtoull(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0') {
+		throw runtime_error("Invalid value for " + name + ": " + value);
+	}
+	return (size_t)n;
+}
+
+Options parseOptions(int argc, char* argv[]) {
+	Options options;
+	bool outputGiven = false;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const size_t eq = arg.find('=');
+		const std::string name = arg.substr(0, eq);
+		const std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+
+		if (name == "--frames") {
+			options.frames = parseCount(name, value);
+		} else if (name == "--readback-depth") {
+			options.readbackDepth = parseCount(name, value);
+			if (options.readbackDepth == 0) {
+				throw runtime_error("--readback-depth must be at least 1");
+			}
+		} else if (name == "--workers") {
+			options.workers = parseCount(name, value);
+		} else if (name == "--platform") {
+			options.platform = value;
+		} else if (name == "--device") {
+			options.device = value;
+		} else if (name == "--list-devices") {
+			options.listDevices = true;
+		} else if (name == "--bench-extensions") {
+			options.benchExtensions = true;
+		} else if (name == "--bench-shaders") {
+			options.benchShaders = parseCount(name, value);
+		} else if (name == "--bench-readback") {
+			options.benchReadback = parseCount(name, value);
+		} else if (name == "--capability-cache") {
+			options.capabilityCache = value;
+		} else if (name == "--refresh-capabilities") {
+			options.refreshCapabilities = true;
+		} else if (name == "--shader-cache") {
+			options.shaderCache = value;
+		} else if (name == "--output") {
+			options.output = value;
+			outputGiven = true;
+		} else if (name == "--png-level") {
+			options.image.pngLevel = (int)parseCount(name, value);
+			if (options.image.pngLevel > 9) {
+				throw runtime_error("--png-level must be 0 to 9");
+			}
+		} else if (name == "--raw-layout") {
+			if (value == "rgb") {
+				options.image.layout = PIXELS_RGB;
+			} else if (value == "bgr") {
+				options.image.layout = PIXELS_BGR;
+			} else if (value == "rgba") {
+				options.image.layout = PIXELS_RGBA;
+			} else {
+				throw runtime_error("Invalid value for --raw-layout: " + value);
+			}
+		} else if (name == "--encode-threads") {
+			options.image.threads = parseCount(name, value);
+		} else if (name == "--size") {
+			const size_t x = value.find('x');
+			if (x == std::string::npos) {
+				throw runtime_error("Invalid value for --size: " + value);
+			}
+			options.width = parseCount(name, value.substr(0, x));
+			options.height = parseCount(name, value.substr(x + 1));
+			if (options.width == 0 || options.height == 0) {
+				throw runtime_error("--size must not be empty");
+			}
+		} else if (name == "--tile-size") {
+			options.tileSize = parseCount(name, value);
+		} else if (name == "--shm-ring") {
+			options.shmRing = value;
+		} else if (name == "--shm-slots") {
+			options.shmSlots = parseCount(name, value);
+			if (options.shmSlots == 0) {
+				throw runtime_error("--shm-slots must be at least 1");
+			}
+		} else if (name == "--shm-policy") {
+			if (value == "drop") {
+				options.shmPolicy = FRAME_RING_DROP;
+			} else if (value == "block") {
+				options.shmPolicy = FRAME_RING_BLOCK;
+			} else {
+				throw runtime_error("Invalid value for --shm-policy: " + value);
+			}
+		} else if (name == "--shm-wait") {
+			options.shmWaitMs = parseCount(name, value);
+		} else if (name == "--serve") {
+			options.serve = true;
+			options.serveSocket = value;
+		} else if (name == "--sparse-canvases") {
+			options.sparseCanvases = true;
+		} else if (name == "--raw-output") {
+			options.rawOutput = value;
+		} else if (name == "--raw-queue-depth") {
+			options.rawQueueDepth = parseCount(name, value);
+			if (options.rawQueueDepth == 0) {
+				throw runtime_error("--raw-queue-depth must be at least 1");
+			}
+		} else if (name == "--raw-io") {
+			options.rawIo = parseRawFrameIo(value);
+		} else if (name == "--gpu-convert") {
+			options.gpuConvert = parseGpuConvertFormat(value);
+		} else if (name == "--target-format") {
+			options.targetFormat = parseRenderFormat(value).internalFormat;
+		} else if (name == "--metrics-file") {
+			options.metricsFile = value;
+		} else if (name == "--metrics-interval") {
+			options.metricsInterval = parseCount(name, value);
+			if (options.metricsInterval == 0) {
+				throw runtime_error("--metrics-interval must be at least 1 second");
+			}
+		} else if (name == "--batch-views") {
+			options.batchViews = parseCount(name, value);
+		} else if (name == "--upload") {
+			options.upload = true;
+		} else if (name == "--target-budget") {
+			options.targetBudget = parseCount(name, value) << 20;
+		} else if (name == "--gl-errors") {
+			options.glErrors = parseGlErrorMode(value);
+		} else if (name == "--bench") {
+			options.bench = true;
+		} else if (name == "--bench-output") {
+			options.benchmark.output = value;
+		} else if (name == "--bench-repetitions") {
+			options.benchmark.repetitions = parseCount(name, value);
+		} else if (name == "--bench-max-size") {
+			options.benchmark.maxSize = parseCount(name, value);
+		} else {
+			throw runtime_error("Unknown option: " + arg);
+		}
+	}
+	// yuv420 frames are not images; unless asked for another file, save them next to where the image would go.
+	if (options.gpuConvert == GPU_CONVERT_YUV420 && !outputGiven) {
+		options.output = "img.raw";
+	}
+	if (!options.output.empty()) {
+		options.image.format = imageFormatFromPath(options.output);
+	}
+	if (options.batchViews > 0 && (options.workers > 0 || options.upload || options.gpuConvert != GPU_CONVERT_NONE)) {
+		throw runtime_error("--batch-views renders on the main thread, without --upload or --gpu-convert");
+	}
+	if (options.batchViews > 0 && options.frames == 0) {
+		throw runtime_error("--batch-views needs at least one frame");
+	}
+	if (options.upload && options.workers > 0) {
+		throw runtime_error("--upload renders on the main thread, not with --workers");
+	}
+	if (options.gpuConvert != GPU_CONVERT_NONE) {
+		if (options.workers > 0) {
+			throw runtime_error("--gpu-convert renders on the main thread, not with --workers");
+		}
+		if (options.gpuConvert == GPU_CONVERT_YUV420 && !isGpuYuv420Size(options.width, options.height)) {
+			throw runtime_error("--gpu-convert=yuv420 needs even edges and a chroma plane divisible by 4 bytes");
+		}
+		if (options.gpuConvert == GPU_CONVERT_YUV420 && !options.output.empty() &&
+			options.image.format != IMAGE_RAW) {
+			throw runtime_error("--gpu-convert=yuv420 saves .raw output only");
+		}
+	}
+	options.benchmark.platform = options.platform;
+	options.benchmark.device = options.device;
+	return options;
+}
 
-	if (error != GL_NO_ERROR) {
-		stringstream s;
-		s << "OpenGL error 0x" << std::hex << error << " at " << msg;
-		throw runtime_error(s.str());
+/*
+ * Synthetic source image of an upload job, standing in for a decoded input:
+ * diagonal stripes that move with the job id.
+ */
+void fillSourceImage(const UploadJob& job, unsigned char* rgba, size_t stride) {
+	for (GLsizei y = 0; y < job.height; y++) {
+		unsigned char* row = rgba + y * stride;
+		for (GLsizei x = 0; x < job.width; x++) {
+			const bool stripe = ((x + y + job.id * 8) / 32) % 2 == 0;
+			row[4 * x] = stripe ? 255 : 64;
+			row[4 * x + 1] = (unsigned char)(x * 255 / job.width);
+			row[4 * x + 2] = (unsigned char)(y * 255 / job.height);
+			row[4 * x + 3] = 255;
+		}
 	}
 }
 
-void assertEGLError(const std::string& msg) {
-	EGLint error = eglGetError();
+/*
+ * Draw texture over the whole viewport, modulated by color.
+ */
+void drawSourceTexture(GLuint texture, const GLfloat color[4]) {
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glColor4fv(color);
+	glBegin(GL_TRIANGLE_STRIP);
+	glTexCoord2f(0, 0);
+	glVertex2f(-1, -1);
+	glTexCoord2f(1, 0);
+	glVertex2f(1, -1);
+	glTexCoord2f(0, 1);
+	glVertex2f(-1, 1);
+	glTexCoord2f(1, 1);
+	glVertex2f(1, 1);
+	glEnd();
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+}
 
-	if (error != EGL_SUCCESS) {
-		stringstream s;
-		s << "EGL error 0x" << std::hex << error << " at " << msg;
-		throw runtime_error(s.str());
+/*
+ * Render the frames and read the framebuffer's color attachment back
+ * through the PBO ring, so frame N+1 is rendered while frame N is
+ * still being transferred. With a converter, a compute pass writes the
+ * converted frame into the PBO instead of glReadPixels. With an uploader,
+ * every frame draws a source image uploaded on the upload thread while the
+ * previous frame rendered.
+ */
+void renderFrames(const Options& options, const RenderTarget& target, GpuConverter* converter,
+				  TextureUploader* uploader, FrameRingWriter* ring, RawFrameSink* sink) {
+	const GLsizei width = target.key.width;
+	const GLsizei height = target.key.height;
+	const ReadbackFormat format = readbackFormat(target.key.internalFormat);
+	const size_t stride = (size_t)width * pixelSize(format.format, format.type);
+	std::unique_ptr<PboReadback> readback(
+		converter ? new PboReadback(converter->bufferSize(), options.readbackDepth)
+				  : new PboReadback(width, height, format.format, format.type, options.readbackDepth));
+
+	// RGBA8 frames are encoded straight from the mapped PBO, without a host copy.
+	std::vector<unsigned char> expanded;
+	PboReadback::Consumer keep = [&options, format, &expanded, width, height, stride, converter, ring, sink](
+									 uint64_t frame, const void* pixels, size_t size) {
+		const bool last = frame + 1 == options.frames && !options.output.empty();
+		if (converter) {
+			if (ring) {
+				const size_t stride = converter->outputSize() / converter->outputHeight();
+				ring->publish(frame, pixels, converter->outputWidth(), converter->outputHeight(), stride, false);
+			}
+			if (sink) {
+				sink->write(frame, pixels, converter->outputSize());
+			}
+			if (last) {
+				writeConvertedFrame(options.output, *converter, pixels, options.image);
+			}
+			return;
+		}
+		if (ring) {
+			ring->publish(frame, pixels, width, height, stride, true);
+		}
+		if (sink) {
+			sink->write(frame, pixels, size);
+		}
+		if (last && format.format == GL_RGBA && format.type == GL_UNSIGNED_BYTE) {
+			writeImage(options.output, pixels, width, height, options.image);
+		} else if (last) {
+			expanded.resize((size_t)width * height * 4);
+			expandPixelsToRgba8(format.format, format.type, pixels, (size_t)width * height, expanded.data());
+			writeImage(options.output, expanded.data(), width, height, options.image);
+		}
+	};
+	const PboReadback::Producer convert = [&target, converter](GLuint buffer) {
+		converter->convert(target.texture, buffer);
+	};
+
+	if (uploader) {
+		for (size_t frame = 0; frame < options.frames; frame++) {
+			const UploadJob job = {frame, width, height, fillSourceImage};
+			uploader->submit(job);
+		}
+	}
+	glViewport(0, 0, width, height);
+
+	for (size_t frame = 0; frame < options.frames; frame++) {
+		/*
+		 * Render something.
+		 */
+		GlDebugGroup group("render frame");
+		{
+			StageTimer timer(METRIC_RENDER);
+			const float phase = options.frames > 1 ? (float)frame / (options.frames - 1) : 0.0f;
+			const GLfloat color[4] = {0.9f, 0.8f - 0.3f * phase, 0.5f + 0.4f * phase, 1.0f};
+			glClearColor(color[0], color[1], color[2], color[3]);
+			glClear(GL_COLOR_BUFFER_BIT);
+			if (uploader) {
+				const TextureUploader::Texture source = uploader->acquire();
+				drawSourceTexture(source.texture, color);
+				uploader->release(source);
+			}
+		}
+		countMetric(METRIC_FRAMES);
+
+		// Hand over every frame that already finished, block only when the ring is full.
+		while (readback->tryRetrieve(keep)) {
+		}
+		if (readback->full()) {
+			readback->retrieve(keep);
+		}
+		if (converter) {
+			readback->queue(frame, convert);
+		} else {
+			readback->queue(frame);
+		}
+	}
+	while (!readback->empty()) {
+		readback->retrieve(keep);
+	}
+
+	const PboReadback::Statistics& stats = readback->statistics();
+	std::cout << std::endl << "Readback: " << stats.queued << " frames, ring depth " << readback->depth() << ", "
+			  << stats.completedWithoutWait << " completed without waiting, " << stats.stalled << " stalled"
+			  << std::endl;
+	std::cout << "Frame format: " << renderFormat(format.internalFormat).name << ", read as "
+			  << glEnumName(format.format) << "/" << glEnumName(format.type) << " (" << format.source << "), "
+			  << stride * height << " bytes per frame" << std::endl;
+	if (converter) {
+		const size_t full = stride * height;
+		std::cout << "GPU conversion: " << gpuConvertFormatName(converter->format()) << ", "
+				  << converter->outputSize() << " bytes per frame instead of " << full << " ("
+				  << (long long)100 - (long long)(converter->outputSize() * 100 / full) << "% less readback)"
+				  << std::endl;
 	}
+	if (uploader) {
+		const TextureUploader::Statistics uploads = uploader->statistics();
+		std::cout << "Uploads: " << uploads.uploads << " textures, " << uploads.bytes / (1024 * 1024) << " MiB, "
+				  << uploads.recycled << " recycled, " << (uploader->persistent() ? "persistent" : "host")
+				  << " staging, fill " << uploads.fillSeconds << " s, upload " << uploads.uploadSeconds
+				  << " s, render thread waited " << uploads.waitSeconds << " s" << std::endl;
+	}
+}
+
+/*
+ * Render the frames in batches of layers of one target, one draw and one
+ * readback per batch.
+ */
+void renderLayeredFrames(const Options& options, RenderTargetPool& targets, GLuint program, LayeredMode mode,
+						 size_t views, FrameRingWriter* ring, RawFrameSink* sink) {
+	const GLsizei width = (GLsizei)options.width;
+	const GLsizei height = (GLsizei)options.height;
+	const ReadbackFormat format = readbackFormat(options.targetFormat);
+	const size_t stride = (size_t)width * pixelSize(format.format, format.type);
+
+	std::vector<unsigned char> expanded;
+	const PboReadback::Consumer keep = [&](uint64_t frame, const void* pixels, size_t size) {
+		if (ring) {
+			ring->publish(frame, pixels, width, height, stride, true);
+		}
+		if (sink) {
+			sink->write(frame, pixels, size);
+		}
+		if (frame + 1 != options.frames || options.output.empty()) {
+			return;
+		}
+		if (format.format == GL_RGBA && format.type == GL_UNSIGNED_BYTE) {
+			writeImage(options.output, pixels, width, height, options.image);
+		} else {
+			expanded.resize((size_t)width * height * 4);
+			expandPixelsToRgba8(format.format, format.type, pixels, (size_t)width * height, expanded.data());
+			writeImage(options.output, expanded.data(), width, height, options.image);
+		}
+	};
+
+	LayeredRenderOptions layered;
+	layered.width = width;
+	layered.height = height;
+	layered.internalFormat = options.targetFormat;
+	layered.frames = options.frames;
+	layered.views = views;
+	layered.readbackDepth = options.readbackDepth;
+	const LayeredRenderStatistics stats = RenderLayered(targets, program, mode, layered, keep);
+
+	std::cout << std::endl << "Layered render: " << options.frames << " frames in " << stats.batches
+			  << " batches of " << views << " views (" << layeredModeName(mode) << "), " << stats.stalled
+			  << " readbacks stalled, " << stats.seconds << " s ("
+			  << (stats.seconds > 0 ? options.frames / stats.seconds : 0.0) << " frames/s)" << std::endl;
 }
 
-int main() {
+/*
+ * Render the frames as independent jobs on a pool of worker threads and
+ * report the throughput of each worker. The worker that reads back the last
+ * frame saves it to options.output.
+ */
+void renderWithPool(const Options& options, EGLDisplay display, EGLConfig config, GLsizei width, GLsizei height,
+					FrameRingWriter* ring, RawFrameSink* sink) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RenderPool pool(display, config, options.workers, options.targetBudget);
+	const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+	for (size_t frame = 0; frame < options.frames; frame++) {
+		const float phase = options.frames > 1 ? (float)frame / (options.frames - 1) : 0.0f;
+		RenderJob job = {frame, width, height, {0.9f, 0.8f - 0.3f * phase, 0.5f + 0.4f * phase, 1.0f},
+						 options.targetFormat, nullptr};
+		if (ring || sink || !options.output.empty()) {
+			job.done = [&options, ring, sink](const RenderJob& job, const void* pixels, size_t size) {
+				if (ring) {
+					ring->publish(job.id, pixels, job.width, job.height, size / job.height, true);
+				}
+				if (sink) {
+					sink->write(job.id, pixels, size);
+				}
+				if (job.id + 1 != options.frames || options.output.empty()) {
+					return;
+				}
+				// Only the last job writes, so the worker thread can expand into its own buffer.
+				const ReadbackFormat format = readbackFormat(job.internalFormat);
+				if (format.format == GL_RGBA && format.type == GL_UNSIGNED_BYTE) {
+					writeImage(options.output, pixels, job.width, job.height, options.image);
+				} else {
+					std::vector<unsigned char> expanded((size_t)job.width * job.height * 4);
+					expandPixelsToRgba8(format.format, format.type, pixels, (size_t)job.width * job.height,
+										expanded.data());
+					writeImage(options.output, expanded.data(), job.width, job.height, options.image);
+				}
+			};
+		}
+		pool.submit(job);
+	}
+	pool.wait();
+
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	const double setup = std::chrono::duration<double>(started - start).count();
+	const double wall = std::chrono::duration<double>(end - started).count();
+
+	std::cout << std::endl << "Render pool: " << pool.size() << " workers, " << options.frames << " jobs in " << wall
+			  << " s (" << (wall > 0 ? options.frames / wall : 0.0) << " jobs/s), context setup " << setup << " s"
+			  << std::endl;
+
+	const std::vector<RenderPool::WorkerStatistics> stats = pool.statistics();
+	for (size_t i = 0; i < stats.size(); i++) {
+		const double busy = stats[i].busySeconds;
+		std::cout << "\tworker " << i << " : " << stats[i].jobs << " jobs (" << stats[i].stolen << " stolen), "
+				  << (busy > 0 ? stats[i].jobs / busy : 0.0) << " jobs/s, "
+				  << (busy > 0 ? stats[i].pixels / busy / 1e6 : 0.0) << " Mpixel/s, render targets "
+				  << stats[i].targetHits << " hits / " << stats[i].targetMisses << " misses, "
+				  << stats[i].targetBytes / 1024 << " KiB resident" << std::endl;
+	}
+}
+
+/*
+ * Render one image tile by tile and stream it to the output file.
+ */
+void renderTiledImage(const Options& options, RenderTargetPool& targets, GLuint sceneProgram) {
+	const float phase = options.frames > 1 ? 1.0f : 0.0f;
+	TiledRenderOptions tiled;
+	tiled.width = options.width;
+	tiled.height = options.height;
+	tiled.tileSize = options.tileSize;
+	tiled.readbackDepth = options.readbackDepth;
+	const float clearColor[4] = {0.9f, 0.8f - 0.3f * phase, 0.5f + 0.4f * phase, 1.0f};
+	std::copy(clearColor, clearColor + 4, tiled.clearColor);
+
+	const TiledRenderStatistics stats = RenderTiled(targets, sceneProgram, tiled, options.output, options.image);
+	std::cout << std::endl << "Tiled render: " << options.width << "x" << options.height << " in " << stats.tiles
+			  << " tiles of " << stats.tileWidth << "x" << stats.tileHeight << " (" << stats.strips << " strips), "
+			  << stats.stalled << " readbacks stalled, " << stats.seconds << " s ("
+			  << (stats.seconds > 0 ? options.width * options.height / stats.seconds / 1e6 : 0.0) << " Mpixel/s)"
+			  << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	try {
+		options = parseOptions(argc, argv);
+	} catch (const std::exception &ex) {
+		std::cerr << ex.what() << std::endl;
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
 	/*
 	 * EGL initialization and OpenGL context creation.
 	 */
@@ -497,21 +1155,58 @@ int main() {
 	EGLConfig config;
 	EGLContext context;
 	EGLSurface surface;
-	EGLint num_config;
 
-	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-	assertEGLError("eglGetDisplay");
-	
-	eglInitialize(display, nullptr, nullptr);
-	assertEGLError("eglInitialize");
+	setGlErrorMode(options.glErrors);
+
+	if (options.bench) {
+		return RunBenchmark(options.benchmark);
+	}
 
-	eglChooseConfig(display, nullptr, &config, 1, &num_config);
-	assertEGLError("eglChooseConfig");
+	if (options.listDevices) {
+		const std::vector<EglDeviceInfo> devices = enumerateEglDevices();
+		for (size_t i = 0; i < devices.size(); i++) {
+			std::cout << devices[i].index << " : " << devices[i].name << " [" << devices[i].extensions << "]"
+					  << std::endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// When serving stdin, stdout carries the responses; log to stderr instead.
+	if (options.serve && options.serveSocket.empty()) {
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
+	std::unique_ptr<MetricsExporter> metrics;
+	if (!options.metricsFile.empty()) {
+		try {
+			const std::chrono::seconds interval(options.metricsInterval);
+			metrics.reset(new MetricsExporter(options.metricsFile, interval));
+		} catch (const std::exception& ex) {
+			std::cerr << ex.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	const std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
+	display = openEglDisplay(options.platform, options.device);
+
+	/*
+	 * The default EGL_SURFACE_TYPE is EGL_WINDOW_BIT, which the surfaceless
+	 * and device platforms do not offer; ask for an offscreen config. All
+	 * rendering goes to framebuffer objects, so the config needs no color
+	 * depth, depth or stencil of its own: take the smallest one.
+	 */
+	size_t matchingConfigs = 0;
+	const EglConfigInfo configInfo = chooseEglConfig(display, EglConfigRequirements(), &matchingConfigs);
+	config = configInfo.config;
+	std::cout << "EGL config: " << describeEglConfig(configInfo) << " (smallest of " << matchingConfigs
+			  << " matching)" << std::endl;
 	
 	eglBindAPI(EGL_OPENGL_API);
 	assertEGLError("eglBindAPI");
 	
-	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	const std::vector<EGLint> contextAttributes = glContextAttributes();
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes.data());
 	assertEGLError("eglCreateContext");
 
 	//surface = eglCreatePbufferSurface(display, config, nullptr);
@@ -519,74 +1214,218 @@ int main() {
 	
 	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
 	assertEGLError("eglMakeCurrent");
+	recordStage(METRIC_CONTEXT_SETUP,
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count());
+
+	glExtensionIndex().load();
+	installGlDebugCallback();
+
+	if (options.benchShaders > 0) {
+		const int result = BenchmarkShaderCompile(display, options.benchShaders);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return result;
+	}
+
+	if (options.benchReadback > 0) {
+		const int result = BenchmarkReadbackFormats(options.width, options.height, options.benchReadback);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return result;
+	}
+
+	if (options.benchExtensions) {
+		const int result = BenchmarkExtensionLookup();
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return result;
+	}
+
+	if (options.serve) {
+		RenderServerOptions server;
+		server.socketPath = options.serveSocket;
+		server.image = options.image;
+		server.targetBudget = options.targetBudget;
+		server.sparseCanvases = options.sparseCanvases;
+		const int result = RunRenderServer(server);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return result;
+	}
 	
 	
 	/*
-	 * Create an OpenGL framebuffer as render target.
+	 * Take the render target from the pool, which recycles framebuffers and
+	 * their color attachment by size and format. Images beyond the render
+	 * target limits are rendered in tiles instead.
 	 */
-	GLuint frameBuffer;
-	glGenFramebuffers(1, &frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-	assertOpenGLError("glBindFramebuffer");
+	const GLsizei width = (GLsizei)options.width;
+	const GLsizei height = (GLsizei)options.height;
+	const size_t maxSize = maxRenderTargetSize();
+	const bool tiled = options.tileSize > 0 || options.width > maxSize || options.height > maxSize;
 
-	
-	/*
-	 * Create a texture as color attachment.
-	 */
-	GLuint t;
-	glGenTextures(1, &t);
+	RenderTargetPool targets(options.targetBudget);
 
-	glBindTexture(GL_TEXTURE_2D, t);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 500, 500, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	assertOpenGLError("glTexImage2D");
-	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
-	
 	/*
-	 * Attach the texture to the framebuffer.
+	 * Submit the shader programs, restoring linked binaries from the cache.
+	 * Compiles run on the driver's threads while the capabilities are probed.
 	 */
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t, 0);
-	assertOpenGLError("glFramebufferTexture2D");
-
-	
+	ShaderProgramCache shaders(options.shaderCache, display);
+	const ShaderProgramCache::Handle sceneShaders = shaders.submit("scene", sceneShaderSources());
+
+	// The conversion pass needs compute shaders; without them the frames are read back as RGBA.
+	GpuConvertFormat gpuConvert = options.gpuConvert;
+	if (gpuConvert != GPU_CONVERT_NONE && (tiled || !isGpuConvertSupported())) {
+		std::cout << "GPU conversion: " << (tiled ? "not used for tiled images" : "no compute shader support")
+				  << ", reading back RGBA" << std::endl;
+		gpuConvert = GPU_CONVERT_NONE;
+	}
+	ShaderProgramCache::Handle convertShaders = 0;
+	if (gpuConvert != GPU_CONVERT_NONE) {
+		convertShaders = shaders.submit(std::string("convert ") + gpuConvertFormatName(gpuConvert),
+										gpuConvertShaderSources(gpuConvert));
+	}
 
+	/*
+	 * Batches are limited by the layers a framebuffer can have, and are no
+	 * larger than the frames to render.
+	 */
+	LayeredMode layeredMode = LAYERED_GEOMETRY;
+	size_t batchViews = 0;
+	ShaderProgramCache::Handle layeredShaders = 0;
+	if (options.batchViews > 0 && !tiled) {
+		layeredMode = chooseLayeredMode();
+		const size_t maxViews = maxRenderTargetLayers(layeredMode == LAYERED_MULTIVIEW);
+		batchViews = std::min(std::min(options.batchViews, maxViews), options.frames);
+		if (batchViews < options.batchViews) {
+			std::cout << "Batch views: limited to " << batchViews << " (" << maxViews << " layers, "
+					  << options.frames << " frames)" << std::endl;
+		}
+		if (batchViews > 0) {
+			layeredShaders = shaders.submit("layered " + std::string(layeredModeName(layeredMode)) + " " +
+												std::to_string(batchViews),
+											layeredShaderSources(layeredMode, batchViews));
+		}
+	}
 
+	// Only renderFrames draws on the main context into one 2D target; the other paths bring their own.
+	RenderTarget* target = nullptr;
+	if (!tiled && batchViews == 0 && options.workers == 0) {
+		const RenderTargetKey targetKey = renderTargetKey(width, height, options.targetFormat);
+		target = targets.acquire(targetKey);
+	}
 
+	TestOpenGLCapabilities(display, options.capabilityCache, options.refreshCapabilities);
 
 
 	/*
-	 * Render something.
+	 * Render, read the framebuffer's color attachment back and save the last
+	 * frame as an image file.
 	 */
-	glClearColor(0.9, 0.8, 0.5, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glFlush();
+	std::unique_ptr<GpuConverter> converter;
+	if (gpuConvert != GPU_CONVERT_NONE) {
+		converter.reset(new GpuConverter(shaders.program(convertShaders), gpuConvert, width, height));
+	}
 
+	std::unique_ptr<TextureUploader> uploader;
+	if (options.upload && !tiled) {
+		uploader.reset(new TextureUploader(display, config, context, (size_t)width * height * 4));
+	}
 
+	std::unique_ptr<FrameRingWriter> ring;
+	if (!options.shmRing.empty() && !tiled) {
+		const ReadbackFormat format = readbackFormat(options.targetFormat);
+		const size_t frameBytes =
+			converter ? converter->outputSize() : (size_t)width * height * pixelSize(format.format, format.type);
+		ring.reset(new FrameRingWriter(options.shmRing, options.shmSlots, frameBytes, options.shmPolicy));
+		std::cout << "Frame ring: " << ring->path() << ", " << options.shmSlots << " slots" << std::endl;
+		// Blocking only holds frames back for an attached consumer, so give it the chance to attach first.
+		if (options.shmPolicy == FRAME_RING_BLOCK && !ring->waitForConsumer((int)options.shmWaitMs)) {
+			std::cerr << "Frame ring: no consumer attached after " << options.shmWaitMs << " ms" << std::endl;
+		}
+	}
 
+	std::unique_ptr<RawFrameSink> sink;
+	if (!options.rawOutput.empty() && !tiled) {
+		const ReadbackFormat format = readbackFormat(options.targetFormat);
+		RawFrameLayout layout;
+		if (converter) {
+			layout = {(uint32_t)converter->outputWidth(), (uint32_t)converter->outputHeight(),
+					  (uint32_t)(converter->outputSize() / converter->outputHeight()), 0, 0, false,
+					  converter->outputSize()};
+		} else {
+			const uint32_t stride = (uint32_t)(width * pixelSize(format.format, format.type));
+			layout = {(uint32_t)width, (uint32_t)height, stride, format.format, format.type, true,
+					  (size_t)stride * height};
+		}
+		sink.reset(new RawFrameSink(options.rawOutput, layout, options.frames, options.rawQueueDepth, options.rawIo));
+		std::cout << "Raw frames: " << options.rawOutput << ", " << rawFrameIoName(sink->io()) << ", "
+				  << (sink->direct() ? "O_DIRECT" : "buffered") << ", " << sink->queueDepth() << " in flight"
+				  << std::endl;
+	}
 
-	TestOpenGLCapabilities();
+	if (tiled) {
+		renderTiledImage(options, targets, shaders.program(sceneShaders));
+	} else if (batchViews > 0) {
+		renderLayeredFrames(options, targets, shaders.program(layeredShaders), layeredMode, batchViews, ring.get(),
+							sink.get());
+	} else if (options.workers > 0) {
+		renderWithPool(options, display, config, width, height, ring.get(), sink.get());
+	} else {
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		renderFrames(options, *target, converter.get(), uploader.get(), ring.get(), sink.get());
+	}
+
+	// Programs the render path did not need still get linked and cached.
+	shaders.program(sceneShaders);
+	std::cout << std::endl;
+	printShaderReport(shaders);
+
+	if (ring) {
+		const FrameRingWriter::Statistics stats = ring->statistics();
+		std::cout << "Frame ring: " << stats.published << " frames published, " << stats.dropped << " dropped, "
+				  << stats.blocked << " blocked for " << stats.blockedSeconds << " s" << std::endl;
+		ring.reset();
+	}
+
+	if (sink) {
+		sink->close();
+		const RawFrameSink::Statistics stats = sink->statistics();
+		const double mib = stats.bytes / (1024.0 * 1024.0);
+		std::cout << "Raw frames: " << stats.written << " frames written, " << stats.dropped << " dropped, " << mib
+				  << " MiB in " << stats.seconds << " s (" << (stats.seconds > 0 ? mib / stats.seconds : 0.0)
+				  << " MiB/s), queue depth " << stats.averageInFlight << " average, " << stats.maxInFlight
+				  << " max" << std::endl;
+		sink.reset();
+	}
+
+
+	if (target) {
+		targets.release(target);
+	}
+	const RenderTargetPool::Statistics& targetStats = targets.statistics();
+	std::cout << "Render targets: " << targetStats.hits << " hits, " << targetStats.misses << " misses, "
+			  << targetStats.evictions << " evictions, " << targetStats.residentBytes / 1024 << " KiB resident of "
+			  << targetStats.budgetBytes / (1024 * 1024) << " MiB budget" << std::endl;
+	for (const RenderTargetPool::FormatUsage& usage : targets.usageByFormat()) {
+		std::cout << "\t" << renderFormat(usage.internalFormat).name << " : " << usage.targets << " targets, "
+				  << usage.bytes / 1024 << " KiB" << std::endl;
+	}
 
-	
-	/*
-	 * Read the framebuffer's color attachment and save it as a PNG file.
-	 */
-	// cv::Mat image(500, 500, CV_8UC3);
-	// glReadBuffer(GL_COLOR_ATTACHMENT0);
-	// glReadPixels(0, 0, 500, 500, GL_BGR, GL_UNSIGNED_BYTE, image.data);
-	// assertOpenGLError("glReadPixels");
 
-	// cv::imwrite("img.png", image);
-	
-	
 	/*
 	 * Destroy context.
 	 */
-	glDeleteFramebuffers(1, &frameBuffer);
-	glDeleteTextures(1, &t);
+	targets.trim();
+	assertOpenGLError("RenderTargetPool trim");
+
+	if (glErrorMode() == GL_ERRORS_DEBUG) {
+		drainGlDebugMessages();
+		if (glDebugDroppedMessages()) {
+			std::cerr << "GL debug: " << glDebugDroppedMessages() << " messages dropped" << std::endl;
+		}
+	}
 	 
 	//eglDestroySurface(display, surface);
 	//assertEGLError("eglDestroySurface");
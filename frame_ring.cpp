@@ -0,0 +1,344 @@
+/*
+ * Shared-memory frame ring.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "frame_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the frame ring needs address-free 64-bit atomics");
+
+static const char ringMagic[8] = {'G', 'L', 'F', 'R', 'I', 'N', 'G', '\1'};
+static const size_t pageSize = 4096;
+
+struct FrameRingHeader {
+	char magic[8];
+	uint32_t slotCount;
+	uint32_t reserved;
+	uint64_t slotBytes;		/* capacity of one data slot */
+	uint64_t slotsOffset;	/* FrameRingSlot array */
+	uint64_t dataOffset;	/* data of slot 0 */
+	uint64_t dataStride;	/* page-aligned distance between data slots */
+	std::atomic<uint64_t> writeSequence;	/* frames published */
+	std::atomic<uint64_t> readSequence;		/* frames released by the registered consumer */
+	std::atomic<uint32_t> consumers;		/* attached registered consumers */
+	std::atomic<uint32_t> closed;
+	std::atomic<uint32_t> ready;			/* set last, once the header is valid */
+};
+
+struct alignas(64) FrameRingSlot {
+	std::atomic<uint64_t> sequence;	/* 2n+1 while frame n is written, 2n+2 once published */
+	uint64_t frame;
+	uint64_t timestampNs;
+	uint64_t size;
+	uint32_t width, height, stride;
+};
+
+static_assert(sizeof(FrameRingHeader) <= pageSize, "frame ring header exceeds a page");
+
+static size_t roundToPage(size_t bytes) {
+	return (bytes + pageSize - 1) / pageSize * pageSize;
+}
+
+static uint64_t monotonicNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static std::string systemError(const std::string& what) {
+	return "FrameRing: " + what + ": " + strerror(errno);
+}
+
+/*
+ * A path with a directory (/proc/1234/fd/5) is a file, "/name" a POSIX
+ * shared memory object.
+ */
+static bool isSharedMemoryName(const std::string& path) {
+	return path.size() > 1 && path[0] == '/' && path.find('/', 1) == std::string::npos;
+}
+
+FrameRingMapping::~FrameRingMapping() {
+	if (base) {
+		munmap(base, bytes);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+FrameRingSlot& FrameRingMapping::slot(uint64_t sequence) const {
+	const FrameRingHeader& h = header();
+	return ((FrameRingSlot*)((char*)base + h.slotsOffset))[sequence % h.slotCount];
+}
+
+unsigned char* FrameRingMapping::data(uint64_t sequence) const {
+	const FrameRingHeader& h = header();
+	return (unsigned char*)base + h.dataOffset + (sequence % h.slotCount) * h.dataStride;
+}
+
+void FrameRingMapping::map(int fd, size_t bytes) {
+	// Readers write too: the registered consumer publishes readSequence.
+	void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		throw runtime_error(systemError("mmap"));
+	}
+	this->base = mapped;
+	this->bytes = bytes;
+}
+
+FrameRingWriter::FrameRingWriter(const std::string& name, size_t slots, size_t slotBytes, FrameRingPolicy policy)
+	: policy(policy), stats() {
+	if (slots == 0 || slotBytes == 0) {
+		throw runtime_error("FrameRing: needs at least one non-empty slot");
+	}
+
+	if (name == "memfd") {
+		fd = memfd_create("egl_frame_ring", MFD_CLOEXEC);
+		if (fd < 0) {
+			throw runtime_error(systemError("memfd_create"));
+		}
+		std::ostringstream s;
+		s << "/proc/" << getpid() << "/fd/" << fd;
+		ringPath = s.str();
+	} else {
+		if (!isSharedMemoryName(name)) {
+			throw runtime_error("FrameRing: shared memory name must look like /name: " + name);
+		}
+		// A stale ring of a crashed producer must not be picked up by readers.
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if (fd < 0) {
+			throw runtime_error(systemError("shm_open " + name));
+		}
+		this->name = name;
+		ringPath = name;
+	}
+
+	const size_t slotsOffset = pageSize;
+	const size_t dataOffset = slotsOffset + roundToPage(slots * sizeof(FrameRingSlot));
+	const size_t dataStride = roundToPage(slotBytes);
+	const size_t total = dataOffset + slots * dataStride;
+	if (ftruncate(fd, total) != 0) {
+		throw runtime_error(systemError("ftruncate"));
+	}
+	map(fd, total);
+
+	// The file starts zeroed, so every atomic already holds 0.
+	FrameRingHeader& h = header();
+	memcpy(h.magic, ringMagic, sizeof(ringMagic));
+	h.slotCount = (uint32_t)slots;
+	h.slotBytes = slotBytes;
+	h.slotsOffset = slotsOffset;
+	h.dataOffset = dataOffset;
+	h.dataStride = dataStride;
+	h.ready.store(1, std::memory_order_release);
+}
+
+FrameRingWriter::~FrameRingWriter() {
+	if (base) {
+		header().closed.store(1, std::memory_order_release);
+	}
+	if (!name.empty()) {
+		shm_unlink(name.c_str());
+	}
+}
+
+void FrameRingWriter::publish(uint64_t frame, const void* pixels, uint32_t width, uint32_t height, uint32_t stride,
+							  bool bottomUp) {
+	const size_t size = (size_t)stride * height;
+	FrameRingHeader& h = header();
+	if (size > h.slotBytes) {
+		throw runtime_error("FrameRing: frame of " + to_string(size) + " bytes exceeds the slot size " +
+							to_string(h.slotBytes));
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const uint64_t sequence = h.writeSequence.load(std::memory_order_relaxed);
+
+	if (sequence - h.readSequence.load(std::memory_order_acquire) >= h.slotCount) {
+		if (policy == FRAME_RING_BLOCK && h.consumers.load(std::memory_order_acquire) > 0) {
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			while (sequence - h.readSequence.load(std::memory_order_acquire) >= h.slotCount &&
+				   h.consumers.load(std::memory_order_acquire) > 0) {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			stats.blocked++;
+			stats.blockedSeconds +=
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		} else if (h.consumers.load(std::memory_order_acquire) > 0) {
+			stats.dropped++;
+		}
+	}
+
+	/*
+	 * Seqlock write: readers that see an odd or newer sequence know the slot
+	 * is, or was, being overwritten.
+	 */
+	FrameRingSlot& s = slot(sequence);
+	s.sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	unsigned char* destination = data(sequence);
+	const unsigned char* source = (const unsigned char*)pixels;
+	if (bottomUp) {
+		for (uint32_t y = 0; y < height; y++) {
+			memcpy(destination + (size_t)y * stride, source + (size_t)(height - 1 - y) * stride, stride);
+		}
+	} else {
+		memcpy(destination, source, size);
+	}
+	s.frame = frame;
+	s.timestampNs = monotonicNs();
+	s.size = size;
+	s.width = width;
+	s.height = height;
+	s.stride = stride;
+
+	s.sequence.store(2 * sequence + 2, std::memory_order_release);
+	h.writeSequence.store(sequence + 1, std::memory_order_release);
+	stats.published++;
+}
+
+bool FrameRingWriter::waitForConsumer(int timeoutMs) const {
+	const std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	while (header().consumers.load(std::memory_order_acquire) == 0) {
+		if (std::chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+FrameRingWriter::Statistics FrameRingWriter::statistics() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+FrameRingReader::FrameRingReader(const std::string& path, int timeoutMs, bool registered)
+	: registered(registered), cursor(0), lostFrames(0) {
+	const std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+	/*
+	 * The producer may not have created, or not yet initialized, the ring.
+	 */
+	for (;;) {
+		if (fd < 0) {
+			fd = isSharedMemoryName(path) ? shm_open(path.c_str(), O_RDWR | O_CLOEXEC, 0)
+										  : open(path.c_str(), O_RDWR | O_CLOEXEC);
+			if (fd < 0 && errno != ENOENT) {
+				throw runtime_error(systemError("open " + path));
+			}
+		}
+		if (fd >= 0) {
+			struct stat info;
+			if (fstat(fd, &info) != 0) {
+				throw runtime_error(systemError("fstat " + path));
+			}
+			if ((size_t)info.st_size > pageSize) {
+				map(fd, info.st_size);
+				if (header().ready.load(std::memory_order_acquire) != 0) {
+					break;
+				}
+				munmap(base, bytes);
+				base = nullptr;
+			}
+		}
+		if (std::chrono::steady_clock::now() >= deadline) {
+			throw runtime_error("FrameRing: no ring at " + path);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	FrameRingHeader& h = header();
+	if (memcmp(h.magic, ringMagic, sizeof(ringMagic)) != 0) {
+		throw runtime_error("FrameRing: " + path + " is not a frame ring");
+	}
+	// Start with the oldest frame still in the ring.
+	const uint64_t written = h.writeSequence.load(std::memory_order_acquire);
+	cursor = written > h.slotCount ? written - h.slotCount : 0;
+	if (registered) {
+		cursor = std::max(cursor, h.readSequence.load(std::memory_order_acquire));
+		h.readSequence.store(cursor, std::memory_order_release);
+		h.consumers.fetch_add(1, std::memory_order_acq_rel);
+	}
+}
+
+FrameRingReader::~FrameRingReader() {
+	if (base && registered) {
+		header().consumers.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+bool FrameRingReader::next(Frame& frame, int timeoutMs) {
+	const std::chrono::steady_clock::time_point deadline =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	FrameRingHeader& h = header();
+
+	for (;;) {
+		const uint64_t written = h.writeSequence.load(std::memory_order_acquire);
+		if (written > cursor) {
+			if (written - cursor > h.slotCount) {
+				lostFrames += written - h.slotCount - cursor;
+				cursor = written - h.slotCount;
+			}
+
+			FrameRingSlot& s = slot(cursor);
+			const uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+			if (sequence == 2 * cursor + 2) {
+				frame.sequence = cursor;
+				frame.frame = s.frame;
+				frame.timestampNs = s.timestampNs;
+				frame.width = s.width;
+				frame.height = s.height;
+				frame.stride = s.stride;
+				frame.size = s.size;
+				frame.pixels = data(cursor);
+				return true;
+			}
+			// Overwritten by a later frame since writeSequence was read.
+			lostFrames++;
+			cursor++;
+			continue;
+		}
+
+		if (h.closed.load(std::memory_order_acquire) != 0) {
+			return false;
+		}
+		if (std::chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+bool FrameRingReader::release(const Frame& frame) {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const bool intact = slot(frame.sequence).sequence.load(std::memory_order_relaxed) == 2 * frame.sequence + 2;
+
+	cursor = frame.sequence + 1;
+	if (registered) {
+		header().readSequence.store(cursor, std::memory_order_release);
+	}
+	return intact;
+}
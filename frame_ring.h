@@ -0,0 +1,162 @@
+/*
+ * Shared-memory ring for handing frames to consumer processes on the same
+ * host without a file system round trip.
+ *
+ * The ring lives in a POSIX shared memory object (shm_open) or an anonymous
+ * memfd, which consumers open as /proc/<pid>/fd/<fd>. It starts with a
+ * header page, followed by slot headers and page-aligned pixel slots:
+ *
+ *   header   magic, geometry, writeSequence, readSequence, flags
+ *   slot i   sequence, frame, timestamp, width, height, stride, size
+ *   data i   pixels of the frame in slot i
+ *
+ * Synchronization is lock-free through sequence numbers only. Publishing
+ * frame n into slot n % slots sets the slot sequence to 2n+1, copies the
+ * pixels, sets it to 2n+2 and then bumps writeSequence to n+1. A reader
+ * maps the slot in place and checks the slot sequence again when it is done
+ * with it, which tells it whether the producer overwrote the frame
+ * meanwhile (a seqlock).
+ *
+ * When all slots hold unread frames, the producer either overwrites the
+ * oldest one (FRAME_RING_DROP, for live consumers that only want recent
+ * frames) or waits for the consumer to release a slot (FRAME_RING_BLOCK).
+ * Blocking only applies while a consumer is attached, so a producer without
+ * any consumer never stalls. readSequence tracks a single registered
+ * consumer; any number of unregistered readers can follow the ring as well,
+ * but the producer never waits for them.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_FRAME_RING_H
+#define EGL_OFFSCREEN_FRAME_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+enum FrameRingPolicy {
+	FRAME_RING_DROP,	/* overwrite the oldest unread frame */
+	FRAME_RING_BLOCK	/* wait until the consumer releases a slot */
+};
+
+struct FrameRingHeader;
+struct FrameRingSlot;
+
+/*
+ * Mapping of a ring, shared by the writer and the reader.
+ */
+class FrameRingMapping {
+public:
+	FrameRingMapping() : base(nullptr), bytes(0), fd(-1) {}
+	~FrameRingMapping();
+
+	FrameRingMapping(const FrameRingMapping&) = delete;
+	FrameRingMapping& operator=(const FrameRingMapping&) = delete;
+
+	FrameRingHeader& header() const { return *(FrameRingHeader*)base; }
+	FrameRingSlot& slot(uint64_t sequence) const;
+	unsigned char* data(uint64_t sequence) const;
+
+protected:
+	void map(int fd, size_t bytes);
+
+	void* base;
+	size_t bytes;
+	int fd;
+};
+
+class FrameRingWriter : public FrameRingMapping {
+public:
+	struct Statistics {
+		uint64_t published;
+		uint64_t dropped;		/* frames overwritten before the registered consumer released them */
+		uint64_t blocked;		/* publishes that waited for the consumer */
+		double blockedSeconds;
+	};
+
+	/*
+	 * Create the ring. name is a POSIX shared memory name ("/frames"), which
+	 * replaces an existing object of that name, or "memfd" for an anonymous
+	 * memfd; path() tells consumers where to find it.
+	 */
+	FrameRingWriter(const std::string& name, size_t slots, size_t slotBytes, FrameRingPolicy policy);
+
+	/*
+	 * Mark the ring closed so readers stop once they caught up, and remove
+	 * the shared memory name.
+	 */
+	~FrameRingWriter();
+
+	/*
+	 * Copy a frame into the next slot, top row first; bottomUp rows, as
+	 * glReadPixels returns them, are flipped on the way. Thread-safe. Throws
+	 * if the frame exceeds the slot size.
+	 */
+	void publish(uint64_t frame, const void* pixels, uint32_t width, uint32_t height, uint32_t stride,
+				 bool bottomUp);
+
+	/*
+	 * Wait up to timeoutMs for a registered consumer to attach. Returns
+	 * false if none did.
+	 */
+	bool waitForConsumer(int timeoutMs) const;
+
+	const std::string& path() const { return ringPath; }
+	Statistics statistics() const;
+
+private:
+	std::string name;		/* shm_open name, empty for a memfd */
+	std::string ringPath;
+	FrameRingPolicy policy;
+	mutable std::mutex mutex;
+	Statistics stats;
+};
+
+class FrameRingReader : public FrameRingMapping {
+public:
+	struct Frame {
+		uint64_t sequence;
+		uint64_t frame;
+		uint64_t timestampNs;	/* CLOCK_MONOTONIC at publish */
+		uint32_t width, height, stride;
+		const unsigned char* pixels;	/* top row first, in the shared ring */
+		size_t size;
+	};
+
+	/*
+	 * Attach to the ring at path, a shared memory name ("/frames") or a file
+	 * such as /proc/<pid>/fd/<fd>. Waits up to timeoutMs for the producer to
+	 * create and initialize it. registered makes this reader the consumer
+	 * whose progress the producer tracks: it waits for it in FRAME_RING_BLOCK
+	 * mode and counts the frames it misses as dropped.
+	 */
+	FrameRingReader(const std::string& path, int timeoutMs, bool registered);
+	~FrameRingReader();
+
+	/*
+	 * Wait up to timeoutMs for the next frame and map it into frame. Returns
+	 * false on timeout, or once the ring is closed and all frames are read.
+	 */
+	bool next(Frame& frame, int timeoutMs);
+
+	/*
+	 * Done with frame: hands the slot back to the producer. Returns false if
+	 * the frame was overwritten while it was in use, i.e. its pixels may be
+	 * torn.
+	 */
+	bool release(const Frame& frame);
+
+	/* Frames the producer overwrote before this reader got to them. */
+	uint64_t lost() const { return lostFrames; }
+
+private:
+	bool registered;
+	uint64_t cursor;
+	uint64_t lostFrames;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Reference consumer of the shared-memory frame ring.
+ *
+ * Attaches to the ring published by egl_opengl_test --shm-ring, reads the
+ * frames in place and reports per-frame latency, lost and torn frames. Exits
+ * with failure on a torn frame, fewer than --frames frames, or frames lost
+ * by a registered consumer.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <time.h>
+
+#include "frame_ring.h"
+
+using namespace std;
+
+
+static uint64_t monotonicNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void printUsage(const char* program) {
+	std::cerr << "Usage: " << program << " RING [options]" << std::endl
+			  << "\tRING              shared memory name (/frames) or /proc/<pid>/fd/<fd>" << std::endl
+			  << "\t--frames=N        stop after N frames, fail on fewer (default: until the producer closes)" << std::endl
+			  << "\t--timeout=MS      give up after MS without a frame (default 5000)" << std::endl
+			  << "\t--hold=MS         keep every frame mapped for MS, to simulate a slow consumer" << std::endl
+			  << "\t--passive         do not register, the producer never waits for this reader" << std::endl
+			  << "\t--quiet           only print the summary" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	const std::string path = argv[1];
+	uint64_t frames = 0;
+	int timeout = 5000, hold = 0;
+	bool registered = true, quiet = false;
+
+	for (int i = 2; i < argc; i++) {
+		const std::string arg = argv[i];
+		const size_t eq = arg.find('=');
+		const std::string name = arg.substr(0, eq);
+		const std::string value = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+
+		if (name == "--frames") {
+			frames = strtoull(value.c_str(), nullptr, 10);
+		} else if (name == "--timeout") {
+			timeout = atoi(value.c_str());
+		} else if (name == "--hold") {
+			hold = atoi(value.c_str());
+		} else if (name == "--passive") {
+			registered = false;
+		} else if (name == "--quiet") {
+			quiet = true;
+		} else {
+			std::cerr << "Unknown option: " << arg << std::endl;
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	try {
+		FrameRingReader ring(path, timeout, registered);
+		uint64_t received = 0, torn = 0;
+		double latencySum = 0, latencyMax = 0;
+
+		FrameRingReader::Frame frame;
+		while ((frames == 0 || received < frames) && ring.next(frame, timeout)) {
+			const double latency = (monotonicNs() - frame.timestampNs) / 1e3;
+			const unsigned char* p = frame.pixels;
+			if (!quiet) {
+				std::cout << "frame " << frame.frame << " : " << frame.width << "x" << frame.height << ", "
+						  << frame.size << " bytes, latency " << latency << " us, first pixel " << (int)p[0] << ","
+						  << (int)p[1] << "," << (int)p[2] << "," << (int)p[3] << std::endl;
+			}
+			if (hold > 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(hold));
+			}
+			if (!ring.release(frame)) {
+				torn++;
+			}
+
+			received++;
+			latencySum += latency;
+			latencyMax = std::max(latencyMax, latency);
+		}
+
+		std::cout << "Received " << received << " frames, " << ring.lost() << " lost, " << torn << " torn, latency "
+				  << (received > 0 ? latencySum / received : 0.0) << " us mean, " << latencyMax << " us max"
+				  << std::endl;
+		if (frames > 0 && received < frames) {
+			std::cerr << "Expected " << frames << " frames" << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (registered && ring.lost() > 0) {
+			std::cerr << "Registered consumer lost " << ring.lost() << " frames" << std::endl;
+			return EXIT_FAILURE;
+		}
+		return received > 0 && torn == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+}
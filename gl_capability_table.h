@@ -0,0 +1,313 @@
+/*
+ * Table of the implementation limits probed by TestOpenGLCapabilities(),
+ * grouped by the GL version or extension that defines them.
+ *
+ * This file is an X-macro list without include guard: it is included several
+ * times with different definitions of
+ *
+ *	GLIF_EXTENSION(name)		start of the group of a version or extension
+ *	GLIF_MACRO(glenum)			GLint limit, glGetIntegerv
+ *	GLIF_MACRON(glenum, n)		indexed GLint limit with n values, glGetIntegeri_v
+ *	GLIF_MACRO64(glenum)		GLint64 limit, glGetInteger64v
+ *	GLIF_MACROF(glenum)			GLfloat limit, glGetFloatv
+ *
+ * Every extension may appear only once; a duplicate fails to compile.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+GLIF_EXTENSION(GL_VERSION_1_1)
+	GLIF_MACRO(GL_MAX_LIST_NESTING)
+	GLIF_MACRO(GL_MAX_EVAL_ORDER)
+	GLIF_MACRO(GL_MAX_LIGHTS)
+	GLIF_MACRO(GL_MAX_TEXTURE_SIZE)
+	GLIF_MACRO(GL_MAX_PIXEL_MAP_TABLE)
+	GLIF_MACRO(GL_MAX_ATTRIB_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_MODELVIEW_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_NAME_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_PROJECTION_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_TEXTURE_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_VIEWPORT_DIMS)
+	GLIF_MACRO(GL_MAX_CLIENT_ATTRIB_STACK_DEPTH)
+
+GLIF_EXTENSION(GL_VERSION_1_2)
+	GLIF_MACRO(GL_MAX_3D_TEXTURE_SIZE)
+	GLIF_MACRO(GL_MAX_ELEMENTS_VERTICES)
+	GLIF_MACRO(GL_MAX_ELEMENTS_INDICES)
+
+GLIF_EXTENSION(GL_VERSION_1_3)
+	GLIF_MACRO(GL_MAX_TEXTURE_UNITS)
+	GLIF_MACRO(GL_MAX_CUBE_MAP_TEXTURE_SIZE)
+
+GLIF_EXTENSION(GL_VERSION_1_4)
+	GLIF_MACROF(GL_MAX_TEXTURE_LOD_BIAS)
+
+GLIF_EXTENSION(GL_VERSION_2_0)
+	GLIF_MACRO(GL_MAX_DRAW_BUFFERS)
+	GLIF_MACRO(GL_MAX_VERTEX_ATTRIBS)
+	GLIF_MACRO(GL_MAX_TEXTURE_COORDS)
+	GLIF_MACRO(GL_MAX_TEXTURE_IMAGE_UNITS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_VARYING_FLOATS)
+	GLIF_MACRO(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS)
+	GLIF_MACRO(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS)
+
+GLIF_EXTENSION(GL_VERSION_3_0)
+	GLIF_MACRO(GL_MAX_CLIP_DISTANCES)
+	GLIF_MACRO(GL_MAX_CLIP_PLANES)
+	GLIF_MACRO(GL_MAX_VARYING_COMPONENTS)
+	GLIF_MACRO(GL_MAX_VARYING_FLOATS)
+	GLIF_MACRO(GL_NUM_EXTENSIONS)
+	GLIF_MACRO(GL_MAX_ARRAY_TEXTURE_LAYERS)
+	GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_COMPONENTS)
+	GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_INTERLEAVED_COMPONENTS)
+	GLIF_MACRO(GL_MAX_TRANSFORM_FEEDBACK_SEPARATE_ATTRIBS)
+	GLIF_MACRO(GL_MAX_PROGRAM_TEXEL_OFFSET)
+	GLIF_MACRO(GL_MIN_PROGRAM_TEXEL_OFFSET)
+
+GLIF_EXTENSION(GL_VERSION_3_1)
+	GLIF_MACRO(GL_MAX_RECTANGLE_TEXTURE_SIZE)
+
+GLIF_EXTENSION(GL_VERSION_3_2)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS)
+	GLIF_MACRO(GL_MAX_VERTEX_OUTPUT_COMPONENTS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_INPUT_COMPONENTS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_COMPONENTS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_INPUT_COMPONENTS)
+
+GLIF_EXTENSION(GL_VERSION_4_4)
+	GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_STRIDE)
+
+GLIF_EXTENSION(GL_VERSION_4_6)
+	GLIF_MACRO(GL_NUM_SPIR_V_EXTENSIONS)
+
+GLIF_EXTENSION(GL_ARB_ES2_compatibility)
+	GLIF_MACRO(GL_NUM_SHADER_BINARY_FORMATS)
+	GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_VECTORS)
+	GLIF_MACRO(GL_MAX_VARYING_VECTORS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_VECTORS)
+
+GLIF_EXTENSION(GL_AMD_debug_output)
+	GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH_AMD)
+	GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES_AMD)
+
+GLIF_EXTENSION(GL_ARB_debug_output)
+	GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH_ARB)
+	GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES_ARB)
+
+GLIF_EXTENSION(GL_ARB_texture_multisample)
+	GLIF_MACRO(GL_MAX_SAMPLE_MASK_WORDS)
+	GLIF_MACRO(GL_MAX_COLOR_TEXTURE_SAMPLES)
+	GLIF_MACRO(GL_MAX_DEPTH_TEXTURE_SAMPLES)
+	GLIF_MACRO(GL_MAX_INTEGER_SAMPLES)
+
+GLIF_EXTENSION(GL_AMD_sparse_texture)
+	GLIF_MACRO(GL_MAX_SPARSE_TEXTURE_SIZE_AMD)
+	GLIF_MACRO(GL_MAX_SPARSE_ARRAY_TEXTURE_LAYERS)
+	GLIF_MACRO64(GL_MAX_SPARSE_3D_TEXTURE_SIZE_AMD)
+
+GLIF_EXTENSION(GL_ARB_sparse_texture)
+	GLIF_MACRO(GL_MAX_SPARSE_TEXTURE_SIZE_ARB)
+	GLIF_MACRO(GL_MAX_SPARSE_3D_TEXTURE_SIZE_ARB)
+	GLIF_MACRO(GL_MAX_SPARSE_ARRAY_TEXTURE_LAYERS_ARB)
+
+GLIF_EXTENSION(GL_ARB_ES3_compatibility)
+	GLIF_MACRO(GL_MAX_ELEMENT_INDEX)
+
+GLIF_EXTENSION(GL_ARB_blend_func_extended)
+	GLIF_MACRO(GL_MAX_DUAL_SOURCE_DRAW_BUFFERS)
+
+GLIF_EXTENSION(GL_ARB_compute_shader)
+	GLIF_MACRO(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE)
+	GLIF_MACRO(GL_MAX_COMPUTE_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_COMPUTE_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_COMPUTE_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_COMBINED_COMPUTE_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS)
+	GLIF_MACRO(GL_MAX_COMPUTE_UNIFORM_BLOCKS)
+	GLIF_MACRO(GL_MAX_COMPUTE_TEXTURE_IMAGE_UNITS)
+	GLIF_MACRO(GL_MAX_COMPUTE_IMAGE_UNIFORMS)
+	GLIF_MACRON(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 3)
+	GLIF_MACRON(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 3)
+
+GLIF_EXTENSION(GL_ARB_compute_variable_group_size)
+	GLIF_MACRO(GL_MAX_COMPUTE_FIXED_GROUP_INVOCATIONS_ARB)
+	GLIF_MACRON(GL_MAX_COMPUTE_FIXED_GROUP_SIZE_ARB, 3)
+	GLIF_MACRO(GL_MAX_COMPUTE_VARIABLE_GROUP_INVOCATIONS_ARB)
+	GLIF_MACRON(GL_MAX_COMPUTE_VARIABLE_GROUP_SIZE_ARB, 3)
+
+GLIF_EXTENSION(GL_ARB_cull_distance)
+	GLIF_MACRO(GL_MAX_CULL_DISTANCES)
+	GLIF_MACRO(GL_MAX_COMBINED_CLIP_AND_CULL_DISTANCES)
+
+GLIF_EXTENSION(GL_ARB_draw_buffers)
+	GLIF_MACRO(GL_MAX_DRAW_BUFFERS_ARB)
+
+GLIF_EXTENSION(GL_ARB_explicit_uniform_location)
+	GLIF_MACRO(GL_MAX_UNIFORM_LOCATIONS)
+
+GLIF_EXTENSION(GL_ARB_fragment_program)
+	GLIF_MACRO(GL_MAX_TEXTURE_COORDS_ARB)
+	GLIF_MACRO(GL_MAX_TEXTURE_IMAGE_UNITS_ARB)
+
+GLIF_EXTENSION(GL_ARB_fragment_shader)
+	GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_COMPONENTS_ARB)
+
+GLIF_EXTENSION(GL_ARB_framebuffer_no_attachments)
+	GLIF_MACRO(GL_MAX_FRAMEBUFFER_WIDTH)
+	GLIF_MACRO(GL_MAX_FRAMEBUFFER_HEIGHT)
+	GLIF_MACRO(GL_MAX_FRAMEBUFFER_LAYERS)
+	GLIF_MACRO(GL_MAX_FRAMEBUFFER_SAMPLES)
+
+GLIF_EXTENSION(GL_EXT_framebuffer_multisample)
+	GLIF_MACRO(GL_MAX_SAMPLES_EXT)
+
+GLIF_EXTENSION(GL_ARB_framebuffer_object)
+	GLIF_MACRO(GL_MAX_RENDERBUFFER_SIZE)
+	GLIF_MACRO(GL_MAX_COLOR_ATTACHMENTS)
+	GLIF_MACRO(GL_MAX_SAMPLES)
+
+GLIF_EXTENSION(GL_ARB_geometry_shader4)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS_ARB)
+	GLIF_MACRO(GL_MAX_GEOMETRY_VARYING_COMPONENTS_ARB)
+	GLIF_MACRO(GL_MAX_VERTEX_VARYING_COMPONENTS_ARB)
+	GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS_ARB)
+	GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES_ARB)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS_ARB)
+
+GLIF_EXTENSION(GL_ARB_gpu_shader5)
+	GLIF_MACRO(GL_MAX_GEOMETRY_SHADER_INVOCATIONS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_INTERPOLATION_OFFSET)
+	GLIF_MACRO(GL_MAX_VERTEX_STREAMS)
+
+GLIF_EXTENSION(GL_ARB_matrix_palette)
+	GLIF_MACRO(GL_MAX_MATRIX_PALETTE_STACK_DEPTH_ARB)
+	GLIF_MACRO(GL_MAX_PALETTE_MATRICES_ARB)
+
+GLIF_EXTENSION(GL_ARB_multitexture)
+	GLIF_MACRO(GL_MAX_TEXTURE_UNITS_ARB)
+
+GLIF_EXTENSION(GL_ARB_parallel_shader_compile)
+	GLIF_MACRO(GL_MAX_SHADER_COMPILER_THREADS_ARB)
+
+GLIF_EXTENSION(GL_ARB_shader_atomic_counters)
+	GLIF_MACRO(GL_MAX_VERTEX_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_TESS_CONTROL_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_TESS_EVALUATION_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_COMBINED_ATOMIC_COUNTER_BUFFERS)
+	GLIF_MACRO(GL_MAX_VERTEX_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_TESS_CONTROL_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_TESS_EVALUATION_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_COMBINED_ATOMIC_COUNTERS)
+	GLIF_MACRO(GL_MAX_ATOMIC_COUNTER_BUFFER_SIZE)
+	GLIF_MACRO(GL_MAX_ATOMIC_COUNTER_BUFFER_BINDINGS)
+
+GLIF_EXTENSION(GL_ARB_shader_image_load_store)
+	GLIF_MACRO(GL_MAX_IMAGE_UNITS)
+	GLIF_MACRO(GL_MAX_COMBINED_IMAGE_UNITS_AND_FRAGMENT_OUTPUTS)
+	GLIF_MACRO(GL_MAX_IMAGE_SAMPLES)
+	GLIF_MACRO(GL_MAX_VERTEX_IMAGE_UNIFORMS)
+	GLIF_MACRO(GL_MAX_TESS_CONTROL_IMAGE_UNIFORMS)
+	GLIF_MACRO(GL_MAX_TESS_EVALUATION_IMAGE_UNIFORMS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_IMAGE_UNIFORMS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_IMAGE_UNIFORMS)
+	GLIF_MACRO(GL_MAX_COMBINED_IMAGE_UNIFORMS)
+
+GLIF_EXTENSION(GL_ARB_uniform_buffer_object)
+	GLIF_MACRO(GL_MAX_VERTEX_UNIFORM_BLOCKS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_BLOCKS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_UNIFORM_BLOCKS)
+	GLIF_MACRO(GL_MAX_COMBINED_UNIFORM_BLOCKS)
+	GLIF_MACRO(GL_MAX_UNIFORM_BUFFER_BINDINGS)
+	GLIF_MACRO(GL_MAX_UNIFORM_BLOCK_SIZE)
+	GLIF_MACRO(GL_MAX_COMBINED_VERTEX_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_COMBINED_GEOMETRY_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_MAX_COMBINED_FRAGMENT_UNIFORM_COMPONENTS)
+	GLIF_MACRO(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+
+GLIF_EXTENSION(GL_ARB_shader_storage_buffer_object)
+	GLIF_MACRO(GL_MAX_COMBINED_SHADER_OUTPUT_RESOURCES)
+	GLIF_MACRO(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_GEOMETRY_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_TESS_CONTROL_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_TESS_EVALUATION_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_FRAGMENT_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_COMBINED_SHADER_STORAGE_BLOCKS)
+	GLIF_MACRO(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS)
+	GLIF_MACRO(GL_MAX_SHADER_STORAGE_BLOCK_SIZE)
+	GLIF_MACRO(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT)
+
+GLIF_EXTENSION(GL_ARB_shader_subroutine)
+	GLIF_MACRO(GL_MAX_SUBROUTINES)
+	GLIF_MACRO(GL_MAX_SUBROUTINE_UNIFORM_LOCATIONS)
+
+GLIF_EXTENSION(GL_ARB_map_buffer_alignment)
+	GLIF_MACRO(GL_MIN_MAP_BUFFER_ALIGNMENT)
+
+GLIF_EXTENSION(GL_EXT_bindable_uniform)
+	GLIF_MACRO(GL_MAX_VERTEX_BINDABLE_UNIFORMS_EXT)
+	GLIF_MACRO(GL_MAX_FRAGMENT_BINDABLE_UNIFORMS_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_BINDABLE_UNIFORMS_EXT)
+	GLIF_MACRO(GL_MAX_BINDABLE_UNIFORM_SIZE_EXT)
+
+GLIF_EXTENSION(GL_EXT_geometry_shader4)
+	GLIF_MACRO(GL_MAX_VARYING_COMPONENTS_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TEXTURE_IMAGE_UNITS_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_VARYING_COMPONENTS_EXT)
+	GLIF_MACRO(GL_MAX_VERTEX_VARYING_COMPONENTS_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_UNIFORM_COMPONENTS_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_OUTPUT_VERTICES_EXT)
+	GLIF_MACRO(GL_MAX_GEOMETRY_TOTAL_OUTPUT_COMPONENTS_EXT)
+
+GLIF_EXTENSION(GL_EXT_framebuffer_object)
+	GLIF_MACRO(GL_MAX_RENDERBUFFER_SIZE_EXT)
+	GLIF_MACRO(GL_MAX_COLOR_ATTACHMENTS_EXT)
+
+GLIF_EXTENSION(GL_EXT_texture3D)
+	GLIF_MACRO(GL_MAX_3D_TEXTURE_SIZE_EXT)
+
+GLIF_EXTENSION(GL_ARB_texture_compression)
+	GLIF_MACRO(GL_NUM_COMPRESSED_TEXTURE_FORMATS_ARB)
+
+GLIF_EXTENSION(GL_ARB_vertex_attrib_binding)
+	GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_RELATIVE_OFFSET)
+	GLIF_MACRO(GL_MAX_VERTEX_ATTRIB_BINDINGS)
+
+GLIF_EXTENSION(GL_ARB_texture_buffer_range)
+	GLIF_MACRO(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT)
+
+GLIF_EXTENSION(GL_ARB_vertex_program)
+	GLIF_MACRO(GL_MAX_PROGRAM_MATRIX_STACK_DEPTH_ARB)
+	GLIF_MACRO(GL_MAX_PROGRAM_MATRICES_ARB)
+	GLIF_MACRO(GL_MAX_VERTEX_ATTRIBS_ARB)
+
+GLIF_EXTENSION(GL_EXT_raster_multisample)
+	GLIF_MACRO64(GL_MAX_RASTER_SAMPLES_EXT)
+
+GLIF_EXTENSION(GL_OVR_multiview)
+	GLIF_MACRO64(GL_MAX_VIEWS_OVR)
+
+GLIF_EXTENSION(GL_KHR_debug)
+	GLIF_MACRO(GL_MAX_DEBUG_GROUP_STACK_DEPTH)
+	GLIF_MACRO(GL_MAX_LABEL_LENGTH)
+	GLIF_MACRO(GL_MAX_DEBUG_MESSAGE_LENGTH)
+	GLIF_MACRO(GL_MAX_DEBUG_LOGGED_MESSAGES)
+
+GLIF_EXTENSION(GL_ARB_sync)
+	GLIF_MACRO64(GL_MAX_SERVER_WAIT_TIMEOUT)
+
+GLIF_EXTENSION(GL_SGIX_async_histogram)
+	GLIF_MACRO64(GL_MAX_ASYNC_HISTOGRAM_SGIX)
+
+GLIF_EXTENSION(GL_ARB_polygon_offset_clamp)
+	GLIF_MACROF(GL_POLYGON_OFFSET_CLAMP)
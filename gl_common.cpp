@@ -0,0 +1,91 @@
+/*
+ * Common EGL/OpenGL error checking helpers.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "gl_common.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#include <EGL/eglext.h>
+
+#include "gl_debug.h"
+#include "metrics.h"
+
+using namespace std;
+
+
+namespace {
+
+GlErrorMode errorMode = GL_ERRORS_STRICT;
+
+}
+
+
+GlErrorMode parseGlErrorMode(const std::string& name) {
+	if (name == "off") {
+		return GL_ERRORS_OFF;
+	}
+	if (name == "debug") {
+		return GL_ERRORS_DEBUG;
+	}
+	if (name == "strict") {
+		return GL_ERRORS_STRICT;
+	}
+	throw runtime_error("Unknown GL error mode \"" + name + "\" (use off, debug or strict)");
+}
+
+void setGlErrorMode(GlErrorMode mode) {
+	errorMode = mode;
+}
+
+GlErrorMode glErrorMode() {
+	return errorMode;
+}
+
+std::vector<EGLint> glContextAttributes() {
+	std::vector<EGLint> attributes;
+	if (errorMode == GL_ERRORS_DEBUG) {
+		attributes.push_back(EGL_CONTEXT_FLAGS_KHR);
+		attributes.push_back(EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR);
+	}
+	attributes.push_back(EGL_NONE);
+	return attributes;
+}
+
+void assertOpenGLError(const char* msg) {
+	if (errorMode == GL_ERRORS_OFF) {
+		return;
+	}
+	if (errorMode == GL_ERRORS_DEBUG) {
+		if (glDebugErrorPending()) {
+			const std::string errors = drainGlDebugMessages();
+			countMetric(METRIC_GL_ERRORS);
+			throw runtime_error("OpenGL error at " + std::string(msg) + ": " + errors);
+		}
+		return;
+	}
+
+	GLenum error = glGetError();
+
+	if (error != GL_NO_ERROR) {
+		countMetric(METRIC_GL_ERRORS);
+		stringstream s;
+		s << "OpenGL error 0x" << std::hex << error << " at " << msg;
+		throw runtime_error(s.str());
+	}
+}
+
+void assertEGLError(const char* msg) {
+	EGLint error = eglGetError();
+
+	if (error != EGL_SUCCESS) {
+		countMetric(METRIC_EGL_ERRORS);
+		stringstream s;
+		s << "EGL error 0x" << std::hex << error << " at " << msg;
+		throw runtime_error(s.str());
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ * Common EGL/OpenGL includes and error checking helpers shared by the
+ * offscreen rendering modules.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_GL_COMMON_H
+#define EGL_OFFSCREEN_GL_COMMON_H
+
+#include <string>
+#include <vector>
+
+/*
+ * EGL headers.
+ */
+#include <EGL/egl.h>
+
+/*
+ * OpenGL headers.
+ */
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/*
+ * How assertOpenGLError() detects GL errors:
+ *
+ *	off		no checking at all
+ *	debug	KHR_debug messages, delivered asynchronously by the driver into a
+ *			lock-free ring; assertOpenGLError() only looks at a flag
+ *	strict	synchronous glGetError() after every checked call (default)
+ */
+enum GlErrorMode {
+	GL_ERRORS_OFF,
+	GL_ERRORS_DEBUG,
+	GL_ERRORS_STRICT
+};
+
+GlErrorMode parseGlErrorMode(const std::string& name);
+void setGlErrorMode(GlErrorMode mode);
+GlErrorMode glErrorMode();
+
+/*
+ * eglCreateContext attributes for the current mode: a debug context in
+ * debug mode, none otherwise.
+ */
+std::vector<EGLint> glContextAttributes();
+
+/*
+ * Throw a std::runtime_error naming msg if a GL error was detected (see
+ * GlErrorMode) or the EGL error flag is set. EGL errors are always checked,
+ * eglGetError() is answered by the client library without a GPU round-trip.
+ */
+void assertOpenGLError(const char* msg);
+void assertEGLError(const char* msg);
+
+#endif
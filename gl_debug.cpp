@@ -0,0 +1,258 @@
+/*
+ * KHR_debug message ring.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "gl_debug.h"
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
+#include "gl_extensions.h"
+
+using namespace std;
+
+
+namespace {
+
+const size_t ringSize = 256;	/* power of two */
+const size_t maxMessageLength = 240;
+
+}
+
+
+struct GlDebugMessage {
+	std::atomic<uint64_t> sequence;
+	GLenum source, type, severity;
+	GLuint id;
+	char text[maxMessageLength];
+};
+
+/*
+ * Slot i is free for the producer at position p when its sequence equals p,
+ * and holds a message for the consumer at position p when it equals p + 1.
+ */
+struct GlDebugRing {
+	GlDebugRing() : head(0), tail(0), dropped(0), errorPending(false), expecting(0) {
+		for (size_t i = 0; i < ringSize; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	GlDebugMessage slots[ringSize];
+	std::atomic<uint64_t> head;		/* next position to produce */
+	uint64_t tail;					/* next position to consume, drain side only */
+	std::atomic<size_t> dropped;
+	std::atomic<bool> errorPending;
+	std::atomic<int> expecting;		/* GlExpectedErrors scopes open on the context */
+	std::mutex drainMutex;			/* serializes drains; producers never block */
+};
+
+
+namespace {
+
+/*
+ * One ring per context, so an error is reported by the next check on the
+ * context that caused it. Rings are never freed: an asynchronous callback
+ * may still arrive after its context is gone.
+ */
+struct RingRegistry {
+	std::mutex mutex;
+	std::map<EGLContext, GlDebugRing*> rings;
+};
+
+RingRegistry& registry() {
+	static RingRegistry* instance = new RingRegistry();
+	return *instance;
+}
+
+thread_local EGLContext cachedContext = EGL_NO_CONTEXT;
+thread_local GlDebugRing* cachedRing = nullptr;
+
+/*
+ * The ring of the calling thread's current context, nullptr if the callback
+ * was not installed on it.
+ */
+GlDebugRing* currentRing() {
+	const EGLContext context = eglGetCurrentContext();
+	if (context != cachedContext) {
+		RingRegistry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		auto found = all.rings.find(context);
+		cachedRing = found == all.rings.end() ? nullptr : found->second;
+		cachedContext = context;
+	}
+	return cachedRing;
+}
+
+void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+							const GLchar* message, const void* userParam) {
+	GlDebugRing& ring = *(GlDebugRing*)userParam;
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) {
+		return;
+	}
+	if (type == GL_DEBUG_TYPE_ERROR) {
+		if (ring.expecting.load(std::memory_order_relaxed) > 0) {
+			return;
+		}
+		ring.errorPending.store(true, std::memory_order_release);
+	}
+
+	uint64_t position = ring.head.load(std::memory_order_relaxed);
+	GlDebugMessage* slot;
+	for (;;) {
+		slot = &ring.slots[position & (ringSize - 1)];
+		const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const int64_t difference = (int64_t)sequence - (int64_t)position;
+		if (difference == 0) {
+			if (ring.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (difference < 0) {
+			ring.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			position = ring.head.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->source = source;
+	slot->type = type;
+	slot->severity = severity;
+	slot->id = id;
+	size_t size = length < 0 ? strlen(message) : (size_t)length;
+	if (size >= maxMessageLength) {
+		size = maxMessageLength - 1;
+	}
+	memcpy(slot->text, message, size);
+	slot->text[size] = '\0';
+	slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+const char* typeName(GLenum type) {
+	switch (type) {
+		case GL_DEBUG_TYPE_ERROR: return "error";
+		case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+		case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+		case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+		case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+		case GL_DEBUG_TYPE_MARKER: return "marker";
+		default: return "other";
+	}
+}
+
+}
+
+
+void installGlDebugCallback() {
+	if (glErrorMode() != GL_ERRORS_DEBUG) {
+		return;
+	}
+	if (!isGlextSupported("GL_KHR_debug")) {
+		throw runtime_error("GL error mode \"debug\" requires GL_KHR_debug");
+	}
+
+	const EGLContext context = eglGetCurrentContext();
+	GlDebugRing* ring;
+	{
+		RingRegistry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		GlDebugRing*& entry = all.rings[context];
+		if (!entry) {
+			entry = new GlDebugRing();
+		}
+		ring = entry;
+	}
+	cachedContext = EGL_NO_CONTEXT;
+
+	glDebugMessageCallback(debugCallback, ring);
+	// Asynchronous delivery: the driver does not have to serialize for us.
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glEnable(GL_DEBUG_OUTPUT);
+}
+
+bool glDebugErrorPending() {
+	const GlDebugRing* ring = currentRing();
+	return ring && ring->errorPending.load(std::memory_order_acquire);
+}
+
+size_t glDebugDroppedMessages() {
+	RingRegistry& all = registry();
+	std::lock_guard<std::mutex> lock(all.mutex);
+	size_t dropped = 0;
+	for (const auto& entry : all.rings) {
+		dropped += entry.second->dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
+
+std::string drainGlDebugMessages() {
+	GlDebugRing* current = currentRing();
+	if (!current) {
+		return "";
+	}
+	GlDebugRing& ring = *current;
+	std::lock_guard<std::mutex> lock(ring.drainMutex);
+
+	// Clear first, so an error arriving during the drain stays pending.
+	ring.errorPending.store(false, std::memory_order_release);
+
+	stringstream errors;
+	for (;;) {
+		GlDebugMessage& slot = ring.slots[ring.tail & (ringSize - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != ring.tail + 1) {
+			break;
+		}
+
+		if (slot.type == GL_DEBUG_TYPE_ERROR) {
+			if (errors.tellp() > 0) {
+				errors << "; ";
+			}
+			errors << slot.text << " (id 0x" << std::hex << slot.id << std::dec << ")";
+		} else {
+			std::cerr << "GL debug [" << typeName(slot.type) << "] " << slot.text << std::endl;
+		}
+
+		slot.sequence.store(ring.tail + ringSize, std::memory_order_release);
+		ring.tail++;
+	}
+	return errors.str();
+}
+
+GlExpectedErrors::GlExpectedErrors() : ring(glErrorMode() == GL_ERRORS_DEBUG ? currentRing() : nullptr) {
+	if (ring) {
+		// Synchronous delivery, so the errors of the scope arrive within it.
+		ring->expecting.fetch_add(1, std::memory_order_relaxed);
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	}
+}
+
+GlExpectedErrors::~GlExpectedErrors() {
+	while (glGetError() != GL_NO_ERROR) {
+	}
+	if (ring) {
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		ring->expecting.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+GlDebugGroup::GlDebugGroup(const char* label) : active(glErrorMode() == GL_ERRORS_DEBUG) {
+	if (active) {
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, label);
+	}
+}
+
+GlDebugGroup::~GlDebugGroup() {
+	if (active) {
+		glPopDebugGroup();
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * KHR_debug support for the "debug" GL error mode.
+ *
+ * The driver's debug callback may run on any thread, so messages are pushed
+ * into a fixed-size lock-free ring (a bounded multi-producer queue with
+ * per-slot sequence numbers) and only formatted when drained. Messages that
+ * arrive while the ring is full are counted and dropped. Every context the
+ * callback is installed on gets its own ring, so the checks of one thread
+ * only see the errors of the context current on it.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_GL_DEBUG_H
+#define EGL_OFFSCREEN_GL_DEBUG_H
+
+#include <cstddef>
+#include <string>
+
+#include "gl_common.h"
+
+struct GlDebugRing;
+
+/*
+ * Enable KHR_debug output with our callback on the current context. Does
+ * nothing unless the error mode is GL_ERRORS_DEBUG; throws if the context
+ * lacks GL_KHR_debug.
+ */
+void installGlDebugCallback();
+
+/*
+ * True once an error-type message was received on the current context and
+ * not yet drained.
+ */
+bool glDebugErrorPending();
+
+/*
+ * Remove all queued messages of the current context. Errors are returned joined into one string,
+ * other messages (performance, portability, ...) are logged to stderr.
+ */
+std::string drainGlDebugMessages();
+
+/*
+ * Number of messages dropped because a ring was full, over all contexts.
+ */
+size_t glDebugDroppedMessages();
+
+/*
+ * Marks a scope whose GL errors are expected, such as probing queries a
+ * driver may not support. The errors neither reach the debug ring of the
+ * current context nor stay in glGetError() after the scope, so they do not
+ * fail the next assertOpenGLError().
+ */
+class GlExpectedErrors {
+public:
+	GlExpectedErrors();
+	~GlExpectedErrors();
+
+	GlExpectedErrors(const GlExpectedErrors&) = delete;
+	GlExpectedErrors& operator=(const GlExpectedErrors&) = delete;
+
+private:
+	GlDebugRing* ring;	/* of the current context in GL_ERRORS_DEBUG mode */
+};
+
+/*
+ * Labels the GL commands issued in its scope with glPushDebugGroup, so
+ * debug messages and captures in tools show which stage they belong to.
+ * Only active in GL_ERRORS_DEBUG mode.
+ */
+class GlDebugGroup {
+public:
+	explicit GlDebugGroup(const char* label);
+	~GlDebugGroup();
+
+	GlDebugGroup(const GlDebugGroup&) = delete;
+	GlDebugGroup& operator=(const GlDebugGroup&) = delete;
+
+private:
+	bool active;
+};
+
+#endif
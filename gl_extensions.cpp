@@ -0,0 +1,94 @@
+/*
+ * OpenGL extension lookup.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "gl_extensions.h"
+
+#include <string.h>
+
+using namespace std;
+
+
+size_t GlExtensionIndex::Hash::operator()(const char* s) const {
+	// FNV-1a
+	size_t hash = (size_t)14695981039346656037ULL;
+	for (; *s; s++) {
+		hash ^= (unsigned char)*s;
+		hash *= (size_t)1099511628211ULL;
+	}
+	return hash;
+}
+
+bool GlExtensionIndex::Equal::operator()(const char* a, const char* b) const {
+	return strcmp(a, b) == 0;
+}
+
+void GlExtensionIndex::load() {
+	names.clear();
+	storage.clear();
+
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	assertOpenGLError("glGetIntegerv(GL_NUM_EXTENSIONS)");
+
+	// Fill storage first, the set keeps pointers into it.
+	storage.reserve(count);
+	for (GLint i = 0; i < count; i++) {
+		const GLubyte* name = glGetStringi(GL_EXTENSIONS, i);
+		if (name) {
+			storage.push_back((const char*)name);
+		}
+	}
+	assertOpenGLError("glGetStringi(GL_EXTENSIONS)");
+
+	names.reserve(storage.size());
+	for (size_t i = 0; i < storage.size(); i++) {
+		names.insert(storage[i].c_str());
+	}
+	isLoaded = true;
+}
+
+bool GlExtensionIndex::contains(const char* name) const {
+	return names.find(name) != names.end();
+}
+
+GlExtensionIndex& glExtensionIndex() {
+	static GlExtensionIndex index;
+	return index;
+}
+
+bool isGlextSupported(const char extension[]) {
+	GlExtensionIndex& index = glExtensionIndex();
+	if (!index.loaded()) {
+		index.load();
+	}
+	return index.contains(extension);
+}
+
+bool isGlextSupportedScan(const char extension[])
+{
+	GLubyte *where, *terminator;
+
+	// Extension names should not have spaces.
+	where = (GLubyte*) strchr(extension, ' ');
+	if (where || extension[0] == '\0') return false;
+
+	const GLubyte* extensions = glGetString(GL_EXTENSIONS);
+	if (!extensions) return false;  //glGetString did not return a string
+
+	// It takes a bit of care to be fool-proof about parsing the
+	// OpenGL extensions string. Don't be fooled by sub-strings, etc.
+	const GLubyte* start = extensions;
+	for (;;)
+	{
+		where = (GLubyte*)strstr((const char*)start, extension);
+		if (!where)	return false;
+		terminator = where + strlen(extension);
+		if ((where == start || *(where - 1) == ' ') && (*terminator == ' ' || *terminator == '\0'))
+			return true;
+		start = terminator;
+	}
+}
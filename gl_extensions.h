@@ -0,0 +1,62 @@
+/*
+ * OpenGL extension lookup.
+ *
+ * The extension names of the current context are read once with
+ * glGetStringi(GL_EXTENSIONS, i), which unlike glGetString(GL_EXTENSIONS)
+ * also works in core profiles, and kept in a hash set so every
+ * isGlextSupported() call is a single O(1) lookup.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_GL_EXTENSIONS_H
+#define EGL_OFFSCREEN_GL_EXTENSIONS_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "gl_common.h"
+
+class GlExtensionIndex {
+public:
+	/*
+	 * (Re)build the index from the current context.
+	 */
+	void load();
+
+	bool contains(const char* name) const;
+	bool loaded() const { return isLoaded; }
+	size_t size() const { return storage.size(); }
+	const std::string& name(size_t i) const { return storage[i]; }
+
+private:
+	struct Hash {
+		size_t operator()(const char* s) const;
+	};
+	struct Equal {
+		bool operator()(const char* a, const char* b) const;
+	};
+
+	std::vector<std::string> storage;
+	std::unordered_set<const char*, Hash, Equal> names;	/* points into storage */
+	bool isLoaded = false;
+};
+
+/*
+ * Index of the context the program renders with. Load it right after the
+ * context is made current; isGlextSupported() loads it lazily otherwise.
+ */
+GlExtensionIndex& glExtensionIndex();
+
+bool isGlextSupported(const char extension[]);
+
+/*
+ * The original glGetString(GL_EXTENSIONS) + strstr scan, kept as the
+ * baseline for the lookup benchmark.
+ */
+bool isGlextSupportedScan(const char extension[]);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * GPU-side conversion of the rendered frame before readback.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "gpu_convert.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdio.h>
+
+#include "gl_debug.h"
+#include "gl_extensions.h"
+#include "metrics.h"
+
+using namespace std;
+
+
+namespace {
+
+const GLuint groupSize = 64;
+
+/*
+ * Shared by all passes: one invocation per output word, or group of words,
+ * counted across a 2D dispatch for outputs beyond the work group count limit.
+ */
+const char* shaderPrologue = R"(#version 430
+layout(local_size_x = 64) in;
+layout(binding = 0) uniform sampler2D source;
+layout(std430, binding = 0) writeonly buffer Output { uint words[]; };
+uniform ivec2 size;
+
+int invocation() {
+	return int(gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x);
+}
+
+// Pixel (x, y) of the top-down image; the framebuffer is bottom-up.
+vec3 pixel(int x, int y) {
+	return texelFetch(source, ivec2(x, size.y - 1 - y), 0).rgb;
+}
+
+uint toByte(float value) {
+	return uint(clamp(value, 0.0, 255.0) + 0.5);
+}
+
+uint packBytes(uint b0, uint b1, uint b2, uint b3) {
+	return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+}
+)";
+
+/*
+ * Four pixels in three words.
+ */
+const char* rgb24Shader = R"(
+void main() {
+	int total = size.x * size.y;
+	int first = invocation() * 4;
+	if (first >= total) {
+		return;
+	}
+	uint b[12];
+	for (int i = 0; i < 4; i++) {
+		int p = min(first + i, total - 1);
+		vec3 c = pixel(p % size.x, p / size.x) * 255.0;
+		b[3 * i] = toByte(c.r);
+		b[3 * i + 1] = toByte(c.g);
+		b[3 * i + 2] = toByte(c.b);
+	}
+	int count = (total * 3 + 3) / 4;
+	int base = first / 4 * 3;
+	for (int i = 0; i < 3 && base + i < count; i++) {
+		words[base + i] = packBytes(b[4 * i], b[4 * i + 1], b[4 * i + 2], b[4 * i + 3]);
+	}
+}
+)";
+
+/*
+ * Four luma samples in one word; the first quarter of the invocations also
+ * write four samples of each chroma plane.
+ */
+const char* yuv420Shader = R"(
+float luma(vec3 c) {
+	return 16.0 + dot(c, vec3(65.481, 128.553, 24.966));
+}
+
+void main() {
+	int lumaWords = size.x * size.y / 4;
+	int chromaWords = lumaWords / 4;
+	int i = invocation();
+	if (i >= lumaWords) {
+		return;
+	}
+
+	uint y[4];
+	for (int k = 0; k < 4; k++) {
+		int p = i * 4 + k;
+		y[k] = toByte(luma(pixel(p % size.x, p / size.x)));
+	}
+	words[i] = packBytes(y[0], y[1], y[2], y[3]);
+
+	if (i < chromaWords) {
+		int chromaWidth = size.x / 2;
+		uint u[4], v[4];
+		for (int k = 0; k < 4; k++) {
+			int p = i * 4 + k;
+			int sx = p % chromaWidth * 2, sy = p / chromaWidth * 2;
+			vec3 c = (pixel(sx, sy) + pixel(sx + 1, sy) + pixel(sx, sy + 1) + pixel(sx + 1, sy + 1)) * 0.25;
+			u[k] = toByte(128.0 + dot(c, vec3(-37.797, -74.203, 112.0)));
+			v[k] = toByte(128.0 + dot(c, vec3(112.0, -93.786, -18.214)));
+		}
+		words[lumaWords + i] = packBytes(u[0], u[1], u[2], u[3]);
+		words[lumaWords + chromaWords + i] = packBytes(v[0], v[1], v[2], v[3]);
+	}
+}
+)";
+
+/*
+ * One output pixel per invocation, averaged over its 2x2 source block.
+ */
+const char* thumbnailShader = R"(
+void main() {
+	ivec2 thumb = max(size / 2, ivec2(1));
+	int i = invocation();
+	if (i >= thumb.x * thumb.y) {
+		return;
+	}
+	int x = i % thumb.x * 2, y = i / thumb.x * 2;
+	int x1 = min(x + 1, size.x - 1), y1 = min(y + 1, size.y - 1);
+	vec4 c = vec4(0.0);
+	c += texelFetch(source, ivec2(x, size.y - 1 - y), 0);
+	c += texelFetch(source, ivec2(x1, size.y - 1 - y), 0);
+	c += texelFetch(source, ivec2(x, size.y - 1 - y1), 0);
+	c += texelFetch(source, ivec2(x1, size.y - 1 - y1), 0);
+	c *= 255.0 / 4.0;
+	words[i] = packBytes(toByte(c.r), toByte(c.g), toByte(c.b), toByte(c.a));
+}
+)";
+
+}
+
+
+GpuConvertFormat parseGpuConvertFormat(const std::string& name) {
+	if (name == "none") {
+		return GPU_CONVERT_NONE;
+	} else if (name == "rgb24") {
+		return GPU_CONVERT_RGB24;
+	} else if (name == "yuv420") {
+		return GPU_CONVERT_YUV420;
+	} else if (name == "thumbnail") {
+		return GPU_CONVERT_THUMBNAIL;
+	}
+	throw runtime_error("Unknown GPU conversion: " + name);
+}
+
+const char* gpuConvertFormatName(GpuConvertFormat format) {
+	switch (format) {
+	case GPU_CONVERT_RGB24:
+		return "rgb24";
+	case GPU_CONVERT_YUV420:
+		return "yuv420";
+	case GPU_CONVERT_THUMBNAIL:
+		return "thumbnail";
+	default:
+		return "none";
+	}
+}
+
+bool isGpuYuv420Size(size_t width, size_t height) {
+	// Each chroma plane must fill whole words, so no word straddles two planes.
+	return width % 2 == 0 && height % 2 == 0 && width / 2 * (height / 2) % 4 == 0;
+}
+
+bool isGpuConvertSupported() {
+	if (!isGlextSupported("GL_ARB_compute_shader") || !isGlextSupported("GL_ARB_shader_storage_buffer_object")) {
+		return false;
+	}
+
+	// The passes are written in GLSL 4.30.
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
+	if (!version || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 100 + minor < 430) {
+		return false;
+	}
+
+	GLint invocations = 0, groupWidth = 0, groupCount = 0, storageBlocks = 0;
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &invocations);
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &groupWidth);
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &groupCount);
+	glGetIntegerv(GL_MAX_COMPUTE_SHADER_STORAGE_BLOCKS, &storageBlocks);
+	assertOpenGLError("isGpuConvertSupported");
+	return invocations >= (GLint)groupSize && groupWidth >= (GLint)groupSize && groupCount > 0 && storageBlocks > 0;
+}
+
+std::vector<ShaderSource> gpuConvertShaderSources(GpuConvertFormat format) {
+	const char* body;
+	switch (format) {
+	case GPU_CONVERT_RGB24:
+		body = rgb24Shader;
+		break;
+	case GPU_CONVERT_YUV420:
+		body = yuv420Shader;
+		break;
+	case GPU_CONVERT_THUMBNAIL:
+		body = thumbnailShader;
+		break;
+	default:
+		throw runtime_error("gpuConvertShaderSources: no conversion");
+	}
+	const ShaderSource compute = {GL_COMPUTE_SHADER, std::string(shaderPrologue) + body};
+	return std::vector<ShaderSource>(1, compute);
+}
+
+GpuConverter::GpuConverter(GLuint program, GpuConvertFormat format, GLsizei width, GLsizei height)
+	: program(program), outputFormat(format), sourceWidth(width), sourceHeight(height), width(width),
+	  height(height) {
+	if (width <= 0 || height <= 0) {
+		throw runtime_error("GpuConverter: empty frame");
+	}
+	const size_t pixels = (size_t)width * height;
+
+	switch (format) {
+	case GPU_CONVERT_RGB24:
+		size = pixels * 3;
+		invocations = (GLuint)((pixels + 3) / 4);
+		break;
+	case GPU_CONVERT_YUV420:
+		if (!isGpuYuv420Size(width, height)) {
+			throw runtime_error("GpuConverter: yuv420 needs an even size with chroma planes of whole words, not " +
+								to_string(width) + "x" + to_string(height));
+		}
+		size = pixels * 3 / 2;
+		invocations = (GLuint)(pixels / 4);
+		break;
+	case GPU_CONVERT_THUMBNAIL:
+		this->width = std::max(width / 2, 1);
+		this->height = std::max(height / 2, 1);
+		size = (size_t)this->width * this->height * 4;
+		invocations = (GLuint)(size / 4);
+		break;
+	default:
+		throw runtime_error("GpuConverter: no conversion");
+	}
+
+	sizeLocation = glGetUniformLocation(program, "size");
+	assertOpenGLError("GpuConverter");
+}
+
+void GpuConverter::convert(GLuint texture, GLuint output) {
+	GlDebugGroup group("gpu convert");
+
+	// Spread the work groups over a second dimension beyond the count limit.
+	GLint maxGroups = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
+	const GLuint groups = (invocations + groupSize - 1) / groupSize;
+	const GLuint groupsX = std::min(groups, (GLuint)maxGroups);
+	const GLuint groupsY = (groups + groupsX - 1) / groupsX;
+
+	glUseProgram(program);
+	glUniform2i(sizeLocation, sourceWidth, sourceHeight);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, output);
+
+	glDispatchCompute(groupsX, groupsY, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+	assertOpenGLError("GpuConverter glDispatchCompute");
+}
+
+void writeConvertedFrame(const std::string& path, const GpuConverter& converter, const void* data,
+						 const ImageWriterOptions& options) {
+	if (converter.format() == GPU_CONVERT_THUMBNAIL) {
+		ImageWriter writer(path, converter.outputWidth(), converter.outputHeight(), options);
+		writer.writeRows((const unsigned char*)data, converter.outputWidth() * 4, converter.outputHeight(), false);
+		writer.finish();
+		return;
+	}
+	if (converter.format() == GPU_CONVERT_RGB24 && options.format != IMAGE_RAW) {
+		// The writer takes RGBA rows, so widen the packed top-down rows one band at a time.
+		const size_t width = converter.outputWidth(), height = converter.outputHeight();
+		const size_t bandRows = std::max<size_t>(options.bandRows, 1);
+		const unsigned char* rgb = (const unsigned char*)data;
+		std::vector<unsigned char> rgba(width * 4 * std::min(bandRows, height));
+		ImageWriter writer(path, width, height, options);
+		for (size_t row = 0; row < height; row += bandRows) {
+			const size_t rows = std::min(bandRows, height - row);
+			const unsigned char* source = rgb + row * width * 3;
+			for (size_t i = 0; i < rows * width; i++) {
+				rgba[4 * i] = source[3 * i];
+				rgba[4 * i + 1] = source[3 * i + 1];
+				rgba[4 * i + 2] = source[3 * i + 2];
+				rgba[4 * i + 3] = 255;
+			}
+			writer.writeRows(rgba.data(), width * 4, rows, false);
+		}
+		writer.finish();
+		return;
+	}
+	if (options.format != IMAGE_RAW) {
+		throw runtime_error(std::string(gpuConvertFormatName(converter.format())) + " frames can only be saved as .raw: " +
+							path);
+	}
+
+	StageTimer timer(METRIC_WRITE);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		throw runtime_error("Cannot create " + path);
+	}
+	bool written = fwrite(data, 1, converter.outputSize(), file) == converter.outputSize();
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		throw runtime_error("Cannot write " + path);
+	}
+}
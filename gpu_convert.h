@@ -0,0 +1,98 @@
+/*
+ * GPU-side conversion of the rendered frame before readback.
+ *
+ * A compute shader reads the color attachment and writes the frame, already
+ * converted and packed, into a buffer that the PBO ring then maps: only the
+ * reduced bytes cross to host memory, and the host does no per-pixel work.
+ *
+ *	rgb24		packed RGB, 3 instead of 4 bytes per pixel
+ *	yuv420		planar I420, BT.601 limited range, 1.5 bytes per pixel
+ *	thumbnail	RGBA at half the width and height, 2x2 box filtered
+ *
+ * All outputs are top-down and tightly packed.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_GPU_CONVERT_H
+#define EGL_OFFSCREEN_GPU_CONVERT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "gl_common.h"
+#include "image_writer.h"
+#include "shader_cache.h"
+
+enum GpuConvertFormat {
+	GPU_CONVERT_NONE,
+	GPU_CONVERT_RGB24,
+	GPU_CONVERT_YUV420,
+	GPU_CONVERT_THUMBNAIL
+};
+
+GpuConvertFormat parseGpuConvertFormat(const std::string& name);
+const char* gpuConvertFormatName(GpuConvertFormat format);
+
+/*
+ * True if the current context has compute shaders and shader storage
+ * buffers with the work group limits the conversion passes rely on.
+ */
+bool isGpuConvertSupported();
+
+/*
+ * True if width x height frames can be converted to yuv420: even edges, and
+ * a chroma plane size divisible by 4.
+ */
+bool isGpuYuv420Size(size_t width, size_t height);
+
+/*
+ * GLSL sources of the compute program for format.
+ */
+std::vector<ShaderSource> gpuConvertShaderSources(GpuConvertFormat format);
+
+class GpuConverter {
+public:
+	/*
+	 * Convert width x height frames with program, built from
+	 * gpuConvertShaderSources(format). Throws if the size does not suit the
+	 * format, see isGpuYuv420Size().
+	 */
+	GpuConverter(GLuint program, GpuConvertFormat format, GLsizei width, GLsizei height);
+
+	GpuConverter(const GpuConverter&) = delete;
+	GpuConverter& operator=(const GpuConverter&) = delete;
+
+	/*
+	 * Convert the RGBA8 texture into output, which must hold bufferSize()
+	 * bytes. The writes are visible to buffer mapping and copies afterwards.
+	 */
+	void convert(GLuint texture, GLuint output);
+
+	GpuConvertFormat format() const { return outputFormat; }
+	size_t outputSize() const { return size; }
+	size_t bufferSize() const { return (size + 3) / 4 * 4; }	/* whole words */
+	GLsizei outputWidth() const { return width; }
+	GLsizei outputHeight() const { return height; }
+
+private:
+	GLuint program;
+	GpuConvertFormat outputFormat;
+	GLsizei sourceWidth, sourceHeight;
+	GLsizei width, height;		/* of the output image */
+	size_t size;
+	GLuint invocations;			/* one per 32-bit output word, or word group */
+	GLint sizeLocation;
+};
+
+/*
+ * Save a frame converted by converter to path: thumbnails and rgb24 frames
+ * in any image format (a .raw rgb24 frame is written as it is), yuv420
+ * frames as they are, which needs a .raw path.
+ */
+void writeConvertedFrame(const std::string& path, const GpuConverter& converter, const void* data,
+						 const ImageWriterOptions& options);
+
+#endif
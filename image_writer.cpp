@@ -0,0 +1,363 @@
+/*
+ * Streaming PPM/raw/PNG writer.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "image_writer.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "metrics.h"
+
+using namespace std;
+
+
+/*
+ * Rows of one encoding task. For PNG the output is the raw deflate stream of
+ * the filtered scanlines, otherwise the converted rows themselves.
+ */
+struct ImageWriter::Band {
+	const unsigned char* source;	/* first row in memory order */
+	size_t stride;
+	size_t rows;
+	bool bottomUp;
+	bool last;						/* band holds the last row of the image */
+
+	std::vector<unsigned char> output;
+	unsigned long adler;			/* adler32 of the PNG scanlines */
+	size_t scanlineBytes;
+};
+
+namespace {
+
+void storeBigEndian(unsigned char* out, uint32_t value) {
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+bool endsWith(const std::string& value, const std::string& suffix) {
+	return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+
+ImageEncoderPool::ImageEncoderPool(size_t count) : stopping(false) {
+	if (count == 0) {
+		count = std::thread::hardware_concurrency();
+	}
+	for (size_t i = 0; i < std::max<size_t>(count, 1); i++) {
+		threads.push_back(std::thread([this] { run(); }));
+	}
+}
+
+ImageEncoderPool::~ImageEncoderPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+std::future<void> ImageEncoderPool::submit(const std::function<void()>& work) {
+	std::shared_ptr<std::packaged_task<void()>> task = std::make_shared<std::packaged_task<void()>>(work);
+	std::future<void> result = task->get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back([task] { (*task)(); });
+	}
+	available.notify_one();
+	return result;
+}
+
+void ImageEncoderPool::run() {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			available.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (tasks.empty()) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+ImageFormat imageFormatFromPath(const std::string& path) {
+	if (endsWith(path, ".ppm")) {
+		return IMAGE_PPM;
+	}
+	if (endsWith(path, ".raw") || endsWith(path, ".rgb") || endsWith(path, ".bgr") || endsWith(path, ".rgba")) {
+		return IMAGE_RAW;
+	}
+	if (endsWith(path, ".png")) {
+		return IMAGE_PNG;
+	}
+	throw runtime_error("Unknown image format for " + path + " (use .png, .ppm or .raw)");
+}
+
+ImageWriter::ImageWriter(const std::string& path, size_t width, size_t height, const ImageWriterOptions& options)
+	: path(path), file(nullptr), width(width), height(height), options(options), written(0), fileBytes(0),
+	  adler(adler32(0, Z_NULL, 0)), workers(nullptr) {
+	layout = options.format == IMAGE_PPM ? PIXELS_RGB
+			 : options.format == IMAGE_PNG && options.layout != PIXELS_RGBA ? PIXELS_RGB
+			 : options.layout;
+	rowBytes = width * pixelLayoutSize(layout);
+	if (this->options.bandRows == 0) {
+		this->options.bandRows = 64;
+	}
+	if (options.pngLevel < 0 || options.pngLevel > 9) {
+		throw runtime_error("PNG compression level must be 0 to 9");
+	}
+
+	file = fopen(path.c_str(), "wb");
+	if (!file) {
+		throw runtime_error("Could not create " + path);
+	}
+
+	workers = options.encoders;
+	if (!workers) {
+		ownedWorkers.reset(new ImageEncoderPool(options.threads));
+		workers = ownedWorkers.get();
+	}
+
+	if (options.format == IMAGE_PPM) {
+		const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+		put(header.data(), header.size());
+	} else if (options.format == IMAGE_PNG) {
+		static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+		put(signature, sizeof(signature));
+
+		unsigned char ihdr[13];
+		storeBigEndian(ihdr, (uint32_t)width);
+		storeBigEndian(ihdr + 4, (uint32_t)height);
+		ihdr[8] = 8;								/* bit depth */
+		ihdr[9] = layout == PIXELS_RGBA ? 6 : 2;	/* color type RGBA / RGB */
+		ihdr[10] = 0;								/* deflate */
+		ihdr[11] = 0;								/* adaptive filtering */
+		ihdr[12] = 0;								/* no interlace */
+		putChunk("IHDR", nullptr, 0, ihdr, sizeof(ihdr), nullptr, 0);
+	}
+}
+
+ImageWriter::~ImageWriter() {
+	if (file) {
+		fclose(file);
+	}
+}
+
+void ImageWriter::put(const void* data, size_t size) {
+	StageTimer timer(METRIC_WRITE);
+	if (size && fwrite(data, 1, size, file) != size) {
+		throw runtime_error("Could not write " + path);
+	}
+	fileBytes += size;
+}
+
+void ImageWriter::putChunk(const char type[4], const unsigned char* prefix, size_t prefixSize,
+						   const unsigned char* data, size_t size, const unsigned char* suffix, size_t suffixSize) {
+	unsigned char header[8];
+	storeBigEndian(header, (uint32_t)(prefixSize + size + suffixSize));
+	memcpy(header + 4, type, 4);
+
+	// crc32() restarts on a null buffer, so empty pieces must be skipped.
+	uLong crc = crc32(0, header + 4, 4);
+	if (prefixSize) {
+		crc = crc32(crc, prefix, (uInt)prefixSize);
+	}
+	for (size_t offset = 0; offset < size; offset += 1u << 30) {
+		const size_t piece = size - offset < (1u << 30) ? size - offset : (1u << 30);
+		crc = crc32(crc, data + offset, (uInt)piece);
+	}
+	if (suffixSize) {
+		crc = crc32(crc, suffix, (uInt)suffixSize);
+	}
+
+	unsigned char trailer[4];
+	storeBigEndian(trailer, (uint32_t)crc);
+
+	put(header, sizeof(header));
+	put(prefix, prefixSize);
+	put(data, size);
+	put(suffix, suffixSize);
+	put(trailer, sizeof(trailer));
+}
+
+void ImageWriter::encodeBand(Band& band) const {
+	StageTimer timer(METRIC_ENCODE);
+	if (options.format != IMAGE_PNG) {
+		band.output.resize(band.rows * rowBytes);
+		convertRows(band.source, band.stride, band.output.data(), rowBytes, width, band.rows, band.bottomUp, layout);
+		return;
+	}
+
+	/*
+	 * Filtered scanlines: a filter type byte followed by the row. Level 0 and
+	 * 1 favour speed and store rows unfiltered, higher levels use the Sub
+	 * filter, which needs no neighbouring row and thus no band overlap.
+	 */
+	const size_t channels = pixelLayoutSize(layout);
+	const size_t scanline = rowBytes + 1;
+	const bool sub = options.pngLevel > 1;
+	std::vector<unsigned char> scanlines(band.rows * scanline);
+	convertRows(band.source, band.stride, scanlines.data() + 1, scanline, width, band.rows, band.bottomUp, layout);
+	for (size_t y = 0; y < band.rows; y++) {
+		unsigned char* row = scanlines.data() + y * scanline;
+		row[0] = sub ? 1 : 0;
+		if (sub) {
+			for (size_t i = rowBytes; i > channels; i--) {
+				row[i] = (unsigned char)(row[i] - row[i - channels]);
+			}
+		}
+	}
+	band.scanlineBytes = scanlines.size();
+	band.adler = adler32(adler32(0, Z_NULL, 0), scanlines.data(), (uInt)scanlines.size());
+
+	/*
+	 * Raw deflate, terminated by a sync flush so the next band's stream can
+	 * be appended byte-aligned; only the last band finishes the stream.
+	 */
+	z_stream stream = z_stream();
+	if (deflateInit2(&stream, options.pngLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw runtime_error("deflateInit2 failed");
+	}
+	band.output.resize(deflateBound(&stream, scanlines.size()) + 64);
+	stream.next_in = scanlines.data();
+	stream.avail_in = (uInt)scanlines.size();
+	stream.next_out = band.output.data();
+	stream.avail_out = (uInt)band.output.size();
+
+	const int flush = band.last ? Z_FINISH : Z_SYNC_FLUSH;
+	int result;
+	while ((result = deflate(&stream, flush)) == Z_OK && (stream.avail_out == 0 || stream.avail_in > 0)) {
+		const size_t used = band.output.size() - stream.avail_out;
+		band.output.resize(band.output.size() * 2);
+		stream.next_out = band.output.data() + used;
+		stream.avail_out = (uInt)(band.output.size() - used);
+	}
+	band.output.resize(band.output.size() - stream.avail_out);
+	deflateEnd(&stream);
+
+	if (result != (band.last ? Z_STREAM_END : Z_OK) && result != Z_BUF_ERROR) {
+		throw runtime_error("deflate failed");
+	}
+}
+
+void ImageWriter::emitBand(const Band& band) {
+	if (options.format != IMAGE_PNG) {
+		put(band.output.data(), band.output.size());
+		return;
+	}
+
+	unsigned char header[2];
+	unsigned char trailer[4];
+	size_t headerSize = 0, trailerSize = 0;
+
+	if (written == 0) {
+		// zlib header: 32K window deflate, FLEVEL hint, FCHECK making it a multiple of 31.
+		const int flevel = options.pngLevel <= 1 ? 0 : options.pngLevel <= 5 ? 1 : options.pngLevel == 6 ? 2 : 3;
+		header[0] = 0x78;
+		header[1] = (unsigned char)(flevel << 6);
+		header[1] += (unsigned char)(31 - (header[0] * 256 + header[1]) % 31);
+		headerSize = 2;
+	}
+	adler = adler32_combine(adler, band.adler, (z_off_t)band.scanlineBytes);
+	if (band.last) {
+		storeBigEndian(trailer, (uint32_t)adler);
+		trailerSize = 4;
+	}
+
+	putChunk("IDAT", header, headerSize, band.output.data(), band.output.size(), trailer, trailerSize);
+}
+
+void ImageWriter::writeRows(const unsigned char* rgba, size_t stride, size_t rows, bool bottomUp) {
+	if (!file) {
+		throw runtime_error("ImageWriter: " + path + " is already finished");
+	}
+	if (written + rows > height) {
+		throw runtime_error("ImageWriter: too many rows for " + path);
+	}
+
+	/*
+	 * Keep at most two bands per thread in flight, so memory stays bounded by
+	 * the band size however large the image is.
+	 */
+	const size_t inFlight = workers->size() * 2;
+	std::deque<std::pair<std::shared_ptr<Band>, std::future<void>>> pending;
+	const size_t first = written;
+
+	try {
+		for (size_t done = 0; done < rows || !pending.empty();) {
+			while (done < rows && pending.size() < inFlight) {
+				std::shared_ptr<Band> band = std::make_shared<Band>();
+				band->rows = rows - done < options.bandRows ? rows - done : options.bandRows;
+				band->stride = stride;
+				band->bottomUp = bottomUp;
+				// Output rows [done, done + band rows) of this call, located in memory order.
+				band->source = bottomUp ? rgba + (rows - done - band->rows) * stride : rgba + done * stride;
+				band->last = first + done + band->rows == height;
+				band->adler = 0;
+				band->scanlineBytes = 0;
+				Band* raw = band.get();
+				pending.push_back(std::make_pair(band, workers->submit([this, raw] { encodeBand(*raw); })));
+				done += band->rows;
+			}
+
+			pending.front().second.get();
+			emitBand(*pending.front().first);
+			written += pending.front().first->rows;
+			pending.pop_front();
+		}
+	} catch (...) {
+		// The tasks still point at the bands, let them finish before unwinding.
+		for (size_t i = 0; i < pending.size(); i++) {
+			pending[i].second.wait();
+		}
+		throw;
+	}
+}
+
+void ImageWriter::finish() {
+	if (!file) {
+		return;
+	}
+	if (written != height) {
+		throw runtime_error("ImageWriter: " + path + " is missing rows");
+	}
+	if (options.format == IMAGE_PNG) {
+		putChunk("IEND", nullptr, 0, nullptr, 0, nullptr, 0);
+	}
+	int result;
+	{
+		StageTimer timer(METRIC_WRITE);
+		result = fclose(file);
+	}
+	file = nullptr;
+	if (result != 0) {
+		throw runtime_error("Could not write " + path);
+	}
+}
+
+void writeImage(const std::string& path, const void* rgba, size_t width, size_t height,
+				const ImageWriterOptions& options) {
+	ImageWriter writer(path, width, height, options);
+	writer.writeRows((const unsigned char*)rgba, width * 4, height, true);
+	writer.finish();
+}
@@ -0,0 +1,135 @@
+/*
+ * Streaming image writer for PPM, raw and PNG output.
+ *
+ * Rows are converted from the RGBA8 readback layout and encoded in bands of
+ * a few dozen rows on worker threads; every band only needs a band-sized
+ * scratch buffer, so a frame is never copied into a second full-size image.
+ * PNG bands are deflated independently and joined with sync flushes, the
+ * same way pigz parallelizes gzip.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_IMAGE_WRITER_H
+#define EGL_OFFSCREEN_IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pixel_convert.h"
+
+enum ImageFormat {
+	IMAGE_PPM,	/* binary P6, always RGB */
+	IMAGE_RAW,	/* headerless rows in ImageWriterOptions::layout */
+	IMAGE_PNG	/* 8-bit RGB, or RGBA if layout is PIXELS_RGBA */
+};
+
+/*
+ * Fixed set of threads running encoder tasks in submission order. A writer
+ * creates its own unless ImageWriterOptions::encoders shares one, which
+ * keeps the threads alive across images.
+ */
+class ImageEncoderPool {
+public:
+	/*
+	 * count of 0 starts one thread per core.
+	 */
+	explicit ImageEncoderPool(size_t count = 0);
+	~ImageEncoderPool();
+
+	ImageEncoderPool(const ImageEncoderPool&) = delete;
+	ImageEncoderPool& operator=(const ImageEncoderPool&) = delete;
+
+	std::future<void> submit(const std::function<void()>& work);
+	size_t size() const { return threads.size(); }
+
+private:
+	void run();
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable available;
+	std::deque<std::function<void()>> tasks;
+	bool stopping;
+};
+
+struct ImageWriterOptions {
+	ImageFormat format = IMAGE_PNG;
+	PixelLayout layout = PIXELS_RGB;
+	int pngLevel = 1;		/* zlib level, 0 (stored) to 9 */
+	size_t threads = 0;		/* encoder threads, 0 for one per core */
+	ImageEncoderPool* encoders = nullptr;	/* shared encoder threads instead of threads, nullptr for none */
+	size_t bandRows = 64;	/* rows encoded per task */
+};
+
+/*
+ * Format implied by the file extension: .ppm, .raw/.rgb/.bgr/.rgba or .png.
+ */
+ImageFormat imageFormatFromPath(const std::string& path);
+
+class ImageWriter {
+public:
+	/*
+	 * Create path and write the header for a width x height image.
+	 */
+	ImageWriter(const std::string& path, size_t width, size_t height, const ImageWriterOptions& options);
+	~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	/*
+	 * Append rows RGBA8 rows, top row first in the output. With bottomUp the
+	 * rows are taken from the end of rgba, as glReadPixels returns them.
+	 * Returns once the rows are encoded; rgba may be reused afterwards.
+	 */
+	void writeRows(const unsigned char* rgba, size_t stride, size_t rows, bool bottomUp);
+
+	/*
+	 * Write the trailer and close the file. Throws if not all rows were written.
+	 */
+	void finish();
+
+	size_t rowsWritten() const { return written; }
+	uint64_t bytesWritten() const { return fileBytes; }
+
+private:
+	struct Band;
+
+	void encodeBand(Band& band) const;
+	void emitBand(const Band& band);
+	void put(const void* data, size_t size);
+	void putChunk(const char type[4], const unsigned char* prefix, size_t prefixSize, const unsigned char* data,
+				  size_t size, const unsigned char* suffix, size_t suffixSize);
+
+	std::string path;
+	FILE* file;
+	size_t width, height;
+	ImageWriterOptions options;
+	PixelLayout layout;
+	size_t rowBytes;
+	size_t written;
+	uint64_t fileBytes;
+	unsigned long adler;	/* running adler32 of the PNG scanlines */
+	ImageEncoderPool* workers;	/* options.encoders or ownedWorkers */
+	std::unique_ptr<ImageEncoderPool> ownedWorkers;
+};
+
+/*
+ * Write a whole bottom-up RGBA8 frame as returned by glReadPixels.
+ */
+void writeImage(const std::string& path, const void* rgba, size_t width, size_t height,
+				const ImageWriterOptions& options);
+
+#endif
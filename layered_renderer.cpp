@@ -0,0 +1,218 @@
+/*
+ * Batched rendering into the layers of one target.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "layered_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#include "gl_debug.h"
+#include "metrics.h"
+#include "readback_format.h"
+#include "render_target_pool.h"
+
+using namespace std;
+
+
+namespace {
+
+/*
+ * The clear color of frame f in the single-target render loop, so both
+ * paths produce the same frames.
+ */
+const char* frameColorSource = R"(
+uniform int firstFrame;
+uniform int frameCount;
+
+vec4 frameColor(int frame) {
+	float phase = frameCount > 1 ? float(frame) / float(frameCount - 1) : 0.0;
+	return vec4(0.9, 0.8 - 0.3 * phase, 0.5 + 0.4 * phase, 1.0);
+}
+
+// A triangle covering the viewport, from the vertex index alone.
+vec4 coveringVertex(int index) {
+	vec2 corner = vec2((index << 1) & 2, index & 2);
+	return vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* geometryVertexShader = R"(
+flat out int instance;
+
+void main() {
+	gl_Position = coveringVertex(gl_VertexID);
+	instance = gl_InstanceID;
+}
+)";
+
+/*
+ * Route every instance of the triangle to the layer of its frame.
+ */
+const char* geometryShader = R"(
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+flat in int instance[];
+flat out vec4 color;
+
+void main() {
+	vec4 c = frameColor(firstFrame + instance[0]);
+	for (int i = 0; i < 3; i++) {
+		gl_Layer = instance[0];
+		color = c;
+		gl_Position = gl_in[i].gl_Position;
+		EmitVertex();
+	}
+	EndPrimitive();
+}
+)";
+
+const char* multiviewVertexShader = R"(
+flat out vec4 color;
+
+void main() {
+	gl_Position = coveringVertex(gl_VertexID);
+	color = frameColor(firstFrame + int(gl_ViewID_OVR));
+}
+)";
+
+const char* fragmentShader = R"(#version 150
+flat in vec4 color;
+out vec4 fragColor;
+
+void main() {
+	fragColor = color;
+}
+)";
+
+}
+
+
+const char* layeredModeName(LayeredMode mode) {
+	return mode == LAYERED_MULTIVIEW ? "multiview" : "geometry";
+}
+
+LayeredMode chooseLayeredMode() {
+	if (maxRenderTargetLayers(true) > 1) {
+		return LAYERED_MULTIVIEW;
+	}
+	if (maxRenderTargetLayers(false) > 1) {
+		return LAYERED_GEOMETRY;
+	}
+	throw runtime_error("Layered rendering needs GL_OVR_multiview or layered framebuffers");
+}
+
+std::vector<ShaderSource> layeredShaderSources(LayeredMode mode, size_t views) {
+	const ShaderSource fragment = {GL_FRAGMENT_SHADER, fragmentShader};
+	if (mode == LAYERED_MULTIVIEW) {
+		const ShaderSource vertex = {GL_VERTEX_SHADER,
+			"#version 330\n"
+			"#extension GL_OVR_multiview : require\n"
+			"layout(num_views = " + to_string(views) + ") in;\n" +
+			frameColorSource + multiviewVertexShader};
+		return std::vector<ShaderSource>{vertex, fragment};
+	}
+	const ShaderSource vertex = {GL_VERTEX_SHADER, std::string("#version 150\n") + frameColorSource +
+												   geometryVertexShader};
+	const ShaderSource geometry = {GL_GEOMETRY_SHADER, std::string("#version 150\n") + frameColorSource +
+													   geometryShader};
+	return std::vector<ShaderSource>{vertex, geometry, fragment};
+}
+
+LayeredRenderStatistics RenderLayered(RenderTargetPool& targets, GLuint program, LayeredMode mode,
+									  const LayeredRenderOptions& options, const PboReadback::Consumer& consume) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (options.width <= 0 || options.height <= 0 || options.frames == 0 || options.views == 0) {
+		throw runtime_error("RenderLayered: nothing to render");
+	}
+
+	const ReadbackFormat format = readbackFormat(options.internalFormat);
+	const size_t frameBytes = (size_t)options.width * options.height * pixelSize(format.format, format.type);
+	const size_t views = options.views;
+	const RenderTargetKey key = {options.width, options.height, options.internalFormat, 0, (GLsizei)views,
+								 mode == LAYERED_MULTIVIEW, false};
+	RenderTarget* target = targets.acquire(key);
+
+	LayeredRenderStatistics stats = LayeredRenderStatistics();
+	stats.batches = (options.frames + views - 1) / views;
+
+	// Attribute-less draws still need a vertex array object bound.
+	GLuint vertexArray = 0;
+	glGenVertexArrays(1, &vertexArray);
+
+	try {
+		PboReadback readback(frameBytes * views, options.readbackDepth);
+
+		// A finished batch holds its frames layer after layer; the last batch may be partly unused.
+		PboReadback::Consumer split = [&](uint64_t batch, const void* pixels, size_t) {
+			for (size_t view = 0; view < views; view++) {
+				const uint64_t frame = batch * views + view;
+				if (frame >= options.frames) {
+					break;
+				}
+				consume(frame, (const unsigned char*)pixels + view * frameBytes, frameBytes);
+			}
+		};
+		const GLuint texture = target->texture;
+		const PboReadback::Producer readLayers = [texture, format](GLuint buffer) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, format.format, format.type, nullptr);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		};
+
+		glViewport(0, 0, options.width, options.height);
+		glUseProgram(program);
+		glBindVertexArray(vertexArray);
+		const GLint firstFrame = glGetUniformLocation(program, "firstFrame");
+		glUniform1i(glGetUniformLocation(program, "frameCount"), (GLint)options.frames);
+		assertOpenGLError("RenderLayered setup");
+
+		for (size_t batch = 0; batch < stats.batches; batch++) {
+			GlDebugGroup group("render batch");
+			{
+				StageTimer timer(METRIC_RENDER);
+				glUniform1i(firstFrame, (GLint)(batch * views));
+				if (mode == LAYERED_MULTIVIEW) {
+					glDrawArrays(GL_TRIANGLES, 0, 3);
+				} else {
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 3, (GLsizei)views);
+				}
+			}
+			countMetric(METRIC_FRAMES, std::min(views, options.frames - batch * views));
+
+			while (readback.tryRetrieve(split)) {
+			}
+			if (readback.full()) {
+				readback.retrieve(split);
+			}
+			readback.queue(batch, readLayers);
+		}
+		while (!readback.empty()) {
+			readback.retrieve(split);
+		}
+		stats.stalled = readback.statistics().stalled;
+
+		glBindVertexArray(0);
+		glUseProgram(0);
+		assertOpenGLError("RenderLayered");
+	} catch (...) {
+		glBindVertexArray(0);
+		glUseProgram(0);
+		glDeleteVertexArrays(1, &vertexArray);
+		targets.release(target);
+		throw;
+	}
+	glDeleteVertexArrays(1, &vertexArray);
+	targets.release(target);
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,72 @@
+/*
+ * Batched rendering of many small frames as the layers of one target.
+ *
+ * Every frame of a batch is a view: a layer of a GL_TEXTURE_2D_ARRAY
+ * framebuffer. One instanced draw call fills all layers, either through
+ * GL_OVR_multiview, where gl_ViewID_OVR picks the view, or through a
+ * geometry shader routing each instance to its layer with gl_Layer. The whole
+ * array is then read back with a single glGetTexImage into the PBO ring. So
+ * a batch of K frames costs one framebuffer bind, one draw and one transfer
+ * instead of K of each, which dominates for thumbnail-sized frames.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_LAYERED_RENDERER_H
+#define EGL_OFFSCREEN_LAYERED_RENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gl_common.h"
+#include "pbo_readback.h"
+#include "shader_cache.h"
+
+class RenderTargetPool;
+
+enum LayeredMode {
+	LAYERED_GEOMETRY,	/* geometry shader writing gl_Layer */
+	LAYERED_MULTIVIEW	/* GL_OVR_multiview */
+};
+
+const char* layeredModeName(LayeredMode mode);
+
+/*
+ * Multiview if GL_OVR_multiview offers views, otherwise layered geometry if
+ * the context can attach layered framebuffers at all. Throws if neither
+ * works.
+ */
+LayeredMode chooseLayeredMode();
+
+/*
+ * GLSL sources of the program filling views layers per draw. Multiview
+ * programs are compiled for a fixed number of views.
+ */
+std::vector<ShaderSource> layeredShaderSources(LayeredMode mode, size_t views);
+
+struct LayeredRenderOptions {
+	GLsizei width, height;		/* size of one frame */
+	GLenum internalFormat = GL_RGBA8;
+	size_t frames = 1;
+	size_t views = 1;			/* layers per batch, at most maxRenderTargetLayers() */
+	size_t readbackDepth = 3;	/* batches in the PBO ring */
+};
+
+struct LayeredRenderStatistics {
+	size_t batches;
+	uint64_t stalled;	/* batch readbacks that had to wait on their fence */
+	double seconds;
+};
+
+/*
+ * Render options.frames frames in batches of options.views layers with
+ * program on the current context, and hand every frame to consume, in order,
+ * bottom-up in the readbackFormat() pair of options.internalFormat. Frame f
+ * shows the same colors as frame f of the single-target render loop.
+ */
+LayeredRenderStatistics RenderLayered(RenderTargetPool& targets, GLuint program, LayeredMode mode,
+									  const LayeredRenderOptions& options, const PboReadback::Consumer& consume);
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * Stage latency histograms and counters.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "metrics.h"
+
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+
+namespace {
+
+/*
+ * Upper bounds of the histogram buckets in seconds, 10 us to 10 s; one more
+ * bucket takes everything above.
+ */
+const double bucketBounds[] = {1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2,
+							   2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+const size_t bucketCount = sizeof(bucketBounds) / sizeof(bucketBounds[0]);
+
+const char* stageNames[METRIC_STAGE_COUNT] = {"context_setup", "render", "readback", "encode", "write"};
+
+const struct {
+	const char* name;
+	const char* help;
+} counterNames[METRIC_COUNTER_COUNT] = {
+	{"egl_offscreen_frames_total", "Frames and jobs rendered."},
+	{"egl_offscreen_readback_bytes_total", "Bytes read back from the GPU."},
+	{"egl_offscreen_gl_errors_total", "OpenGL errors caught by assertOpenGLError."},
+	{"egl_offscreen_egl_errors_total", "EGL errors caught by assertEGLError."},
+};
+
+struct Histogram {
+	std::atomic<uint64_t> buckets[bucketCount + 1];
+	std::atomic<uint64_t> sumNanoseconds;
+};
+
+/*
+ * Everything one thread records. Only the owning thread writes, anyone may
+ * read.
+ */
+struct ThreadMetrics {
+	Histogram stages[METRIC_STAGE_COUNT];
+	std::atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+};
+
+struct Registry {
+	std::mutex mutex;
+	std::vector<ThreadMetrics*> blocks;		/* every block ever handed out */
+	std::vector<ThreadMetrics*> unused;		/* blocks of exited threads */
+};
+
+// Never destroyed: threads may still record while the process exits.
+Registry& registry() {
+	static Registry* instance = new Registry();
+	return *instance;
+}
+
+/*
+ * The calling thread's block, taken on first use and returned when the
+ * thread exits.
+ */
+struct LocalMetrics {
+	ThreadMetrics* block = nullptr;
+
+	~LocalMetrics() {
+		if (block) {
+			std::lock_guard<std::mutex> lock(registry().mutex);
+			registry().unused.push_back(block);
+		}
+	}
+};
+
+thread_local LocalMetrics localMetrics;
+
+std::atomic<bool> enabled(false);
+
+ThreadMetrics& localBlock() {
+	if (!localMetrics.block) {
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		if (!all.unused.empty()) {
+			localMetrics.block = all.unused.back();
+			all.unused.pop_back();
+		} else {
+			// Value-initialized, so the atomics start at zero.
+			localMetrics.block = new ThreadMetrics();
+			all.blocks.push_back(localMetrics.block);
+		}
+	}
+	return *localMetrics.block;
+}
+
+/*
+ * Increment for a value only the calling thread writes: a plain load and
+ * store, no locked instruction.
+ */
+inline void add(std::atomic<uint64_t>& value, uint64_t amount) {
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+std::string formatNumber(double value) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	return text;
+}
+
+}
+
+
+void enableMetrics(bool enable) {
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool metricsEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void recordStage(MetricStage stage, double seconds) {
+	if (!metricsEnabled()) {
+		return;
+	}
+	size_t bucket = 0;
+	while (bucket < bucketCount && seconds > bucketBounds[bucket]) {
+		bucket++;
+	}
+	Histogram& histogram = localBlock().stages[stage];
+	add(histogram.buckets[bucket], 1);
+	add(histogram.sumNanoseconds, seconds > 0 ? (uint64_t)(seconds * 1e9) : 0);
+}
+
+void countMetric(MetricCounter counter, uint64_t amount) {
+	if (!metricsEnabled()) {
+		return;
+	}
+	add(localBlock().counters[counter], amount);
+}
+
+StageTimer::StageTimer(MetricStage stage) : stage(stage), active(metricsEnabled()) {
+	if (active) {
+		start = std::chrono::steady_clock::now();
+	}
+}
+
+StageTimer::~StageTimer() {
+	if (active) {
+		recordStage(stage, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+}
+
+std::string formatPrometheusMetrics() {
+	uint64_t buckets[METRIC_STAGE_COUNT][bucketCount + 1] = {};
+	uint64_t sums[METRIC_STAGE_COUNT] = {};
+	uint64_t counters[METRIC_COUNTER_COUNT] = {};
+	{
+		Registry& all = registry();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		for (const ThreadMetrics* block : all.blocks) {
+			for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++) {
+				for (size_t i = 0; i <= bucketCount; i++) {
+					buckets[stage][i] += block->stages[stage].buckets[i].load(std::memory_order_relaxed);
+				}
+				sums[stage] += block->stages[stage].sumNanoseconds.load(std::memory_order_relaxed);
+			}
+			for (int counter = 0; counter < METRIC_COUNTER_COUNT; counter++) {
+				counters[counter] += block->counters[counter].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::string text;
+	text += "# HELP egl_offscreen_stage_seconds Time spent in each stage of a frame.\n";
+	text += "# TYPE egl_offscreen_stage_seconds histogram\n";
+	for (int stage = 0; stage < METRIC_STAGE_COUNT; stage++) {
+		const std::string label = std::string("stage=\"") + stageNames[stage] + "\"";
+		uint64_t cumulative = 0;
+		for (size_t i = 0; i <= bucketCount; i++) {
+			cumulative += buckets[stage][i];
+			const std::string le = i < bucketCount ? formatNumber(bucketBounds[i]) : "+Inf";
+			text += "egl_offscreen_stage_seconds_bucket{" + label + ",le=\"" + le + "\"} " + to_string(cumulative) +
+					"\n";
+		}
+		text += "egl_offscreen_stage_seconds_sum{" + label + "} " + formatNumber(sums[stage] / 1e9) + "\n";
+		text += "egl_offscreen_stage_seconds_count{" + label + "} " + to_string(cumulative) + "\n";
+	}
+	for (int counter = 0; counter < METRIC_COUNTER_COUNT; counter++) {
+		const std::string name = counterNames[counter].name;
+		text += "# HELP " + name + " " + counterNames[counter].help + "\n";
+		text += "# TYPE " + name + " counter\n";
+		text += name + " " + to_string(counters[counter]) + "\n";
+	}
+	return text;
+}
+
+void writeMetricsFile(const std::string& path) {
+	const std::string text = formatPrometheusMetrics();
+	const std::string temporary = path + ".tmp";
+
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		throw runtime_error("Cannot create " + temporary);
+	}
+	bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+	written = fclose(file) == 0 && written;
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		throw runtime_error("Cannot write " + path);
+	}
+}
+
+MetricsExporter::MetricsExporter(const std::string& path, std::chrono::milliseconds interval)
+	: path(path), interval(interval), stopping(false) {
+	enableMetrics(true);
+	writeMetricsFile(path);
+	thread = std::thread(&MetricsExporter::run, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	thread.join();
+
+	try {
+		writeMetricsFile(path);
+	} catch (const std::exception& ex) {
+		std::cerr << "Metrics: " << ex.what() << std::endl;
+	}
+}
+
+void MetricsExporter::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!changed.wait_for(lock, interval, [this] { return stopping; })) {
+		lock.unlock();
+		// A failed rewrite leaves the previous file in place; try again next interval.
+		try {
+			writeMetricsFile(path);
+		} catch (const std::exception& ex) {
+			std::cerr << "Metrics: " << ex.what() << std::endl;
+		}
+		lock.lock();
+	}
+}
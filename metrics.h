@@ -0,0 +1,107 @@
+/*
+ * Stage latency histograms and counters, exported in the Prometheus text
+ * format.
+ *
+ * Every thread records into a block of its own: a histogram per stage and
+ * the counters, written with relaxed atomic stores by that thread only, so
+ * recording takes no lock and no read-modify-write instruction. The exporter
+ * sums the blocks of all threads. Blocks outlive their threads and are handed
+ * to the next new thread, so the totals stay monotonic as Prometheus expects.
+ *
+ * Recording is off until enableMetrics(); until then StageTimer does not even
+ * read the clock.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_METRICS_H
+#define EGL_OFFSCREEN_METRICS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum MetricStage {
+	METRIC_CONTEXT_SETUP,	/* EGL display and context creation, per thread */
+	METRIC_RENDER,			/* issuing the draw commands of a frame */
+	METRIC_READBACK,		/* glReadPixels, fence wait and buffer mapping */
+	METRIC_ENCODE,			/* converting and compressing a band of rows */
+	METRIC_WRITE,			/* writing encoded bytes to the output file */
+	METRIC_STAGE_COUNT
+};
+
+enum MetricCounter {
+	METRIC_FRAMES,			/* frames and jobs rendered */
+	METRIC_READBACK_BYTES,	/* bytes read back from the GPU */
+	METRIC_GL_ERRORS,		/* errors raised by assertOpenGLError() */
+	METRIC_EGL_ERRORS,		/* errors raised by assertEGLError() */
+	METRIC_COUNTER_COUNT
+};
+
+void enableMetrics(bool enabled);
+bool metricsEnabled();
+
+void recordStage(MetricStage stage, double seconds);
+void countMetric(MetricCounter counter, uint64_t amount = 1);
+
+/*
+ * Records the time from construction to destruction under stage.
+ */
+class StageTimer {
+public:
+	explicit StageTimer(MetricStage stage);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	MetricStage stage;
+	bool active;
+	std::chrono::steady_clock::time_point start;
+};
+
+/*
+ * All histograms and counters summed over the threads, in the Prometheus
+ * text exposition format.
+ */
+std::string formatPrometheusMetrics();
+
+/*
+ * Replace path with the current metrics: written to a temporary file next to
+ * it and renamed over it, so a scraper never sees a partial file. Throws if
+ * the file cannot be written.
+ */
+void writeMetricsFile(const std::string& path);
+
+/*
+ * Rewrites a metrics file every interval on a background thread, and once
+ * more on destruction. Enables recording.
+ */
+class MetricsExporter {
+public:
+	/*
+	 * Throws if the first write fails, so a bad path is reported up front.
+	 */
+	MetricsExporter(const std::string& path, std::chrono::milliseconds interval);
+	~MetricsExporter();
+
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+private:
+	void run();
+
+	std::string path;
+	std::chrono::milliseconds interval;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool stopping;
+};
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Asynchronous PBO readback ring.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "pbo_readback.h"
+
+#include "gl_debug.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+
+using namespace std;
+
+
+size_t pixelSize(GLenum format, GLenum type) {
+	size_t components;
+	switch (format) {
+		case GL_RED:
+		case GL_GREEN:
+		case GL_BLUE:
+		case GL_ALPHA:
+		case GL_LUMINANCE:
+		case GL_RED_INTEGER:
+			components = 1;
+			break;
+		case GL_RG:
+		case GL_LUMINANCE_ALPHA:
+		case GL_RG_INTEGER:
+			components = 2;
+			break;
+		case GL_RGB:
+		case GL_BGR:
+		case GL_RGB_INTEGER:
+			components = 3;
+			break;
+		case GL_RGBA:
+		case GL_BGRA:
+		case GL_RGBA_INTEGER:
+			components = 4;
+			break;
+		default: {
+			stringstream s;
+			s << "Unsupported pixel format 0x" << std::hex << format;
+			throw runtime_error(s.str());
+		}
+	}
+
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			return components;
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			return components * 2;
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			return components * 4;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			return 2;
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+			return 4;
+		default: {
+			stringstream s;
+			s << "Unsupported pixel type 0x" << std::hex << type;
+			throw runtime_error(s.str());
+		}
+	}
+}
+
+
+static unsigned char floatToByte(float value) {
+	// Written so that NaN maps to 0.
+	return !(value > 0.0f) ? 0 : value >= 1.0f ? 255 : (unsigned char)(value * 255.0f + 0.5f);
+}
+
+static float halfToFloat(uint16_t half) {
+	const int exponent = (half >> 10) & 0x1f;
+	const int mantissa = half & 0x3ff;
+	float value;
+	if (exponent == 0) {
+		value = std::ldexp((float)mantissa, -24);
+	} else if (exponent == 31) {
+		value = mantissa ? NAN : INFINITY;
+	} else {
+		value = std::ldexp((float)(mantissa | 0x400), exponent - 25);
+	}
+	return (half & 0x8000) ? -value : value;
+}
+
+/*
+ * Position of the red, green, blue and alpha components within a pixel of
+ * format, -1 if absent.
+ */
+static bool componentOrder(GLenum format, int order[4]) {
+	static const int red[4] = {0, -1, -1, -1}, rg[4] = {0, 1, -1, -1}, rgb[4] = {0, 1, 2, -1},
+					 bgr[4] = {2, 1, 0, -1}, rgba[4] = {0, 1, 2, 3}, bgra[4] = {2, 1, 0, 3};
+	const int* source;
+	switch (format) {
+	case GL_RED:
+		source = red;
+		break;
+	case GL_RG:
+		source = rg;
+		break;
+	case GL_RGB:
+		source = rgb;
+		break;
+	case GL_BGR:
+		source = bgr;
+		break;
+	case GL_RGBA:
+		source = rgba;
+		break;
+	case GL_BGRA:
+		source = bgra;
+		break;
+	default:
+		return false;
+	}
+	memcpy(order, source, sizeof(int) * 4);
+	return true;
+}
+
+/*
+ * floatToByte(halfToFloat(h)) for every half h, built on first use.
+ */
+static const unsigned char* halfToByteTable() {
+	static const std::vector<unsigned char> table = [] {
+		std::vector<unsigned char> bytes(65536);
+		for (size_t i = 0; i < bytes.size(); i++) {
+			bytes[i] = floatToByte(halfToFloat((uint16_t)i));
+		}
+		return bytes;
+	}();
+	return table.data();
+}
+
+/*
+ * Scatter the components of count pixels into RGBA8 one channel at a time,
+ * so the type and component order are resolved outside the pixel loops.
+ */
+template <typename T, typename Convert>
+static void expandComponents(const T* src, size_t components, const int order[4], size_t count,
+							 unsigned char* rgba, Convert convert) {
+	for (int c = 0; c < 4; c++) {
+		unsigned char* out = rgba + c;
+		if (order[c] < 0) {
+			const unsigned char fill = c == 3 ? 255 : 0;
+			for (size_t i = 0; i < count; i++) {
+				out[i * 4] = fill;
+			}
+			continue;
+		}
+		const T* in = src + order[c];
+		for (size_t i = 0; i < count; i++) {
+			out[i * 4] = convert(in[i * components]);
+		}
+	}
+}
+
+bool canExpandToRgba8(GLenum format, GLenum type) {
+	int order[4];
+	if (!componentOrder(format, order)) {
+		return false;
+	}
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
+	case GL_FLOAT:
+		return true;
+	case GL_UNSIGNED_SHORT_5_6_5:
+		return format == GL_RGB;
+	case GL_UNSIGNED_INT_8_8_8_8_REV:
+	case GL_UNSIGNED_INT_2_10_10_10_REV:
+		return format == GL_RGBA || format == GL_BGRA;
+	default:
+		return false;
+	}
+}
+
+void expandPixelsToRgba8(GLenum format, GLenum type, const void* src, size_t count, unsigned char* rgba) {
+	if (format == GL_RGBA && type == GL_UNSIGNED_BYTE) {
+		memcpy(rgba, src, count * 4);
+		return;
+	}
+	int order[4];
+	if (!canExpandToRgba8(format, type) || !componentOrder(format, order)) {
+		std::ostringstream s;
+		s << "expandPixelsToRgba8: unsupported format 0x" << std::hex << format << " type 0x" << type;
+		throw runtime_error(s.str());
+	}
+
+	if (type == GL_UNSIGNED_SHORT_5_6_5) {
+		const uint16_t* p = (const uint16_t*)src;
+		for (size_t i = 0; i < count; i++, rgba += 4) {
+			rgba[0] = (unsigned char)(((p[i] >> 11) & 0x1f) * 255 / 31);
+			rgba[1] = (unsigned char)(((p[i] >> 5) & 0x3f) * 255 / 63);
+			rgba[2] = (unsigned char)((p[i] & 0x1f) * 255 / 31);
+			rgba[3] = 255;
+		}
+		return;
+	}
+
+	// The packed _REV types hold the first component in the lowest bits.
+	if (type == GL_UNSIGNED_INT_8_8_8_8_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV) {
+		const bool wide = type == GL_UNSIGNED_INT_2_10_10_10_REV;
+		const uint32_t* p = (const uint32_t*)src;
+		for (size_t i = 0; i < count; i++, rgba += 4) {
+			uint32_t components[4];
+			if (wide) {
+				components[0] = (p[i] & 0x3ff) * 255 / 1023;
+				components[1] = ((p[i] >> 10) & 0x3ff) * 255 / 1023;
+				components[2] = ((p[i] >> 20) & 0x3ff) * 255 / 1023;
+				components[3] = (p[i] >> 30) * 255 / 3;
+			} else {
+				components[0] = p[i] & 0xff;
+				components[1] = (p[i] >> 8) & 0xff;
+				components[2] = (p[i] >> 16) & 0xff;
+				components[3] = p[i] >> 24;
+			}
+			for (int c = 0; c < 4; c++) {
+				rgba[c] = (unsigned char)components[order[c]];
+			}
+		}
+		return;
+	}
+
+	const size_t components = pixelSize(format, GL_UNSIGNED_BYTE);
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+		expandComponents((const unsigned char*)src, components, order, count, rgba,
+						 [](unsigned char value) { return value; });
+		break;
+	case GL_UNSIGNED_SHORT:
+		expandComponents((const uint16_t*)src, components, order, count, rgba,
+						 [](uint16_t value) { return (unsigned char)(value >> 8); });
+		break;
+	case GL_HALF_FLOAT: {
+		const unsigned char* bytes = halfToByteTable();
+		expandComponents((const uint16_t*)src, components, order, count, rgba,
+						 [bytes](uint16_t value) { return bytes[value]; });
+		break;
+	}
+	default:
+		expandComponents((const float*)src, components, order, count, rgba, floatToByte);
+		break;
+	}
+}
+
+PboReadback::PboReadback(GLsizei width, GLsizei height, GLenum format, GLenum type, size_t depth)
+	: width(width), height(height), format(format), type(type),
+	  size(pixelSize(format, type) * width * height), slots(depth), head(0), pendingCount(0), stats() {
+	allocate();
+}
+
+PboReadback::PboReadback(size_t frameSize, size_t depth)
+	: width(0), height(0), format(GL_NONE), type(GL_NONE), size(frameSize), slots(depth), head(0), pendingCount(0),
+	  stats() {
+	allocate();
+}
+
+void PboReadback::allocate() {
+	if (slots.empty()) {
+		throw runtime_error("PboReadback: ring depth must be at least 1");
+	}
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot& slot = slots[i];
+		slot.fence = nullptr;
+		slot.frame = 0;
+		slot.queueSeconds = 0;
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	assertOpenGLError("PboReadback glBufferData");
+}
+
+PboReadback::~PboReadback() {
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].fence) {
+			glDeleteSync(slots[i].fence);
+		}
+		glDeleteBuffers(1, &slots[i].buffer);
+	}
+}
+
+PboReadback::Slot& PboReadback::startQueue(uint64_t frame) {
+	if (full()) {
+		throw runtime_error("PboReadback: ring is full");
+	}
+
+	Slot& slot = slots[(head + pendingCount) % slots.size()];
+	slot.frame = frame;
+	return slot;
+}
+
+void PboReadback::finishQueue(Slot& slot) {
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	/*
+	 * Make sure the fence reaches the GPU, otherwise isReady() could poll a
+	 * fence that was never submitted.
+	 */
+	glFlush();
+
+	pendingCount++;
+	stats.queued++;
+}
+
+void PboReadback::queue(uint64_t frame) {
+	if (width == 0) {
+		throw runtime_error("PboReadback: ring without a pixel format needs a producer");
+	}
+	Slot& slot = startQueue(frame);
+	GlDebugGroup group("readback queue");
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, format, type, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	assertOpenGLError("PboReadback glReadPixels");
+	slot.queueSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	finishQueue(slot);
+}
+
+void PboReadback::queue(uint64_t frame, const Producer& produce) {
+	Slot& slot = startQueue(frame);
+	GlDebugGroup group("readback produce");
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	produce(slot.buffer);
+	assertOpenGLError("PboReadback produce");
+	slot.queueSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	finishQueue(slot);
+}
+
+const PboReadback::Slot* PboReadback::findPending(uint64_t frame) const {
+	for (size_t i = 0; i < pendingCount; i++) {
+		const Slot& slot = slots[(head + i) % slots.size()];
+		if (slot.frame == frame) {
+			return &slot;
+		}
+	}
+	return nullptr;
+}
+
+bool PboReadback::isReady(uint64_t frame) const {
+	const Slot* slot = findPending(frame);
+	if (!slot) {
+		return false;
+	}
+
+	GLint status = GL_UNSIGNALED;
+	glGetSynciv(slot->fence, GL_SYNC_STATUS, 1, nullptr, &status);
+	return status == GL_SIGNALED;
+}
+
+bool PboReadback::tryRetrieve(const Consumer& consume) {
+	if (empty() || !isReady(slots[head].frame)) {
+		return false;
+	}
+	retrieve(consume);
+	return true;
+}
+
+uint64_t PboReadback::retrieve(const Consumer& consume) {
+	if (empty()) {
+		throw runtime_error("PboReadback: no frame pending");
+	}
+
+	Slot& slot = slots[head];
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	GLenum result = glClientWaitSync(slot.fence, 0, 0);
+	if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+		stats.completedWithoutWait++;
+	} else {
+		stats.stalled++;
+		do {
+			result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	if (result == GL_WAIT_FAILED) {
+		assertOpenGLError("PboReadback glClientWaitSync");
+		throw runtime_error("PboReadback: glClientWaitSync failed");
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	GlDebugGroup group("readback map");
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	assertOpenGLError("PboReadback glMapBufferRange");
+	// One sample per frame, as on the synchronous paths: queueing the read plus waiting for and mapping it.
+	recordStage(METRIC_READBACK, slot.queueSeconds +
+									 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	countMetric(METRIC_READBACK_BYTES, size);
+
+	const uint64_t frame = slot.frame;
+	head = (head + 1) % slots.size();
+	pendingCount--;
+
+	try {
+		consume(frame, pixels, size);
+	} catch (...) {
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		throw;
+	}
+
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return frame;
+}
@@ -0,0 +1,125 @@
+/*
+ * Asynchronous readback of the bound read framebuffer through a ring of
+ * pixel buffer objects guarded by GL_ARB_sync fences.
+ *
+ * Each queued frame is copied into its own PBO by glReadPixels, which returns
+ * immediately; the pixels are only mapped once the fence of that slot has
+ * signalled, so the GPU can render frame N+1 while frame N is transferred.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_PBO_READBACK_H
+#define EGL_OFFSCREEN_PBO_READBACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gl_common.h"
+
+/*
+ * Number of bytes per pixel for a glReadPixels format/type pair.
+ */
+size_t pixelSize(GLenum format, GLenum type);
+
+/*
+ * True if expandPixelsToRgba8() handles format/type: GL_RED, GL_RG, GL_RGB,
+ * GL_BGR, GL_RGBA and GL_BGRA with unsigned bytes or shorts, half floats
+ * and floats, GL_RGB with GL_UNSIGNED_SHORT_5_6_5, and GL_RGBA or GL_BGRA
+ * with GL_UNSIGNED_INT_8_8_8_8_REV or GL_UNSIGNED_INT_2_10_10_10_REV.
+ */
+bool canExpandToRgba8(GLenum format, GLenum type);
+
+/*
+ * Expand count pixels read back as format/type to RGBA8, for the image
+ * writers. Missing components read as 0, missing alpha as 255, float values
+ * are clamped to 0-1. Throws unless canExpandToRgba8(format, type).
+ */
+void expandPixelsToRgba8(GLenum format, GLenum type, const void* src, size_t count, unsigned char* rgba);
+
+class PboReadback {
+public:
+	typedef std::function<void(uint64_t frame, const void* pixels, size_t size)> Consumer;
+
+	struct Statistics {
+		uint64_t queued;
+		uint64_t completedWithoutWait;	/* fence had already signalled when retrieved */
+		uint64_t stalled;				/* retrieve had to block on the fence */
+	};
+
+	/*
+	 * Filled by a GPU pass instead of glReadPixels: writes the frame into
+	 * buffer, e.g. as a shader storage buffer.
+	 */
+	typedef std::function<void(GLuint buffer)> Producer;
+
+	PboReadback(GLsizei width, GLsizei height, GLenum format, GLenum type, size_t depth);
+
+	/*
+	 * Ring of frameSize byte slots that are only filled by queue(frame, produce).
+	 */
+	PboReadback(size_t frameSize, size_t depth);
+	~PboReadback();
+
+	PboReadback(const PboReadback&) = delete;
+	PboReadback& operator=(const PboReadback&) = delete;
+
+	/*
+	 * Start reading the current GL_READ_FRAMEBUFFER into the next free slot.
+	 * Throws if the ring is full; retrieve() the oldest frame first.
+	 */
+	void queue(uint64_t frame);
+
+	/*
+	 * Let produce fill the next free slot, then fence it like queue().
+	 */
+	void queue(uint64_t frame, const Producer& produce);
+
+	/*
+	 * Non-blocking poll: true if the readback of frame has completed.
+	 */
+	bool isReady(uint64_t frame) const;
+
+	/*
+	 * Map the oldest pending frame and hand its pixels to consume, blocking
+	 * on its fence if necessary. Returns the frame number.
+	 */
+	uint64_t retrieve(const Consumer& consume);
+
+	/*
+	 * Retrieve the oldest pending frame only if it is ready.
+	 */
+	bool tryRetrieve(const Consumer& consume);
+
+	bool full() const { return pendingCount == slots.size(); }
+	bool empty() const { return pendingCount == 0; }
+	size_t depth() const { return slots.size(); }
+	size_t frameSize() const { return size; }
+	const Statistics& statistics() const { return stats; }
+
+private:
+	struct Slot {
+		GLuint buffer;
+		GLsync fence;
+		uint64_t frame;
+		double queueSeconds;	/* spent queueing the read, recorded with the map as one readback */
+	};
+
+	void allocate();
+	Slot& startQueue(uint64_t frame);
+	void finishQueue(Slot& slot);
+	const Slot* findPending(uint64_t frame) const;
+
+	GLsizei width, height;
+	GLenum format, type;
+	size_t size;
+	std::vector<Slot> slots;
+	size_t head;			/* oldest pending slot */
+	size_t pendingCount;
+	Statistics stats;
+};
+
+#endif
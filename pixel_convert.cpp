@@ -0,0 +1,91 @@
+/*
+ * RGBA8 row conversion kernels.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "pixel_convert.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_CONVERT_X86 1
+#endif
+
+namespace {
+
+void convertRowScalar(const unsigned char* src, unsigned char* dst, size_t width, PixelLayout layout) {
+	if (layout == PIXELS_RGB) {
+		for (size_t x = 0; x < width; x++, src += 4, dst += 3) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+		}
+	} else {
+		for (size_t x = 0; x < width; x++, src += 4, dst += 3) {
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+		}
+	}
+}
+
+#ifdef PIXEL_CONVERT_X86
+/*
+ * 16 pixels per iteration: each 4-pixel register is shuffled down to 12
+ * bytes, and the four 12-byte pieces are packed into three 16-byte stores.
+ */
+__attribute__((target("ssse3"))) void convertRowSsse3(const unsigned char* src, unsigned char* dst, size_t width,
+													  PixelLayout layout) {
+	const __m128i shuffle = layout == PIXELS_RGB
+								? _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+								: _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t x = 0;
+	for (; x + 16 <= width; x += 16, src += 64, dst += 48) {
+		const __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 0)), shuffle);
+		const __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 16)), shuffle);
+		const __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 32)), shuffle);
+		const __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 48)), shuffle);
+		_mm_storeu_si128((__m128i*)(dst + 0), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+		_mm_storeu_si128((__m128i*)(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+		_mm_storeu_si128((__m128i*)(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+	}
+	convertRowScalar(src, dst, width - x, layout);
+}
+
+bool hasSsse3() {
+	static const bool supported = __builtin_cpu_supports("ssse3");
+	return supported;
+}
+#endif
+
+}
+
+
+size_t pixelLayoutSize(PixelLayout layout) {
+	return layout == PIXELS_RGBA ? 4 : 3;
+}
+
+void convertRow(const unsigned char* src, unsigned char* dst, size_t width, PixelLayout layout) {
+	if (layout == PIXELS_RGBA) {
+		memcpy(dst, src, width * 4);
+		return;
+	}
+#ifdef PIXEL_CONVERT_X86
+	if (hasSsse3()) {
+		convertRowSsse3(src, dst, width, layout);
+		return;
+	}
+#endif
+	convertRowScalar(src, dst, width, layout);
+}
+
+void convertRows(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t width,
+				 size_t rows, bool bottomUp, PixelLayout layout) {
+	for (size_t y = 0; y < rows; y++) {
+		const unsigned char* row = src + (bottomUp ? rows - 1 - y : y) * srcStride;
+		convertRow(row, dst + y * dstStride, width, layout);
+	}
+}
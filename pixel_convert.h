@@ -0,0 +1,37 @@
+/*
+ * Row conversion kernels from the RGBA8 pixels OpenGL reads back into the
+ * layouts the image writers emit. SSSE3 kernels are selected at run time on
+ * x86, with a scalar fallback everywhere else.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_PIXEL_CONVERT_H
+#define EGL_OFFSCREEN_PIXEL_CONVERT_H
+
+#include <cstddef>
+
+enum PixelLayout {
+	PIXELS_RGBA,
+	PIXELS_RGB,
+	PIXELS_BGR
+};
+
+size_t pixelLayoutSize(PixelLayout layout);
+
+/*
+ * Convert width RGBA8 pixels from src into layout at dst. src and dst must
+ * not overlap.
+ */
+void convertRow(const unsigned char* src, unsigned char* dst, size_t width, PixelLayout layout);
+
+/*
+ * Convert rows of an image, flipping it vertically when bottomUp is set (the
+ * first output row is then the last row in src), as needed for the
+ * bottom-up rows of glReadPixels.
+ */
+void convertRows(const unsigned char* src, size_t srcStride, unsigned char* dst, size_t dstStride, size_t width,
+				 size_t rows, bool bottomUp, PixelLayout layout);
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ * Raw frame sequence sink on io_uring or pwritev.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "raw_frame_sink.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+using namespace std;
+
+
+static const char sequenceMagic[8] = {'G', 'L', 'R', 'A', 'W', 'S', 'E', 'Q'};
+static const size_t pageSize = 4096;	/* also satisfies the O_DIRECT block alignment */
+
+static_assert(sizeof(RawFrameHeader) <= pageSize, "raw frame header exceeds a page");
+
+static size_t roundToPage(size_t bytes) {
+	return (bytes + pageSize - 1) / pageSize * pageSize;
+}
+
+static uint64_t monotonicNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static std::string systemError(const std::string& what, int error = errno) {
+	return "RawFrameSink: " + what + ": " + strerror(error);
+}
+
+/*
+ * pwritev until all of iov is written, resuming after short writes.
+ */
+static bool pwriteAll(int fd, std::vector<struct iovec>& iov, off_t offset) {
+	size_t first = 0;
+	while (first < iov.size()) {
+		const ssize_t written =
+			pwritev(fd, &iov[first], (int)std::min<size_t>(iov.size() - first, IOV_MAX), offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		offset += written;
+		for (size_t left = written; left > 0 && first < iov.size();) {
+			const size_t step = std::min(left, iov[first].iov_len);
+			iov[first].iov_base = (char*)iov[first].iov_base + step;
+			iov[first].iov_len -= step;
+			left -= step;
+			if (iov[first].iov_len == 0) {
+				first++;
+			}
+		}
+	}
+	return true;
+}
+
+const char* rawFrameIoName(RawFrameIo io) {
+	switch (io) {
+	case RAW_IO_URING:
+		return "io_uring";
+	case RAW_IO_PWRITEV:
+		return "pwritev";
+	default:
+		return "auto";
+	}
+}
+
+RawFrameIo parseRawFrameIo(const std::string& name) {
+	if (name == "auto") {
+		return RAW_IO_AUTO;
+	} else if (name == "io_uring") {
+		return RAW_IO_URING;
+	} else if (name == "pwritev") {
+		return RAW_IO_PWRITEV;
+	}
+	throw runtime_error("Unknown raw frame I/O: " + name);
+}
+
+/*
+ * An io_uring set up with the raw system calls: the submission queue ring,
+ * its entries and the completion queue ring mapped from the kernel. Only
+ * the sink thread holding the mutex touches the rings, so the tails it
+ * produces and the heads it consumes need no more than release/acquire
+ * ordering against the kernel.
+ */
+struct RawFrameSink::Uring {
+	int fd = -1;
+	void* sqRing = MAP_FAILED;
+	void* cqRing = MAP_FAILED;
+	struct io_uring_sqe* sqes = (struct io_uring_sqe*)MAP_FAILED;
+	size_t sqRingBytes = 0, cqRingBytes = 0, sqesBytes = 0;
+	unsigned *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe* cqes;
+	size_t inFlight = 0;
+
+	explicit Uring(unsigned entries) {
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (fd < 0) {
+			throw runtime_error(systemError("io_uring_setup"));
+		}
+
+		sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		// Newer kernels share one mapping for both rings.
+		const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single) {
+			sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+		}
+		sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sqRing == MAP_FAILED) {
+			throw runtime_error(systemError("mmap io_uring submission queue"));
+		}
+		if (!single) {
+			cqRing = mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+						  IORING_OFF_CQ_RING);
+			if (cqRing == MAP_FAILED) {
+				throw runtime_error(systemError("mmap io_uring completion queue"));
+			}
+		}
+		sqesBytes = params.sq_entries * sizeof(struct io_uring_sqe);
+		sqes = (struct io_uring_sqe*)mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+										  IORING_OFF_SQES);
+		if (sqes == MAP_FAILED) {
+			throw runtime_error(systemError("mmap io_uring entries"));
+		}
+
+		char* sq = (char*)sqRing;
+		char* cq = single ? sq : (char*)cqRing;
+		sqTail = (unsigned*)(sq + params.sq_off.tail);
+		sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+		sqArray = (unsigned*)(sq + params.sq_off.array);
+		cqHead = (unsigned*)(cq + params.cq_off.head);
+		cqTail = (unsigned*)(cq + params.cq_off.tail);
+		cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+		cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	}
+
+	~Uring() {
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqesBytes);
+		}
+		if (cqRing != MAP_FAILED) {
+			munmap(cqRing, cqRingBytes);
+		}
+		if (sqRing != MAP_FAILED) {
+			munmap(sqRing, sqRingBytes);
+		}
+		if (fd >= 0) {
+			::close(fd);
+		}
+	}
+
+	int enter(unsigned submit, unsigned wait) {
+		const unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+		int result;
+		do {
+			result = (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+		} while (result < 0 && errno == EINTR);
+		return result;
+	}
+};
+
+RawFrameSink::RawFrameSink(const std::string& path, const RawFrameLayout& layout, uint64_t capacity,
+						   size_t queueDepth, RawFrameIo io)
+	: path(path), layout(layout), capacity(capacity), fd(-1), directIo(false), engine(io), stopping(false),
+	  closed(false), stats(), submitted(0), inFlightSum(0) {
+	if (capacity == 0 || queueDepth == 0 || layout.frameBytes == 0) {
+		throw runtime_error("RawFrameSink: needs frames, buffers and a frame size");
+	}
+	slotBytes = roundToPage(layout.frameBytes);
+	dataOffset = pageSize + roundToPage(capacity * sizeof(uint64_t));
+
+	// tmpfs and some network file systems refuse O_DIRECT; write through the page cache there.
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+	directIo = fd >= 0;
+	if (fd < 0 && errno == EINVAL) {
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+	if (fd < 0) {
+		throw runtime_error(systemError("open " + path));
+	}
+
+	try {
+		// Reserve the blocks up front so writes do not allocate, or fail half way for lack of space.
+		const off_t total = dataOffset + capacity * slotBytes;
+		if (fallocate(fd, 0, 0, total) != 0) {
+			if (errno != EOPNOTSUPP) {
+				throw runtime_error(systemError("fallocate " + path));
+			}
+			if (ftruncate(fd, total) != 0) {
+				throw runtime_error(systemError("ftruncate " + path));
+			}
+		}
+
+		if (io != RAW_IO_PWRITEV) {
+			try {
+				uring.reset(new Uring((unsigned)queueDepth));
+			} catch (const std::exception&) {
+				if (io == RAW_IO_URING) {
+					throw;
+				}
+			}
+		}
+		engine = uring ? RAW_IO_URING : RAW_IO_PWRITEV;
+
+		for (size_t i = 0; i < queueDepth; i++) {
+			void* data = nullptr;
+			if (posix_memalign(&data, pageSize, slotBytes) != 0) {
+				throw runtime_error("RawFrameSink: cannot allocate " + to_string(queueDepth) + " buffers of " +
+									to_string(slotBytes) + " bytes");
+			}
+			// The padding after frameBytes stays zero.
+			memset(data, 0, slotBytes);
+			const Buffer buffer = {(unsigned char*)data, 0, 0};
+			buffers.push_back(buffer);
+			idle.push_back(i);
+		}
+		index.assign(capacity, 0);
+
+		if (!uring) {
+			writer = std::thread(&RawFrameSink::runWriter, this);
+		}
+	} catch (...) {
+		freeBuffers();
+		uring.reset();
+		::close(fd);
+		throw;
+	}
+}
+
+RawFrameSink::~RawFrameSink() {
+	try {
+		close();
+	} catch (const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+	}
+	freeBuffers();
+}
+
+void RawFrameSink::freeBuffers() {
+	for (Buffer& buffer : buffers) {
+		free(buffer.data);
+	}
+	buffers.clear();
+}
+
+bool RawFrameSink::write(uint64_t frame, const void* pixels, size_t size) {
+	if (frame >= capacity) {
+		throw runtime_error("RawFrameSink: frame " + to_string(frame) + " beyond the capacity of " +
+							to_string(capacity));
+	}
+	if (size > layout.frameBytes) {
+		throw runtime_error("RawFrameSink: frame of " + to_string(size) + " bytes exceeds " +
+							to_string(layout.frameBytes));
+	}
+
+	size_t buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closed) {
+			throw runtime_error("RawFrameSink: write after close");
+		}
+		if (!error.empty()) {
+			throw runtime_error(error);
+		}
+		if (uring) {
+			reapUring(false);
+		}
+		if (idle.empty()) {
+			stats.dropped++;
+			return false;
+		}
+		buffer = idle.back();
+		idle.pop_back();
+	}
+
+	// Copy outside the lock, so pool workers fill their buffers in parallel.
+	Buffer& slot = buffers[buffer];
+	memcpy(slot.data, pixels, size);
+	memset(slot.data + size, 0, layout.frameBytes - size);
+	slot.frame = frame;
+	slot.timestampNs = monotonicNs();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (submitted == 0) {
+		firstSubmit = std::chrono::steady_clock::now();
+	}
+	submitted++;
+	if (uring) {
+		submitUring(buffer);
+	} else {
+		queued.push_back(buffer);
+		wake.notify_one();
+	}
+	const size_t inFlight = buffers.size() - idle.size();
+	inFlightSum += inFlight;
+	stats.maxInFlight = std::max(stats.maxInFlight, inFlight);
+	return true;
+}
+
+/*
+ * Queue one slot write on the ring and hand it to the kernel. The queue is
+ * as deep as there are buffers, so a free entry always exists.
+ */
+void RawFrameSink::submitUring(size_t buffer) {
+	const unsigned tail = *uring->sqTail;
+	const unsigned entry = tail & *uring->sqMask;
+	struct io_uring_sqe& sqe = uring->sqes[entry];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_WRITE;
+	sqe.fd = fd;
+	sqe.addr = (uint64_t)(uintptr_t)buffers[buffer].data;
+	sqe.len = (uint32_t)slotBytes;
+	sqe.off = dataOffset + buffers[buffer].frame * slotBytes;
+	sqe.user_data = buffer;
+	uring->sqArray[entry] = entry;
+	__atomic_store_n(uring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	if (uring->enter(1, 0) < 0) {
+		// The entry stays queued in the ring; give up on the sink rather than resubmit it.
+		error = systemError("io_uring_enter");
+		throw runtime_error(error);
+	}
+	uring->inFlight++;
+}
+
+/*
+ * Take the finished writes off the completion queue; with wait, until none
+ * is left in flight.
+ */
+void RawFrameSink::reapUring(bool wait) {
+	unsigned head = *uring->cqHead;
+	while (true) {
+		const unsigned tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			if (!wait || uring->inFlight == 0) {
+				break;
+			}
+			if (uring->enter(0, 1) < 0) {
+				error = systemError("io_uring_enter");
+				break;
+			}
+			continue;
+		}
+
+		const struct io_uring_cqe& cqe = uring->cqes[head & *uring->cqMask];
+		const size_t buffer = (size_t)cqe.user_data;
+		const bool succeeded = cqe.res == (int)slotBytes;
+		if (!succeeded && error.empty()) {
+			error = cqe.res < 0 ? systemError("write " + path, -cqe.res)
+								: "RawFrameSink: short write of frame " + to_string(buffers[buffer].frame);
+		}
+		head++;
+		__atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+		uring->inFlight--;
+		complete(buffer, succeeded);
+	}
+}
+
+/*
+ * Writer thread of the pwritev fallback. Takes everything queued at once and
+ * writes each run of consecutive frames, which are adjacent slots in the
+ * file, with one pwritev.
+ */
+void RawFrameSink::runWriter() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [this] { return stopping || !queued.empty(); });
+		if (queued.empty()) {
+			break;
+		}
+		std::vector<size_t> batch(queued.begin(), queued.end());
+		queued.clear();
+		lock.unlock();
+
+		std::sort(batch.begin(), batch.end(),
+				  [this](size_t a, size_t b) { return buffers[a].frame < buffers[b].frame; });
+		for (size_t first = 0; first < batch.size();) {
+			size_t end = first + 1;
+			while (end < batch.size() && buffers[batch[end]].frame == buffers[batch[end - 1]].frame + 1) {
+				end++;
+			}
+			std::vector<struct iovec> iov;
+			for (size_t i = first; i < end; i++) {
+				const struct iovec slot = {buffers[batch[i]].data, slotBytes};
+				iov.push_back(slot);
+			}
+			const bool succeeded = pwriteAll(fd, iov, dataOffset + buffers[batch[first]].frame * slotBytes);
+			const int writeError = errno;
+
+			lock.lock();
+			if (!succeeded && error.empty()) {
+				error = systemError("pwritev " + path, writeError);
+			}
+			for (size_t i = first; i < end; i++) {
+				complete(batch[i], succeeded);
+			}
+			lock.unlock();
+			first = end;
+		}
+		lock.lock();
+	}
+}
+
+void RawFrameSink::complete(size_t buffer, bool succeeded) {
+	// The write stage is the time the frame spent queued and on its way to the file, not the copy.
+	recordStage(METRIC_WRITE, (monotonicNs() - buffers[buffer].timestampNs) / 1e9);
+	if (succeeded) {
+		index[buffers[buffer].frame] = buffers[buffer].timestampNs;
+		stats.written++;
+		stats.bytes += slotBytes;
+	}
+	lastComplete = std::chrono::steady_clock::now();
+	idle.push_back(buffer);
+}
+
+void RawFrameSink::close() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closed) {
+			return;
+		}
+		closed = true;
+		if (uring) {
+			reapUring(true);
+		}
+		stopping = true;
+	}
+	if (writer.joinable()) {
+		wake.notify_all();
+		writer.join();
+	}
+
+	RawFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, sequenceMagic, sizeof(header.magic));
+	header.version = 1;
+	header.flags = layout.bottomUp ? RAW_FRAME_BOTTOM_UP : 0;
+	header.width = layout.width;
+	header.height = layout.height;
+	header.stride = layout.stride;
+	header.format = layout.format;
+	header.type = layout.type;
+	header.frameBytes = layout.frameBytes;
+	header.slotBytes = slotBytes;
+	header.capacity = capacity;
+	header.written = stats.written;
+	header.indexOffset = pageSize;
+	header.dataOffset = dataOffset;
+
+	// Header and index in one aligned write, as O_DIRECT requires.
+	void* page = nullptr;
+	bool written = posix_memalign(&page, pageSize, dataOffset) == 0;
+	if (written) {
+		memset(page, 0, dataOffset);
+		memcpy(page, &header, sizeof(header));
+		memcpy((char*)page + pageSize, index.data(), index.size() * sizeof(uint64_t));
+		std::vector<struct iovec> iov(1);
+		iov[0].iov_base = page;
+		iov[0].iov_len = dataOffset;
+		written = pwriteAll(fd, iov, 0);
+	}
+	const int writeError = errno;
+	free(page);
+	uring.reset();
+	::close(fd);
+	fd = -1;
+
+	if (!error.empty()) {
+		throw runtime_error(error);
+	}
+	if (!written) {
+		throw runtime_error(systemError("write header of " + path, writeError));
+	}
+}
+
+RawFrameSink::Statistics RawFrameSink::statistics() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	Statistics result = stats;
+	result.averageInFlight = submitted > 0 ? (double)inFlightSum / submitted : 0.0;
+	result.seconds =
+		stats.written > 0 ? std::chrono::duration<double>(lastComplete - firstSubmit).count() : 0.0;
+	return result;
+}
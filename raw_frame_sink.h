@@ -0,0 +1,170 @@
+/*
+ * Raw frame sequence files, for capture runs that keep thousands of
+ * uncompressed frames per second instead of one encoded image.
+ *
+ * The file starts with a header page and a frame index, followed by one
+ * page-aligned slot per frame, so frame n is found at
+ * dataOffset + n * slotBytes without scanning:
+ *
+ *   header   magic, version, width, height, stride, GL format and type,
+ *            flags, frameBytes, slotBytes, capacity, frames written,
+ *            indexOffset, dataOffset (RawFrameHeader, little-endian)
+ *   index    one uint64 per frame: CLOCK_MONOTONIC ns at which the frame
+ *            was handed to the sink, 0 if it never reached the file
+ *   slot n   frameBytes of frame n, zero padded to slotBytes
+ *
+ * The header and index are written last, when the sink closes; until then
+ * the magic is zero, which marks an interrupted capture.
+ *
+ * The file is pre-sized with fallocate and opened with O_DIRECT where the
+ * file system allows it, so frames go from page-aligned buffers to the
+ * device without passing through the page cache. Writes are submitted to an
+ * io_uring, several in flight at once. Where io_uring is unavailable a
+ * writer thread takes over and gathers consecutive frames into a single
+ * pwritev. Either way write() never waits for the disk: a frame that finds
+ * every buffer in flight is dropped and counted.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_RAW_FRAME_SINK_H
+#define EGL_OFFSCREEN_RAW_FRAME_SINK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RawFrameHeader {
+	char magic[8];			/* "GLRAWSEQ" */
+	uint32_t version;		/* 1 */
+	uint32_t flags;			/* RAW_FRAME_BOTTOM_UP */
+	uint32_t width, height, stride;
+	uint32_t format, type;	/* GL pair of the pixels, 0 for GPU converted frames */
+	uint32_t reserved;
+	uint64_t frameBytes;
+	uint64_t slotBytes;		/* page-aligned distance between frames */
+	uint64_t capacity;		/* frame slots in the file */
+	uint64_t written;		/* frames that reached the file */
+	uint64_t indexOffset;
+	uint64_t dataOffset;	/* slot of frame 0 */
+};
+
+enum {
+	RAW_FRAME_BOTTOM_UP = 1		/* rows as glReadPixels returns them, bottom row first */
+};
+
+enum RawFrameIo {
+	RAW_IO_AUTO,		/* io_uring, pwritev if it cannot be set up */
+	RAW_IO_URING,
+	RAW_IO_PWRITEV
+};
+
+const char* rawFrameIoName(RawFrameIo io);
+RawFrameIo parseRawFrameIo(const std::string& name);
+
+struct RawFrameLayout {
+	uint32_t width, height, stride;
+	uint32_t format, type;	/* GL pair, 0 for GPU converted frames */
+	bool bottomUp;
+	size_t frameBytes;
+};
+
+class RawFrameSink {
+public:
+	struct Statistics {
+		uint64_t written;		/* frames on disk */
+		uint64_t dropped;		/* frames that found every buffer in flight */
+		uint64_t bytes;			/* slot bytes written */
+		size_t maxInFlight;		/* most writes queued at once */
+		double averageInFlight;	/* writes queued right after a submission, averaged */
+		double seconds;			/* first submission to last completion */
+	};
+
+	/*
+	 * Create path with room for capacity frames of layout, and queueDepth
+	 * page-aligned buffers that may be in flight at once. Throws if the file
+	 * cannot be created or pre-sized, or io is RAW_IO_URING and io_uring
+	 * cannot be set up.
+	 */
+	RawFrameSink(const std::string& path, const RawFrameLayout& layout, uint64_t capacity, size_t queueDepth,
+				 RawFrameIo io);
+
+	/*
+	 * Close the sink if close() was not called, reporting errors on stderr.
+	 */
+	~RawFrameSink();
+
+	RawFrameSink(const RawFrameSink&) = delete;
+	RawFrameSink& operator=(const RawFrameSink&) = delete;
+
+	/*
+	 * Copy the size bytes of frame into a free buffer and queue its write.
+	 * Returns false if no buffer was free and the frame was dropped.
+	 * Thread-safe. Throws if frame is beyond the capacity, size exceeds the
+	 * layout, or an earlier write failed.
+	 */
+	bool write(uint64_t frame, const void* pixels, size_t size);
+
+	/*
+	 * Wait for the queued writes, then write the header and index and close
+	 * the file. Throws if any write failed.
+	 */
+	void close();
+
+	Statistics statistics() const;
+
+	RawFrameIo io() const { return engine; }
+	bool direct() const { return directIo; }	/* opened with O_DIRECT */
+	size_t queueDepth() const { return buffers.size(); }
+
+private:
+	struct Uring;
+	struct Buffer {
+		unsigned char* data;	/* slotBytes, page-aligned */
+		uint64_t frame;
+		uint64_t timestampNs;
+	};
+
+	void submitUring(size_t buffer);
+	void reapUring(bool wait);
+	void runWriter();
+	void complete(size_t buffer, bool succeeded);
+	void freeBuffers();
+
+	std::string path;
+	RawFrameLayout layout;
+	uint64_t capacity;
+	size_t slotBytes;
+	size_t dataOffset;
+	int fd;
+	bool directIo;
+	RawFrameIo engine;
+	std::unique_ptr<Uring> uring;
+
+	std::vector<Buffer> buffers;
+	std::vector<size_t> idle;		/* buffers free for write() */
+	std::deque<size_t> queued;		/* buffers waiting for the writer thread */
+	std::vector<uint64_t> index;	/* submission time per frame, 0 while not written */
+	std::string error;				/* first failed write */
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::thread writer;
+	bool stopping;
+	bool closed;
+
+	Statistics stats;
+	uint64_t submitted;
+	uint64_t inFlightSum;
+	std::chrono::steady_clock::time_point firstSubmit, lastComplete;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Readback format discovery.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "readback_format.h"
+
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "gl_debug.h"
+#include "gl_extensions.h"
+#include "pbo_readback.h"
+#include "render_target_pool.h"
+
+using namespace std;
+
+
+namespace {
+
+#define GL_ENUM_NAME(e) {e, #e}
+
+const struct {
+	GLenum value;
+	const char* name;
+} enumNames[] = {
+	GL_ENUM_NAME(GL_NONE),
+	GL_ENUM_NAME(GL_RED),
+	GL_ENUM_NAME(GL_RG),
+	GL_ENUM_NAME(GL_RGB),
+	GL_ENUM_NAME(GL_BGR),
+	GL_ENUM_NAME(GL_RGBA),
+	GL_ENUM_NAME(GL_BGRA),
+	GL_ENUM_NAME(GL_RED_INTEGER),
+	GL_ENUM_NAME(GL_RGBA_INTEGER),
+	GL_ENUM_NAME(GL_UNSIGNED_BYTE),
+	GL_ENUM_NAME(GL_BYTE),
+	GL_ENUM_NAME(GL_UNSIGNED_SHORT),
+	GL_ENUM_NAME(GL_SHORT),
+	GL_ENUM_NAME(GL_UNSIGNED_INT),
+	GL_ENUM_NAME(GL_INT),
+	GL_ENUM_NAME(GL_HALF_FLOAT),
+	GL_ENUM_NAME(GL_FLOAT),
+	GL_ENUM_NAME(GL_UNSIGNED_SHORT_5_6_5),
+	GL_ENUM_NAME(GL_UNSIGNED_INT_8_8_8_8),
+	GL_ENUM_NAME(GL_UNSIGNED_INT_8_8_8_8_REV),
+	GL_ENUM_NAME(GL_UNSIGNED_INT_2_10_10_10_REV),
+	GL_ENUM_NAME(GL_FULL_SUPPORT),
+	GL_ENUM_NAME(GL_CAVEAT_SUPPORT),
+};
+
+#undef GL_ENUM_NAME
+
+/*
+ * glGetInternalformativ for one value, 0 if the query is not supported.
+ */
+GLint internalformatValue(GLenum internalFormat, GLenum pname) {
+	GlExpectedErrors expected;
+	GLint value = 0;
+	glGetInternalformativ(GL_TEXTURE_2D, internalFormat, pname, 1, &value);
+	return glGetError() == GL_NO_ERROR ? value : 0;
+}
+
+}
+
+
+std::string glEnumName(GLenum value) {
+	for (const auto& entry : enumNames) {
+		if (entry.value == value) {
+			return entry.name;
+		}
+	}
+	std::ostringstream s;
+	s << "0x" << std::hex << value;
+	return s.str();
+}
+
+ReadbackFormat queryReadbackFormat(GLenum internalFormat) {
+	const RenderFormat& render = renderFormat(internalFormat);
+	ReadbackFormat result = ReadbackFormat();
+	result.internalFormat = internalFormat;
+
+	if (isGlextSupported("GL_ARB_internalformat_query2")) {
+		result.readSupport = internalformatValue(internalFormat, GL_READ_PIXELS);
+		result.queryFormat = internalformatValue(internalFormat, GL_READ_PIXELS_FORMAT);
+		result.queryType = internalformatValue(internalFormat, GL_READ_PIXELS_TYPE);
+		result.textureFormat = internalformatValue(internalFormat, GL_TEXTURE_IMAGE_FORMAT);
+		result.textureType = internalformatValue(internalFormat, GL_TEXTURE_IMAGE_TYPE);
+		result.preferredInternalFormat = internalformatValue(internalFormat, GL_INTERNALFORMAT_PREFERRED);
+	}
+
+	/*
+	 * The implementation read pair belongs to the bound read framebuffer, so
+	 * bind a 1x1 one of this format.
+	 */
+	GLint readFramebuffer = 0, drawFramebuffer = 0, boundTexture = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+
+	GLuint texture = 0, framebuffer = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, 1, 1, 0, render.format, render.type, nullptr);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+		glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &result.implementationFormat);
+		glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &result.implementationType);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+	glBindTexture(GL_TEXTURE_2D, boundTexture);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteTextures(1, &texture);
+	assertOpenGLError("queryReadbackFormat");
+
+	/*
+	 * Prefer the driver's pair from query2, then the implementation read
+	 * pair, as long as the host can expand it; otherwise read in the
+	 * format's own pair.
+	 */
+	if (result.readSupport != GL_NONE && result.queryFormat && result.queryType &&
+		canExpandToRgba8(result.queryFormat, result.queryType)) {
+		result.format = result.queryFormat;
+		result.type = result.queryType;
+		result.source = "query2";
+	} else if (result.implementationFormat && result.implementationType &&
+			   canExpandToRgba8(result.implementationFormat, result.implementationType)) {
+		result.format = result.implementationFormat;
+		result.type = result.implementationType;
+		result.source = "implementation";
+	} else {
+		result.format = render.format;
+		result.type = render.type;
+		result.source = "default";
+	}
+	return result;
+}
+
+ReadbackFormat readbackFormat(GLenum internalFormat) {
+	static std::mutex mutex;
+	static std::map<GLenum, ReadbackFormat> formats;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = formats.find(internalFormat);
+	if (found == formats.end()) {
+		found = formats.insert(std::make_pair(internalFormat, queryReadbackFormat(internalFormat))).first;
+	}
+	return found->second;
+}
+
+std::vector<ReadbackFormat> queryReadbackFormats() {
+	std::vector<ReadbackFormat> formats;
+	for (const RenderFormat& format : renderFormatList()) {
+		formats.push_back(queryReadbackFormat(format.internalFormat));
+	}
+	return formats;
+}
@@ -0,0 +1,63 @@
+/*
+ * Discovery of the driver's native readback format for each render target
+ * format.
+ *
+ * glReadPixels accepts many format/type pairs, but only some are a plain
+ * copy; the others go through a conversion in the driver, often on the CPU.
+ * GL_ARB_internalformat_query2 reports the pair the driver prefers
+ * (GL_READ_PIXELS_FORMAT/TYPE) and whether reading is supported at all, and
+ * GL_IMPLEMENTATION_COLOR_READ_FORMAT/TYPE names the extra pair a bound
+ * framebuffer supports besides the mandatory ones. The readback path reads
+ * in the preferred pair when the host side can expand it, and leaves any
+ * remaining conversion to expandPixelsToRgba8().
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_READBACK_FORMAT_H
+#define EGL_OFFSCREEN_READBACK_FORMAT_H
+
+#include <string>
+#include <vector>
+
+#include "gl_common.h"
+
+struct ReadbackFormat {
+	GLenum internalFormat;
+	GLenum format, type;	/* the pair the readback path uses */
+	const char* source;		/* where the pair came from: "query2", "implementation" or "default" */
+
+	// Raw query results, 0 if unavailable.
+	GLint readSupport;		/* GL_READ_PIXELS: GL_FULL_SUPPORT, GL_CAVEAT_SUPPORT or GL_NONE */
+	GLint queryFormat, queryType;	/* GL_READ_PIXELS_FORMAT/TYPE */
+	GLint implementationFormat, implementationType;	/* GL_IMPLEMENTATION_COLOR_READ_FORMAT/TYPE */
+	GLint textureFormat, textureType;	/* GL_TEXTURE_IMAGE_FORMAT/TYPE, preferred for uploads */
+	GLint preferredInternalFormat;	/* GL_INTERNALFORMAT_PREFERRED */
+};
+
+/*
+ * Query the readback format of a GL_TEXTURE_2D render target in
+ * internalFormat. Creates a 1x1 framebuffer for the implementation read
+ * format and restores the framebuffer bindings. Requires a current context.
+ */
+ReadbackFormat queryReadbackFormat(GLenum internalFormat);
+
+/*
+ * queryReadbackFormat() once per internal format and process, for the
+ * readback paths: the answer depends on the driver, not on the context.
+ * Thread-safe.
+ */
+ReadbackFormat readbackFormat(GLenum internalFormat);
+
+/*
+ * queryReadbackFormat() for every format in the render format table.
+ */
+std::vector<ReadbackFormat> queryReadbackFormats();
+
+/*
+ * "GL_BGRA" for the enums appearing in readback pairs, hex otherwise.
+ */
+std::string glEnumName(GLenum value);
+
+#endif
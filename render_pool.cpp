@@ -0,0 +1,249 @@
+/*
+ * Multi-threaded render worker pool.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "render_pool.h"
+
+#include "gl_debug.h"
+#include "metrics.h"
+#include "pbo_readback.h"
+#include "readback_format.h"
+#include "render_target_pool.h"
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+
+RenderPool::RenderPool(EGLDisplay display, EGLConfig config, size_t workerCount, size_t targetBudget)
+	: display(display), config(config), targetBudget(targetBudget), nextWorker(0), queuedJobs(0), unfinishedJobs(0), startedWorkers(0),
+	  stopping(false) {
+	if (workerCount == 0) {
+		throw runtime_error("RenderPool: at least one worker is required");
+	}
+
+	for (size_t i = 0; i < workerCount; i++) {
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+		workers.back()->stats = WorkerStatistics();
+	}
+	for (size_t i = 0; i < workerCount; i++) {
+		workers[i]->thread = std::thread(&RenderPool::run, this, i);
+	}
+
+	// Wait for every worker to create its context, so setup errors surface here.
+	std::unique_lock<std::mutex> lock(stateMutex);
+	stateChanged.wait(lock, [this] { return startedWorkers == workers.size(); });
+	if (firstError) {
+		std::exception_ptr error = firstError;
+		lock.unlock();
+		shutdown();
+		std::rethrow_exception(error);
+	}
+}
+
+RenderPool::~RenderPool() {
+	shutdown();
+}
+
+void RenderPool::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		if (workers[i]->thread.joinable()) {
+			workers[i]->thread.join();
+		}
+	}
+}
+
+void RenderPool::submit(const RenderJob& job) {
+	Worker& worker = *workers[nextWorker++ % workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		queuedJobs++;
+		unfinishedJobs++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back(job);
+	}
+	workAvailable.notify_one();
+}
+
+void RenderPool::wait() {
+	std::unique_lock<std::mutex> lock(stateMutex);
+	stateChanged.wait(lock, [this] { return unfinishedJobs == 0; });
+	if (firstError) {
+		std::exception_ptr error = firstError;
+		firstError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+std::vector<RenderPool::WorkerStatistics> RenderPool::statistics() const {
+	std::vector<WorkerStatistics> result;
+	for (size_t i = 0; i < workers.size(); i++) {
+		std::lock_guard<std::mutex> lock(workers[i]->mutex);
+		result.push_back(workers[i]->stats);
+	}
+	return result;
+}
+
+void RenderPool::fail(std::exception_ptr error) {
+	std::lock_guard<std::mutex> lock(stateMutex);
+	if (!firstError) {
+		firstError = error;
+	}
+}
+
+bool RenderPool::takeJob(size_t index, RenderJob& job, bool& stolen) {
+	{
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			stolen = false;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers.size(); i++) {
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty()) {
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			stolen = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderPool::run(size_t index) {
+	Worker& worker = *workers[index];
+	EGLContext context = EGL_NO_CONTEXT;
+	std::unique_ptr<RenderTargetPool> targets;
+	std::vector<unsigned char> pixels;
+
+	/*
+	 * Per-thread EGL and OpenGL setup.
+	 */
+	try {
+		StageTimer timer(METRIC_CONTEXT_SETUP);
+		eglBindAPI(EGL_OPENGL_API);
+		assertEGLError("worker eglBindAPI");
+
+		const std::vector<EGLint> attributes = glContextAttributes();
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, attributes.data());
+		assertEGLError("worker eglCreateContext");
+
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+		assertEGLError("worker eglMakeCurrent");
+		installGlDebugCallback();
+
+		// Framebuffers are not shared between contexts, so each worker recycles its own.
+		const size_t budget = targetBudget == 0 ? defaultRenderTargetBudget() : targetBudget;
+		targets.reset(new RenderTargetPool(budget / workers.size()));
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		assertOpenGLError("worker setup");
+	} catch (...) {
+		fail(std::current_exception());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		startedWorkers++;
+	}
+	stateChanged.notify_all();
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			workAvailable.wait(lock, [this] { return stopping || queuedJobs > 0; });
+			if (queuedJobs == 0) {
+				break;
+			}
+			queuedJobs--;
+		}
+
+		/*
+		 * queuedJobs guarantees a job exists in some queue, but another worker
+		 * may be moving it concurrently; keep looking until we get it.
+		 */
+		RenderJob job;
+		bool stolen = false;
+		while (!takeJob(index, job, stolen)) {
+			std::this_thread::yield();
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		try {
+			if (context == EGL_NO_CONTEXT) {
+				throw runtime_error("worker has no EGL context");
+			}
+			GlDebugGroup group("render job");
+
+			const ReadbackFormat format = readbackFormat(job.internalFormat);
+			const RenderTargetKey key = renderTargetKey(job.width, job.height, job.internalFormat);
+			RenderTarget* target = targets->acquire(key);
+			pixels.resize((size_t)job.width * job.height * pixelSize(format.format, format.type));
+
+			{
+				StageTimer timer(METRIC_RENDER);
+				glViewport(0, 0, job.width, job.height);
+				glClearColor(job.clearColor[0], job.clearColor[1], job.clearColor[2], job.clearColor[3]);
+				glClear(GL_COLOR_BUFFER_BIT);
+			}
+			{
+				StageTimer timer(METRIC_READBACK);
+				glReadPixels(0, 0, job.width, job.height, format.format, format.type, pixels.data());
+				targets->release(target);
+				assertOpenGLError("worker glReadPixels");
+			}
+			countMetric(METRIC_FRAMES);
+			countMetric(METRIC_READBACK_BYTES, pixels.size());
+
+			if (job.done) {
+				job.done(job, pixels.data(), pixels.size());
+			}
+		} catch (...) {
+			fail(std::current_exception());
+		}
+		const double elapsed =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.stats.jobs++;
+			worker.stats.stolen += stolen ? 1 : 0;
+			worker.stats.pixels += (uint64_t)job.width * job.height;
+			worker.stats.busySeconds += elapsed;
+			if (targets) {
+				const RenderTargetPool::Statistics& targetStats = targets->statistics();
+				worker.stats.targetHits = targetStats.hits;
+				worker.stats.targetMisses = targetStats.misses;
+				worker.stats.targetBytes = targetStats.residentBytes;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			unfinishedJobs--;
+		}
+		stateChanged.notify_all();
+	}
+
+	if (context != EGL_NO_CONTEXT) {
+		targets.reset();
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	eglReleaseThread();
+}
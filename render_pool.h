@@ -0,0 +1,102 @@
+/*
+ * Pool of render worker threads, each owning a surfaceless EGL context and
+ * its own render target pool, fed from per-worker job queues with work stealing.
+ *
+ * Jobs are distributed round-robin over the worker queues. A worker takes
+ * jobs from the back of its own queue and, once that runs dry, steals from
+ * the front of the other queues, so uneven jobs still keep every core busy.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_RENDER_POOL_H
+#define EGL_OFFSCREEN_RENDER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_common.h"
+
+struct RenderJob {
+	typedef std::function<void(const RenderJob& job, const void* pixels, size_t size)> Completion;
+
+	uint64_t id;
+	GLsizei width, height;
+	GLfloat clearColor[4];
+	GLenum internalFormat;	/* render target format, see renderFormat() */
+	Completion done;	/* optional, called on the worker thread with the pixels in the target format */
+};
+
+class RenderPool {
+public:
+	struct WorkerStatistics {
+		uint64_t jobs;
+		uint64_t stolen;		/* jobs taken from another worker's queue */
+		uint64_t pixels;
+		double busySeconds;		/* time spent executing jobs */
+		uint64_t targetHits;	/* jobs served by a recycled render target */
+		uint64_t targetMisses;
+		size_t targetBytes;		/* resident render target memory */
+	};
+
+	/*
+	 * Start a thread per worker, each creating its own context on display. Throws
+	 * if any worker fails to set up its context. targetBudget is the render
+	 * target memory shared by all workers, 0 for the default budget.
+	 */
+	RenderPool(EGLDisplay display, EGLConfig config, size_t workers, size_t targetBudget = 0);
+	~RenderPool();
+
+	RenderPool(const RenderPool&) = delete;
+	RenderPool& operator=(const RenderPool&) = delete;
+
+	void submit(const RenderJob& job);
+
+	/*
+	 * Block until every submitted job has finished. Rethrows the first
+	 * exception raised by a job.
+	 */
+	void wait();
+
+	size_t size() const { return workers.size(); }
+	std::vector<WorkerStatistics> statistics() const;
+
+private:
+	struct Worker {
+		std::thread thread;
+		mutable std::mutex mutex;	/* guards jobs and stats */
+		std::deque<RenderJob> jobs;
+		WorkerStatistics stats;
+	};
+
+	void shutdown();
+	void run(size_t index);
+	bool takeJob(size_t index, RenderJob& job, bool& stolen);
+	void fail(std::exception_ptr error);
+
+	EGLDisplay display;
+	EGLConfig config;
+	size_t targetBudget;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<size_t> nextWorker;
+
+	std::mutex stateMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable stateChanged;
+	size_t queuedJobs;		/* submitted but not yet taken */
+	size_t unfinishedJobs;	/* submitted but not yet completed */
+	size_t startedWorkers;
+	bool stopping;
+	std::exception_ptr firstError;
+};
+
+#endif
@@ -0,0 +1,552 @@
+/*
+ * Batch render server.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "render_server.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <errno.h>
+#include <iostream>
+#include <signal.h>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "benchmark.h"
+#include "damage_tracker.h"
+#include "gl_common.h"
+#include "gl_debug.h"
+#include "metrics.h"
+#include "pbo_readback.h"
+#include "readback_format.h"
+#include "render_target_pool.h"
+
+using namespace std;
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/* Latencies kept for the percentiles; older jobs only count in the totals. */
+const size_t latencyWindow = 4096;
+
+struct RenderRect {
+	GLint x, y;
+	GLsizei width, height;
+	GLfloat color[4];
+};
+
+struct ServerJob {
+	std::string id;
+	GLsizei width = 0, height = 0;	/* 0 until given or resolved, see RenderServer::resolve() */
+	GLfloat clearColor[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	bool clear = false;			/* color was given */
+	std::vector<RenderRect> rects;
+	GLenum internalFormat = GL_NONE;
+	std::string output;
+	std::string canvas;			/* persistent target to draw over, empty for a fresh one */
+	bool delta = false;			/* send the damaged rectangles only */
+};
+
+/*
+ * A target kept between jobs, with the host copy of its frame that partial
+ * readbacks keep up to date.
+ */
+struct Canvas {
+	RenderTarget* target = nullptr;
+	std::vector<unsigned char> frame;	/* bottom-up, in the target's readback pair */
+	GLfloat background[4];				/* color of the last clear, for newly committed sparse pages */
+};
+
+/*
+ * Buffered line reader and writer on a file descriptor pair.
+ */
+class Channel {
+public:
+	Channel(int in, int out) : in(in), out(out) {}
+
+	bool readLine(std::string& line) {
+		for (;;) {
+			const size_t newline = buffer.find('\n');
+			if (newline != std::string::npos) {
+				line = buffer.substr(0, newline);
+				buffer.erase(0, newline + 1);
+				return true;
+			}
+			char chunk[4096];
+			const ssize_t n = ::read(in, chunk, sizeof(chunk));
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				// A last line without newline still counts.
+				line.swap(buffer);
+				buffer.clear();
+				return !line.empty();
+			}
+			buffer.append(chunk, n);
+		}
+	}
+
+	void write(const void* data, size_t size) {
+		const char* bytes = (const char*)data;
+		while (size > 0) {
+			const ssize_t n = ::write(out, bytes, size);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n <= 0) {
+				throw runtime_error(std::string("render server write: ") + strerror(errno));
+			}
+			bytes += n;
+			size -= n;
+		}
+	}
+
+	void write(const std::string& line) {
+		write(line.data(), line.size());
+	}
+
+private:
+	int in, out;
+	std::string buffer;
+};
+
+void parseFloats(const std::string& name, const std::string& value, float* values, size_t count) {
+	const char* p = value.c_str();
+	for (size_t i = 0; i < count; i++) {
+		char* end = nullptr;
+		values[i] = strtof(p, &end);
+		if (end == p || (i + 1 < count ? *end != ',' : *end != '\0')) {
+			throw runtime_error("invalid " + name + ": " + value);
+		}
+		p = end + 1;
+	}
+}
+
+GLsizei parseSize(const std::string& name, const std::string& value) {
+	char* end = nullptr;
+	const long n = strtol(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0' || n <= 0) {
+		throw runtime_error("invalid " + name + ": " + value);
+	}
+	return (GLsizei)n;
+}
+
+/*
+ * Fill job from the key=value tokens. Keys parsed before an error stay set,
+ * so the error response can still carry the job id.
+ */
+void parseJob(std::istringstream& tokens, ServerJob& job) {
+	std::string token;
+	while (tokens >> token) {
+		const size_t eq = token.find('=');
+		const std::string name = token.substr(0, eq);
+		const std::string value = eq == std::string::npos ? std::string() : token.substr(eq + 1);
+
+		if (name == "id") {
+			job.id = value;
+		} else if (name == "width") {
+			job.width = parseSize(name, value);
+		} else if (name == "height") {
+			job.height = parseSize(name, value);
+		} else if (name == "color") {
+			parseFloats(name, value, job.clearColor, 4);
+			job.clear = true;
+		} else if (name == "rect") {
+			float values[8];
+			parseFloats(name, value, values, 8);
+			RenderRect rect = {(GLint)values[0], (GLint)values[1], (GLsizei)values[2], (GLsizei)values[3],
+							   {values[4], values[5], values[6], values[7]}};
+			job.rects.push_back(rect);
+		} else if (name == "format") {
+			job.internalFormat = parseRenderFormat(value).internalFormat;
+		} else if (name == "output") {
+			job.output = value;
+		} else if (name == "canvas") {
+			job.canvas = value;
+		} else if (name == "delta") {
+			job.delta = value == "1";
+		} else {
+			throw runtime_error("unknown job key: " + name);
+		}
+	}
+}
+
+class RenderServer {
+public:
+	explicit RenderServer(const RenderServerOptions& options)
+		: options(options), targets(options.targetBudget), encoders(options.image.threads), readbackBytes(0), readbackBytesSaved(0),
+		  outputBytesSaved(0), started(Clock::now()), jobs(0), errors(0), busySeconds(0), stopping(false) {
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	}
+
+	/*
+	 * Serve one client until it quits or disconnects.
+	 */
+	void serve(Channel& channel) {
+		std::string line;
+		while (!stopping && channel.readLine(line)) {
+			std::istringstream tokens(line);
+			std::string command;
+			if (!(tokens >> command)) {
+				continue;
+			}
+			if (command == "render") {
+				render(channel, tokens);
+			} else if (command == "close") {
+				close(channel, tokens);
+			} else if (command == "stats") {
+				channel.write("stats " + statistics() + "\n");
+			} else if (command == "quit") {
+				break;
+			} else if (command == "shutdown") {
+				stopping = true;
+			} else {
+				channel.write("error unknown command: " + command + "\n");
+			}
+		}
+	}
+
+	bool stopped() const { return stopping; }
+
+	std::string statistics() const {
+		const double uptime = std::chrono::duration<double>(Clock::now() - started).count();
+		const std::vector<double> window(latencies.begin(), latencies.end());
+		std::ostringstream s;
+		s << "jobs=" << jobs << " errors=" << errors << " jobs_per_s=" << (busySeconds > 0 ? jobs / busySeconds : 0.0)
+		  << " uptime_s=" << uptime << " latency_p50_ms=" << percentile(window, 50)
+		  << " latency_p99_ms=" << percentile(window, 99) << " latency_max_ms=" << percentile(window, 100);
+
+		const RenderTargetPool::Statistics& pool = targets.statistics();
+		s << " target_hits=" << pool.hits << " target_misses=" << pool.misses
+		  << " target_bytes=" << pool.residentBytes << " target_virtual_bytes=" << pool.virtualBytes
+		  << " canvases=" << canvases.size()
+		  << " readback_bytes=" << readbackBytes << " readback_bytes_saved=" << readbackBytesSaved
+		  << " output_bytes_saved=" << outputBytesSaved;
+		for (const RenderTargetPool::FormatUsage& usage : targets.usageByFormat()) {
+			s << " target_bytes_" << renderFormat(usage.internalFormat).name << "=" << usage.bytes;
+		}
+		return s.str();
+	}
+
+private:
+	void render(Channel& channel, std::istringstream& tokens) {
+		const Clock::time_point start = Clock::now();
+		ServerJob job;
+		std::string response;
+		const std::vector<unsigned char>* sent = nullptr;
+		try {
+			parseJob(tokens, job);
+			resolve(job);
+			if (job.delta && (job.canvas.empty() || job.output != "-")) {
+				throw runtime_error("delta=1 needs a canvas and output=-");
+			}
+			const ReadbackFormat format = readbackFormat(job.internalFormat);
+			const size_t stride = (size_t)job.width * pixelSize(format.format, format.type);
+			DamageTracker damage(job.width, job.height);
+			const unsigned char* frame = draw(job, damage);
+
+			size_t bytes = 0;
+			if (job.delta) {
+				delta.clear();
+				appendDeltaRecords(damage.regions(), frame, job.width, job.height,
+								   pixelSize(format.format, format.type), delta);
+				outputBytesSaved += stride * job.height - std::min(delta.size(), stride * job.height);
+				sent = &delta;
+				bytes = delta.size();
+			} else if (job.output == "-") {
+				flipped.resize(stride * job.height);
+				if (format.format == GL_RGBA && format.type == GL_UNSIGNED_BYTE) {
+					convertRows(frame, stride, flipped.data(), stride, job.width, job.height, true, PIXELS_RGBA);
+				} else {
+					for (GLsizei y = 0; y < job.height; y++) {
+						memcpy(&flipped[y * stride], frame + (job.height - 1 - y) * stride, stride);
+					}
+				}
+				sent = &flipped;
+				bytes = flipped.size();
+			} else if (!job.output.empty()) {
+				ImageWriterOptions image = options.image;
+				image.encoders = &encoders;
+				image.format = imageFormatFromPath(job.output);
+				const unsigned char* rgba = frame;
+				if (format.format != GL_RGBA || format.type != GL_UNSIGNED_BYTE) {
+					expanded.resize((size_t)job.width * job.height * 4);
+					expandPixelsToRgba8(format.format, format.type, frame, (size_t)job.width * job.height,
+										expanded.data());
+					rgba = expanded.data();
+				}
+				writeImage(job.output, rgba, job.width, job.height, image);
+				struct stat info;
+				if (stat(job.output.c_str(), &info) == 0) {
+					bytes = info.st_size;
+				}
+			}
+
+			const double latency = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			record(latency);
+			std::ostringstream s;
+			s << "ok id=" << job.id << " width=" << job.width << " height=" << job.height
+			  << " format=" << renderFormat(job.internalFormat).name << " bytes=" << bytes;
+			if (!job.canvas.empty()) {
+				s << " damage=" << damage.regions().size() << " damage_pixels=" << damage.area();
+			}
+			s << " latency_ms=" << latency << "\n";
+			response = s.str();
+		} catch (const std::exception& ex) {
+			errors++;
+			response = "error id=" + job.id + " " + ex.what() + "\n";
+			sent = nullptr;
+		}
+
+		channel.write(response);
+		if (sent) {
+			channel.write(sent->data(), sent->size());
+		}
+	}
+
+	/*
+	 * Fill in what the job left out: the current size and format of its
+	 * canvas, so incremental jobs do not resize it, otherwise 500x500 rgba8.
+	 */
+	void resolve(ServerJob& job) const {
+		auto found = job.canvas.empty() ? canvases.end() : canvases.find(job.canvas);
+		const RenderTarget* current = found != canvases.end() ? found->second.target : nullptr;
+		if (job.width == 0) {
+			job.width = current ? current->key.width : 500;
+		}
+		if (job.height == 0) {
+			job.height = current ? current->key.height : 500;
+		}
+		if (job.internalFormat == GL_NONE) {
+			job.internalFormat = current ? current->key.internalFormat : GL_RGBA8;
+		}
+	}
+
+	/*
+	 * Release a canvas and its render target.
+	 */
+	void close(Channel& channel, std::istringstream& tokens) {
+		std::string name;
+		tokens >> name;
+		auto found = canvases.find(name);
+		if (found == canvases.end()) {
+			channel.write("error unknown canvas: " + name + "\n");
+			return;
+		}
+		targets.release(found->second.target);
+		canvases.erase(found);
+		channel.write("ok closed " + name + "\n");
+	}
+
+	/*
+	 * Render the job and return its frame in the target format, bottom-up as
+	 * GL returns it, with the damaged rectangles in damage.
+	 *
+	 * Plain jobs render into a pooled target and read it back in full into
+	 * pixels. Canvas jobs draw over what the canvas showed after its last
+	 * job, and only the damaged rectangles are read back into the canvas's
+	 * copy of the frame. Sparse canvases never clear the whole target: a clear
+	 * releases its pages and fills the host copy from a single pixel, and
+	 * draws commit the pages they touch.
+	 */
+	const unsigned char* draw(const ServerJob& job, DamageTracker& damage) {
+		GlDebugGroup group("server job");
+		DamageTracker drawn(job.width, job.height);
+		const ReadbackFormat format = readbackFormat(job.internalFormat);
+		const size_t frameBytes = (size_t)job.width * job.height * pixelSize(format.format, format.type);
+
+		Canvas* canvas = nullptr;
+		RenderTarget* target = nullptr;
+		RenderTargetKey key = renderTargetKey(job.width, job.height, job.internalFormat);
+		bool clear = true;
+		if (job.canvas.empty()) {
+			target = targets.acquire(key);
+		} else {
+			canvas = &canvases[job.canvas];
+			key.sparse = options.sparseCanvases;
+			if (canvas->target && !(canvas->target->key == key)) {
+				targets.release(canvas->target);
+				canvas->target = nullptr;
+			}
+			// A new or resized canvas starts from the clear color, afterwards only an explicit color clears it.
+			clear = !canvas->target || job.clear;
+			if (!canvas->target) {
+				canvas->target = targets.acquire(key);
+				canvas->frame.assign(frameBytes, 0);
+			} else {
+				glBindFramebuffer(GL_FRAMEBUFFER, canvas->target->frameBuffer);
+			}
+			target = canvas->target;
+		}
+
+		{
+			StageTimer timer(METRIC_RENDER);
+			glViewport(0, 0, job.width, job.height);
+			if (clear && target->sparse) {
+				std::copy(job.clearColor, job.clearColor + 4, canvas->background);
+				targets.decommit(target);
+				targets.commit(target, 0, 0, 1, 1, canvas->background);
+			} else if (clear) {
+				glClearColor(job.clearColor[0], job.clearColor[1], job.clearColor[2], job.clearColor[3]);
+				glClear(GL_COLOR_BUFFER_BIT);
+			}
+			if (clear) {
+				damage.addAll();
+			}
+			if (!job.rects.empty()) {
+				glEnable(GL_SCISSOR_TEST);
+				for (const RenderRect& rect : job.rects) {
+					if (canvas) {
+						targets.commit(target, rect.x, rect.y, rect.width, rect.height, canvas->background);
+					}
+					glScissor(rect.x, rect.y, rect.width, rect.height);
+					glClearColor(rect.color[0], rect.color[1], rect.color[2], rect.color[3]);
+					glClear(GL_COLOR_BUFFER_BIT);
+					const DamageRect changed = {rect.x, rect.y, rect.width, rect.height};
+					damage.add(changed);
+					drawn.add(changed);
+				}
+				glDisable(GL_SCISSOR_TEST);
+			}
+		}
+
+		size_t read = 0;
+		{
+			StageTimer timer(METRIC_READBACK);
+			if (canvas && clear && target->sparse) {
+				// Everything but the drawn rectangles shows the background: read one pixel of it.
+				const size_t pixelBytes = pixelSize(format.format, format.type);
+				glPixelStorei(GL_PACK_ALIGNMENT, 1);
+				glReadPixels(0, 0, 1, 1, format.format, format.type, canvas->frame.data());
+				for (size_t offset = pixelBytes; offset < frameBytes; offset += pixelBytes) {
+					memcpy(&canvas->frame[offset], canvas->frame.data(), pixelBytes);
+				}
+				read = pixelBytes + readDamage(drawn.regions(), format.format, format.type, job.width,
+											   canvas->frame.data());
+			} else if (canvas) {
+				read = readDamage(damage.regions(), format.format, format.type, job.width, canvas->frame.data());
+			} else {
+				pixels.resize(frameBytes);
+				glReadPixels(0, 0, job.width, job.height, format.format, format.type, pixels.data());
+				read = frameBytes;
+				targets.release(target);
+			}
+			assertOpenGLError("server glReadPixels");
+		}
+		countMetric(METRIC_FRAMES);
+		countMetric(METRIC_READBACK_BYTES, read);
+		readbackBytes += read;
+		readbackBytesSaved += frameBytes - read;
+		return canvas ? canvas->frame.data() : pixels.data();
+	}
+
+	void record(double latency) {
+		jobs++;
+		busySeconds += latency / 1000.0;
+		latencies.push_back(latency);
+		if (latencies.size() > latencyWindow) {
+			latencies.pop_front();
+		}
+	}
+
+	const RenderServerOptions& options;
+	RenderTargetPool targets;
+	ImageEncoderPool encoders;				/* shared by every job's image writer */
+	std::vector<unsigned char> pixels;
+	std::vector<unsigned char> flipped;
+	std::vector<unsigned char> expanded;	/* RGBA8 copy for the image writer */
+	std::vector<unsigned char> delta;		/* delta records of a canvas job */
+	std::map<std::string, Canvas> canvases;
+	uint64_t readbackBytes;
+	uint64_t readbackBytesSaved;	/* frame bytes canvas jobs did not read back */
+	uint64_t outputBytesSaved;		/* frame bytes delta outputs did not send */
+
+	Clock::time_point started;
+	uint64_t jobs;
+	uint64_t errors;
+	double busySeconds;
+	std::deque<double> latencies;
+	bool stopping;
+};
+
+int listenUnixSocket(const std::string& path) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw runtime_error("render server: socket path too long: " + path);
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		throw runtime_error(std::string("render server: socket: ") + strerror(errno));
+	}
+	// Replace a stale socket of an earlier server, but never any other file.
+	struct stat status;
+	if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+		unlink(path.c_str());
+	}
+	if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 8) != 0) {
+		const std::string error = strerror(errno);
+		close(fd);
+		throw runtime_error("render server: cannot listen on " + path + ": " + error);
+	}
+	return fd;
+}
+
+}
+
+int RunRenderServer(const RenderServerOptions& options) {
+	// A client that disconnects early must fail the write, not kill the server.
+	signal(SIGPIPE, SIG_IGN);
+
+	RenderServer server(options);
+	GLsizei pageWidth, pageHeight;
+	if (options.sparseCanvases && !sparseRenderTargetPageSize(GL_RGBA8, pageWidth, pageHeight)) {
+		std::cerr << "Render server: no GL_ARB_sparse_texture, canvases are dense" << std::endl;
+	}
+	if (options.socketPath.empty()) {
+		Channel channel(STDIN_FILENO, STDOUT_FILENO);
+		server.serve(channel);
+	} else {
+		const int listener = listenUnixSocket(options.socketPath);
+		std::cerr << "Render server listening on " << options.socketPath << std::endl;
+		while (!server.stopped()) {
+			const int client = accept(listener, nullptr, nullptr);
+			if (client < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				close(listener);
+				throw runtime_error(std::string("render server: accept: ") + strerror(errno));
+			}
+			try {
+				Channel channel(client, client);
+				server.serve(channel);
+			} catch (const std::exception& ex) {
+				std::cerr << ex.what() << std::endl;
+			}
+			close(client);
+		}
+		close(listener);
+		unlink(options.socketPath.c_str());
+	}
+
+	std::cerr << "Render server: " << server.statistics() << std::endl;
+	return EXIT_SUCCESS;
+}
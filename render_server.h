@@ -0,0 +1,67 @@
+/*
+ * Batch render server: keeps one context, its render targets and the
+ * encoder warm, and renders jobs read from stdin or a local Unix socket.
+ *
+ * The protocol is line based. Each request is one line:
+ *
+ *   render [id=ID] [width=W] [height=H] [color=R,G,B,A] [format=F]
+ *          [rect=X,Y,W,H,R,G,B,A ...] [canvas=NAME [delta=1]] [output=FILE|-]
+ *   close NAME releases a canvas
+ *   stats
+ *   quit       closes the connection (ends the server on stdin)
+ *   shutdown   stops the server
+ *
+ * Colors are floats in 0-1, rects are filled with a scissored clear. F is
+ * the render target format (rgba8, r8, rg8, rgb565, rgba16f, ...; default
+ * rgba8). A render with output=FILE saves the image (format by extension)
+ * and answers
+ *
+ *   ok id=ID width=W height=H format=F bytes=N latency_ms=T
+ *
+ * where N is the size of the written file. With output=- the line is
+ * followed by N bytes of top-down pixels of F in the driver's preferred
+ * readback pair (see readbackFormat()) on the same stream; without output
+ * only the line is sent.
+ *
+ * A job with canvas=NAME draws over the target left by the previous job on
+ * that canvas instead of a cleared one. Its width, height and format default
+ * to the canvas's current ones; the first job, an explicitly different size
+ * or format, or an explicit color clears it. Only the rectangles the job
+ * changed are read back (see DamageTracker), and the ok line adds
+ * "damage=K damage_pixels=P". With delta=1 and output=-, the N bytes are the
+ * K delta records of appendDeltaRecords() instead of the full frame. With
+ * RenderServerOptions::sparseCanvases, canvases are sparse render targets
+ * that only commit memory for the pages their rects touch.
+ *
+ * Failures answer "error id=ID message" and the server carries on with the
+ * next job. stats answers with the job count, jobs/s over the time spent
+ * rendering, latency percentiles and the committed and virtual render target
+ * memory, the memory per format, and the bytes read back and saved by
+ * partial readbacks and delta outputs.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_RENDER_SERVER_H
+#define EGL_OFFSCREEN_RENDER_SERVER_H
+
+#include <cstddef>
+#include <string>
+
+#include "image_writer.h"
+
+struct RenderServerOptions {
+	std::string socketPath;		/* Unix socket to listen on, empty to serve stdin/stdout */
+	ImageWriterOptions image;	/* format is chosen per job from the output path */
+	size_t targetBudget = 0;	/* render target pool budget, 0 for the default */
+	bool sparseCanvases = false;	/* commit canvas memory per page where supported */
+};
+
+/*
+ * Serve render jobs on the current context until shutdown, or until stdin
+ * ends. Prints the final statistics to stderr.
+ */
+int RunRenderServer(const RenderServerOptions& options);
+
+#endif
@@ -0,0 +1,537 @@
+/*
+ * Render target pool with LRU eviction under a memory budget.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "render_target_pool.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "gl_extensions.h"
+
+using namespace std;
+
+
+size_t internalFormatSize(GLenum internalFormat) {
+	switch (internalFormat) {
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_RGB565:
+	case GL_R16F:
+		return 2;
+	case GL_RGB8:
+		return 3;
+	case GL_RGBA8:
+	case GL_SRGB8_ALPHA8:
+	case GL_RGB10_A2:
+	case GL_RG16F:
+	case GL_R32F:
+		return 4;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		std::ostringstream s;
+		s << "RenderTargetPool: unsupported internal format 0x" << std::hex << internalFormat;
+		throw runtime_error(s.str());
+	}
+}
+
+static const RenderFormat renderFormats[] = {
+	{"r8", GL_R8, GL_RED, GL_UNSIGNED_BYTE},
+	{"rg8", GL_RG8, GL_RG, GL_UNSIGNED_BYTE},
+	{"rgb565", GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5},
+	{"rgb8", GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE},
+	{"rgba8", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+	{"srgb8_alpha8", GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE},
+	{"rgb10_a2", GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV},
+	{"r16f", GL_R16F, GL_RED, GL_HALF_FLOAT},
+	{"rg16f", GL_RG16F, GL_RG, GL_HALF_FLOAT},
+	{"rgba16f", GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT},
+	{"r32f", GL_R32F, GL_RED, GL_FLOAT},
+	{"rg32f", GL_RG32F, GL_RG, GL_FLOAT},
+	{"rgba32f", GL_RGBA32F, GL_RGBA, GL_FLOAT},
+};
+
+const RenderFormat& renderFormat(GLenum internalFormat) {
+	for (const RenderFormat& format : renderFormats) {
+		if (format.internalFormat == internalFormat) {
+			return format;
+		}
+	}
+	std::ostringstream s;
+	s << "RenderTargetPool: unsupported internal format 0x" << std::hex << internalFormat;
+	throw runtime_error(s.str());
+}
+
+const RenderFormat& parseRenderFormat(const std::string& name) {
+	for (const RenderFormat& format : renderFormats) {
+		if (name == format.name) {
+			return format;
+		}
+	}
+	throw runtime_error("Unknown render target format: " + name);
+}
+
+std::vector<RenderFormat> renderFormatList() {
+	return std::vector<RenderFormat>(std::begin(renderFormats), std::end(renderFormats));
+}
+
+/*
+ * A format/type pair glTexImage2D accepts for each internal format. No data
+ * is uploaded, but the pair still has to be valid.
+ */
+static void uploadFormat(GLenum internalFormat, GLenum& format, GLenum& type) {
+	switch (internalFormat) {
+	case GL_R8:
+		format = GL_RED, type = GL_UNSIGNED_BYTE;
+		break;
+	case GL_RG8:
+		format = GL_RG, type = GL_UNSIGNED_BYTE;
+		break;
+	case GL_RGB565:
+		format = GL_RGB, type = GL_UNSIGNED_SHORT_5_6_5;
+		break;
+	case GL_RGB8:
+		format = GL_RGB, type = GL_UNSIGNED_BYTE;
+		break;
+	case GL_R16F:
+	case GL_R32F:
+		format = GL_RED, type = GL_FLOAT;
+		break;
+	case GL_RG16F:
+	case GL_RG32F:
+		format = GL_RG, type = GL_FLOAT;
+		break;
+	case GL_RGBA16F:
+	case GL_RGBA32F:
+		format = GL_RGBA, type = GL_FLOAT;
+		break;
+	default:
+		format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+		break;
+	}
+}
+
+static GLsizei roundUp(GLsizei value, GLsizei multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+size_t availableRenderMemory() {
+	GLint kilobytes[4] = {0, 0, 0, 0};
+	if (isGlextSupported("GL_NVX_gpu_memory_info")) {
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, kilobytes);
+	} else if (isGlextSupported("GL_ATI_meminfo")) {
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kilobytes);
+	}
+	if (kilobytes[0] > 0) {
+		return (size_t)kilobytes[0] * 1024;
+	}
+
+	const long pages = sysconf(_SC_AVPHYS_PAGES);
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	if (pages > 0 && pageSize > 0) {
+		return (size_t)pages * pageSize;
+	}
+	return (size_t)256 << 20;
+}
+
+size_t defaultRenderTargetBudget() {
+	return availableRenderMemory() / 2;
+}
+
+size_t maxRenderTargetLayers(bool multiview) {
+	GLint layers = 0;
+	if (multiview) {
+		if (isGlextSupported("GL_OVR_multiview")) {
+			glGetIntegerv(GL_MAX_VIEWS_OVR, &layers);
+		}
+	} else {
+		GLint arrayLayers = 0, framebufferLayers = 0;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &arrayLayers);
+		glGetIntegerv(GL_MAX_FRAMEBUFFER_LAYERS, &framebufferLayers);
+		layers = std::min(arrayLayers, framebufferLayers);
+	}
+	assertOpenGLError("maxRenderTargetLayers");
+	return (size_t)std::max(layers, 0);
+}
+
+bool sparseRenderTargetPageSize(GLenum internalFormat, GLsizei& pageWidth, GLsizei& pageHeight) {
+	if (!isGlextSupported("GL_ARB_sparse_texture")) {
+		return false;
+	}
+	GLint sizes = 0, x = 0, y = 0;
+	glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &sizes);
+	if (sizes > 0) {
+		// The first page size is the one the texture gets with GL_VIRTUAL_PAGE_SIZE_INDEX_ARB 0.
+		glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_VIRTUAL_PAGE_SIZE_X_ARB, 1, &x);
+		glGetInternalformativ(GL_TEXTURE_2D, internalFormat, GL_VIRTUAL_PAGE_SIZE_Y_ARB, 1, &y);
+	}
+	assertOpenGLError("sparseRenderTargetPageSize");
+	if (x <= 0 || y <= 0) {
+		return false;
+	}
+	pageWidth = x;
+	pageHeight = y;
+	return true;
+}
+
+size_t RenderTargetPool::KeyHash::operator()(const RenderTargetKey& key) const {
+	size_t hash = (size_t)key.width;
+	hash = hash * 31 + (size_t)key.height;
+	hash = hash * 31 + (size_t)key.internalFormat;
+	hash = hash * 31 + (size_t)key.samples;
+	hash = hash * 31 + (size_t)key.layers * 2 + (key.multiview ? 1 : 0);
+	hash = hash * 2 + (key.sparse ? 1 : 0);
+	return hash;
+}
+
+RenderTargetPool::RenderTargetPool(size_t budgetBytes) : stats() {
+	GLint maxRenderbufferSize = 0, maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	assertOpenGLError("RenderTargetPool limits");
+	maxSize = std::min(maxRenderbufferSize, maxTextureSize);
+
+	stats.budgetBytes =
+		budgetBytes == 0 ? defaultRenderTargetBudget() : std::min(budgetBytes, availableRenderMemory());
+}
+
+RenderTargetPool::~RenderTargetPool() {
+	trim();
+	for (RenderTarget* target : inUse) {
+		destroy(target);
+	}
+}
+
+RenderTarget* RenderTargetPool::acquire(const RenderTargetKey& key) {
+	auto found = idleByKey.find(key);
+	if (found != idleByKey.end()) {
+		RenderTarget* target = *found->second;
+		idle.erase(found->second);
+		idleByKey.erase(found);
+		inUse.insert(target);
+		stats.hits++;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target->frameBuffer);
+		assertOpenGLError("RenderTargetPool glBindFramebuffer");
+		return target;
+	}
+
+	if (key.width <= 0 || key.height <= 0 || key.width > maxSize || key.height > maxSize) {
+		throw runtime_error("RenderTargetPool: " + to_string(key.width) + "x" + to_string(key.height) +
+							" exceeds the maximum render target size " + to_string(maxSize));
+	}
+	if (key.layers > 0 && key.samples > 0) {
+		throw runtime_error("RenderTargetPool: layered targets cannot be multisampled");
+	}
+	if (key.layers > 0 && (size_t)key.layers > maxRenderTargetLayers(key.multiview)) {
+		throw runtime_error("RenderTargetPool: " + to_string(key.layers) + " layers exceed the limit of " +
+							to_string(maxRenderTargetLayers(key.multiview)));
+	}
+	if (key.sparse && (key.layers > 0 || key.samples > 0)) {
+		throw runtime_error("RenderTargetPool: only single-sample 2D targets can be sparse");
+	}
+
+	// Sparse targets start without committed memory and round up to whole pages.
+	GLsizei pageWidth = 0, pageHeight = 0;
+	bool sparse = key.sparse && sparseRenderTargetPageSize(key.internalFormat, pageWidth, pageHeight);
+	if (sparse) {
+		GLint maxSparseSize = 0;
+		glGetIntegerv(GL_MAX_SPARSE_TEXTURE_SIZE_ARB, &maxSparseSize);
+		sparse = roundUp(key.width, pageWidth) <= maxSparseSize && roundUp(key.height, pageHeight) <= maxSparseSize;
+	}
+	const size_t pixelBytes = internalFormatSize(key.internalFormat);
+	const size_t virtualBytes =
+		sparse ? (size_t)roundUp(key.width, pageWidth) * roundUp(key.height, pageHeight) * pixelBytes
+			   : (size_t)key.width * key.height * pixelBytes * std::max<GLsizei>(key.samples, 1) *
+					 std::max<GLsizei>(key.layers, 1);
+	const size_t bytes = sparse ? 0 : virtualBytes;
+	evictUntil(stats.budgetBytes > bytes ? stats.budgetBytes - bytes : 0);
+
+	RenderTarget* target = allocate(key, bytes, sparse ? pageWidth : 0, sparse ? pageHeight : 0);
+	target->virtualBytes = virtualBytes;
+	inUse.insert(target);
+	stats.misses++;
+	stats.residentBytes += bytes;
+	stats.virtualBytes += virtualBytes;
+	stats.residentTargets++;
+	stats.peakResidentBytes = std::max(stats.peakResidentBytes, stats.residentBytes);
+	return target;
+}
+
+void RenderTargetPool::release(RenderTarget* target) {
+	if (inUse.erase(target) == 0) {
+		throw runtime_error("RenderTargetPool: released a target that is not in use");
+	}
+	idle.push_front(target);
+	idleByKey.insert(std::make_pair(target->key, idle.begin()));
+	evictUntil(stats.budgetBytes);
+}
+
+std::vector<RenderTargetPool::FormatUsage> RenderTargetPool::usageByFormat() const {
+	std::map<GLenum, FormatUsage> usage;
+	auto add = [&usage](const RenderTarget* target) {
+		FormatUsage& entry = usage[target->key.internalFormat];
+		entry.internalFormat = target->key.internalFormat;
+		entry.targets++;
+		entry.bytes += target->bytes;
+		entry.virtualBytes += target->virtualBytes;
+	};
+	for (const RenderTarget* target : idle) {
+		add(target);
+	}
+	for (const RenderTarget* target : inUse) {
+		add(target);
+	}
+
+	std::vector<FormatUsage> result;
+	for (const auto& entry : usage) {
+		result.push_back(entry.second);
+	}
+	return result;
+}
+
+void RenderTargetPool::commit(RenderTarget* target, GLint x, GLint y, GLsizei width, GLsizei height,
+							  const GLfloat background[4]) {
+	glBindFramebuffer(GL_FRAMEBUFFER, target->frameBuffer);
+	if (!target->sparse) {
+		return;
+	}
+	const GLint x0 = std::max(x, 0), y0 = std::max(y, 0);
+	const GLint x1 = std::min(x + width, target->key.width), y1 = std::min(y + height, target->key.height);
+	if (x1 <= x0 || y1 <= y0) {
+		return;
+	}
+
+	const GLsizei columns = roundUp(target->key.width, target->pageWidth) / target->pageWidth;
+	const GLint firstColumn = x0 / target->pageWidth, lastColumn = (x1 - 1) / target->pageWidth;
+	const GLint firstRow = y0 / target->pageHeight, lastRow = (y1 - 1) / target->pageHeight;
+
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+	GLint box[4];
+	GLfloat color[4];
+	glGetIntegerv(GL_SCISSOR_BOX, box);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, color);
+	glEnable(GL_SCISSOR_TEST);
+	glClearColor(background[0], background[1], background[2], background[3]);
+
+	// Commit each run of uncommitted pages of a row with one call, and clear it.
+	for (GLint row = firstRow; row <= lastRow; row++) {
+		GLint column = firstColumn;
+		while (column <= lastColumn) {
+			if (target->committedPages[row * columns + column]) {
+				column++;
+				continue;
+			}
+			GLint end = column;
+			while (end <= lastColumn && !target->committedPages[row * columns + end]) {
+				end++;
+			}
+			commitPages(target, column, row, end - column, true);
+			glScissor(column * target->pageWidth, row * target->pageHeight, (end - column) * target->pageWidth,
+					  target->pageHeight);
+			glClear(GL_COLOR_BUFFER_BIT);
+			column = end;
+		}
+	}
+
+	if (!scissor) {
+		glDisable(GL_SCISSOR_TEST);
+	}
+	glScissor(box[0], box[1], box[2], box[3]);
+	glClearColor(color[0], color[1], color[2], color[3]);
+	assertOpenGLError("RenderTargetPool commit");
+}
+
+void RenderTargetPool::decommit(RenderTarget* target) {
+	if (!target->sparse) {
+		return;
+	}
+	const GLsizei columns = roundUp(target->key.width, target->pageWidth) / target->pageWidth;
+	const GLsizei rows = roundUp(target->key.height, target->pageHeight) / target->pageHeight;
+	for (GLint row = 0; row < rows; row++) {
+		commitPages(target, 0, row, columns, false);
+	}
+	assertOpenGLError("RenderTargetPool decommit");
+}
+
+/*
+ * Commit or release a run of pages in one row and account for the memory.
+ * Committing evicts idle targets first to make room.
+ */
+void RenderTargetPool::commitPages(RenderTarget* target, GLint pageX, GLint pageY, GLsizei pages, bool commit) {
+	const GLsizei columns = roundUp(target->key.width, target->pageWidth) / target->pageWidth;
+	const size_t pageBytes =
+		(size_t)target->pageWidth * target->pageHeight * internalFormatSize(target->key.internalFormat);
+	size_t changed = 0;
+	for (GLint column = pageX; column < pageX + pages; column++) {
+		if (target->committedPages[pageY * columns + column] != commit) {
+			changed++;
+		}
+	}
+	if (changed == 0) {
+		return;
+	}
+	if (commit) {
+		evictUntil(stats.budgetBytes > changed * pageBytes ? stats.budgetBytes - changed * pageBytes : 0);
+	}
+
+	// Not exported by every libGL; sparseRenderTargetPageSize() made sure the extension exists.
+	static const PFNGLTEXPAGECOMMITMENTARBPROC pageCommitment =
+		(PFNGLTEXPAGECOMMITMENTARBPROC)eglGetProcAddress("glTexPageCommitmentARB");
+	glBindTexture(GL_TEXTURE_2D, target->texture);
+	pageCommitment(GL_TEXTURE_2D, 0, pageX * target->pageWidth, pageY * target->pageHeight, 0,
+				   pages * target->pageWidth, target->pageHeight, 1, commit ? GL_TRUE : GL_FALSE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	for (GLint column = pageX; column < pageX + pages; column++) {
+		target->committedPages[pageY * columns + column] = commit;
+	}
+	if (commit) {
+		target->bytes += changed * pageBytes;
+		stats.residentBytes += changed * pageBytes;
+		stats.peakResidentBytes = std::max(stats.peakResidentBytes, stats.residentBytes);
+	} else {
+		target->bytes -= changed * pageBytes;
+		stats.residentBytes -= changed * pageBytes;
+	}
+}
+
+void RenderTargetPool::trim() {
+	evictUntil(0);
+}
+
+/*
+ * Delete least recently used idle targets until at most bytes are resident
+ * or nothing idle is left.
+ */
+void RenderTargetPool::evictUntil(size_t bytes) {
+	while (stats.residentBytes > bytes && !idle.empty()) {
+		IdleList::iterator last = std::prev(idle.end());
+		RenderTarget* target = *last;
+
+		auto range = idleByKey.equal_range(target->key);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == last) {
+				idleByKey.erase(it);
+				break;
+			}
+		}
+		idle.erase(last);
+
+		stats.residentBytes -= target->bytes;
+		stats.virtualBytes -= target->virtualBytes;
+		stats.residentTargets--;
+		stats.evictions++;
+		destroy(target);
+	}
+}
+
+RenderTarget* RenderTargetPool::allocate(const RenderTargetKey& key, size_t bytes, GLsizei pageWidth,
+										 GLsizei pageHeight) {
+	RenderTarget* target = new RenderTarget();
+	target->key = key;
+	target->bytes = bytes;
+
+	/*
+	 * Create an OpenGL framebuffer as render target.
+	 */
+	glGenFramebuffers(1, &target->frameBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->frameBuffer);
+
+	/*
+	 * Create the color attachment: a texture, or a renderbuffer when
+	 * multisampled, since those are resolved with a blit anyway.
+	 */
+	if (key.layers > 0) {
+		GLenum format, type;
+		uploadFormat(key.internalFormat, format, type);
+
+		glGenTextures(1, &target->texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, target->texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, key.internalFormat, key.width, key.height, key.layers, 0, format, type,
+					 nullptr);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		if (key.multiview) {
+			// Not exported by every libGL; maxRenderTargetLayers() made sure the extension exists.
+			const PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC attachViews =
+				(PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)eglGetProcAddress("glFramebufferTextureMultiviewOVR");
+			attachViews(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target->texture, 0, 0, key.layers);
+		} else {
+			// All layers at once; gl_Layer selects the one a primitive goes to.
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target->texture, 0);
+		}
+	} else if (pageWidth > 0) {
+		// Whole pages of address space, none committed yet; storage must be immutable.
+		const GLsizei width = roundUp(key.width, pageWidth), height = roundUp(key.height, pageHeight);
+		target->sparse = true;
+		target->pageWidth = pageWidth;
+		target->pageHeight = pageHeight;
+		target->committedPages.assign((size_t)(width / pageWidth) * (height / pageHeight), false);
+
+		glGenTextures(1, &target->texture);
+		glBindTexture(GL_TEXTURE_2D, target->texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+		glTexParameteri(GL_TEXTURE_2D, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, 0);
+		glTexStorage2D(GL_TEXTURE_2D, 1, key.internalFormat, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+	} else if (key.samples == 0) {
+		GLenum format, type;
+		uploadFormat(key.internalFormat, format, type);
+
+		glGenTextures(1, &target->texture);
+		glBindTexture(GL_TEXTURE_2D, target->texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, key.internalFormat, key.width, key.height, 0, format, type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+	} else {
+		glGenRenderbuffers(1, &target->renderBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, target->renderBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, key.samples, key.internalFormat, key.width, key.height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->renderBuffer);
+	}
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+	try {
+		assertOpenGLError("RenderTargetPool allocate");
+		const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			std::ostringstream s;
+			s << "RenderTargetPool: incomplete framebuffer, status 0x" << std::hex << status;
+			throw runtime_error(s.str());
+		}
+	} catch (...) {
+		destroy(target);
+		throw;
+	}
+	return target;
+}
+
+void RenderTargetPool::destroy(RenderTarget* target) {
+	glDeleteFramebuffers(1, &target->frameBuffer);
+	if (target->texture) {
+		glDeleteTextures(1, &target->texture);
+	}
+	if (target->renderBuffer) {
+		glDeleteRenderbuffers(1, &target->renderBuffer);
+	}
+	delete target;
+}
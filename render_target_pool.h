@@ -0,0 +1,215 @@
+/*
+ * Pool of framebuffers with their color attachment, recycled by size and
+ * format so a job loop does not reallocate GPU memory for every frame.
+ *
+ * Released targets stay resident in least-recently-used order and are handed
+ * out again to the next acquire() with the same key. When allocating a new
+ * target would exceed the memory budget, the least recently used idle targets
+ * are deleted first. Targets in use are never evicted, so a single request
+ * larger than the budget still succeeds.
+ *
+ * Sparse targets (RenderTargetKey::sparse) use GL_ARB_sparse_texture: the
+ * texture reserves address space for the whole frame, but memory is only
+ * committed for the pages commit() is asked to back, so a large canvas that
+ * mostly shows its background costs little more than the parts drawn on. The
+ * budget counts committed bytes. Where the extension or a page size for the
+ * format is missing the target is allocated dense and commit() does nothing,
+ * so callers need no second path.
+ *
+ * GL objects belong to the context that created them: use one pool per
+ * context and only call it while that context is current.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_RENDER_TARGET_POOL_H
+#define EGL_OFFSCREEN_RENDER_TARGET_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gl_common.h"
+
+struct RenderTargetKey {
+	GLsizei width, height;
+	GLenum internalFormat;	/* sized format, e.g. GL_RGBA8 */
+	GLsizei samples;		/* 0 for a texture, otherwise a multisampled renderbuffer */
+	GLsizei layers;			/* 0 for a GL_TEXTURE_2D, otherwise the layers of a GL_TEXTURE_2D_ARRAY */
+	bool multiview;			/* attach the layers as GL_OVR_multiview views instead of layered */
+	bool sparse;			/* commit memory per page where supported; single-sample 2D targets only */
+
+	bool operator==(const RenderTargetKey& other) const {
+		return width == other.width && height == other.height && internalFormat == other.internalFormat &&
+			   samples == other.samples && layers == other.layers && multiview == other.multiview &&
+			   sparse == other.sparse;
+	}
+};
+
+/*
+ * Key of a plain single-sample GL_TEXTURE_2D target.
+ */
+inline RenderTargetKey renderTargetKey(GLsizei width, GLsizei height, GLenum internalFormat) {
+	const RenderTargetKey key = {width, height, internalFormat, 0, 0, false, false};
+	return key;
+}
+
+struct RenderTarget {
+	RenderTargetKey key;
+	GLuint frameBuffer;
+	GLuint texture;			/* color attachment if key.samples == 0, GL_TEXTURE_2D_ARRAY if key.layers > 0 */
+	GLuint renderBuffer;	/* color attachment if key.samples > 0 */
+	size_t bytes;			/* estimated committed size of the color attachment */
+	size_t virtualBytes;	/* size the attachment spans, equal to bytes unless sparse */
+	bool sparse;			/* key.sparse and the driver supports it */
+	GLsizei pageWidth, pageHeight;		/* virtual page size if sparse */
+	std::vector<bool> committedPages;	/* row by row from the bottom, if sparse */
+};
+
+/*
+ * Bytes per pixel of a sized color format. Throws for formats the pool
+ * cannot allocate.
+ */
+size_t internalFormatSize(GLenum internalFormat);
+
+/*
+ * A color format render targets can be created in, with the glReadPixels
+ * format/type pair that returns its pixels at full precision.
+ */
+struct RenderFormat {
+	const char* name;		/* "rgba8", "r8", "rgb565", "rgba16f", ... */
+	GLenum internalFormat;
+	GLenum format, type;
+};
+
+/*
+ * Look up a format by internal format or by name. Both throw for formats
+ * the pool cannot allocate.
+ */
+const RenderFormat& renderFormat(GLenum internalFormat);
+const RenderFormat& parseRenderFormat(const std::string& name);
+
+/*
+ * Every format render targets can be created in.
+ */
+std::vector<RenderFormat> renderFormatList();
+
+/*
+ * Memory the current context could still allocate: the free video memory
+ * reported by GL_NVX_gpu_memory_info or GL_ATI_meminfo, otherwise the
+ * available physical memory, which is where software renderers allocate.
+ */
+size_t availableRenderMemory();
+
+/*
+ * Budget used when none is given: half of availableRenderMemory().
+ */
+size_t defaultRenderTargetBudget();
+
+/*
+ * Most layers a layered target can have: GL_MAX_VIEWS_OVR for multiview, 0
+ * without GL_OVR_multiview; otherwise the smaller of
+ * GL_MAX_ARRAY_TEXTURE_LAYERS and GL_MAX_FRAMEBUFFER_LAYERS.
+ */
+size_t maxRenderTargetLayers(bool multiview);
+
+/*
+ * Whether targets of internalFormat can be sparse: GL_ARB_sparse_texture with
+ * a virtual page size for the format. Sets the page size if so.
+ */
+bool sparseRenderTargetPageSize(GLenum internalFormat, GLsizei& pageWidth, GLsizei& pageHeight);
+
+class RenderTargetPool {
+public:
+	struct Statistics {
+		uint64_t hits;			/* acquire() served from an idle target */
+		uint64_t misses;		/* acquire() had to allocate */
+		uint64_t evictions;		/* idle targets deleted to stay within the budget */
+		size_t residentBytes;	/* committed memory of idle and in-use targets */
+		size_t virtualBytes;	/* what they would take if none were sparse */
+		size_t peakResidentBytes;
+		size_t residentTargets;
+		size_t budgetBytes;
+	};
+
+	struct FormatUsage {
+		GLenum internalFormat;
+		size_t targets;		/* idle and in-use */
+		size_t bytes;
+		size_t virtualBytes;
+	};
+
+	/*
+	 * budgetBytes of 0 selects defaultRenderTargetBudget(); larger budgets are
+	 * capped at the available memory. Requires a current context.
+	 */
+	explicit RenderTargetPool(size_t budgetBytes = 0);
+	~RenderTargetPool();
+
+	RenderTargetPool(const RenderTargetPool&) = delete;
+	RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+	/*
+	 * Return a complete framebuffer for key and bind it as GL_FRAMEBUFFER.
+	 * Throws if the size exceeds GL_MAX_RENDERBUFFER_SIZE or
+	 * GL_MAX_TEXTURE_SIZE, the layers maxRenderTargetLayers(), or the
+	 * framebuffer is incomplete.
+	 */
+	RenderTarget* acquire(const RenderTargetKey& key);
+
+	/*
+	 * Hand a target back for reuse. Its contents are undefined on the next
+	 * acquire().
+	 */
+	void release(RenderTarget* target);
+
+	/*
+	 * Back the pages of a sparse target that cover the rectangle with memory,
+	 * evicting idle targets if that exceeds the budget. Newly committed pages
+	 * are cleared to background, the color of the undrawn canvas; pages already
+	 * committed keep their contents. Leaves target bound as GL_FRAMEBUFFER.
+	 * Dense targets are always committed, so for them this only binds.
+	 */
+	void commit(RenderTarget* target, GLint x, GLint y, GLsizei width, GLsizei height, const GLfloat background[4]);
+
+	/*
+	 * Release all pages of a sparse target; a no-op for dense targets.
+	 */
+	void decommit(RenderTarget* target);
+
+	/*
+	 * Delete all idle targets.
+	 */
+	void trim();
+
+	const Statistics& statistics() const { return stats; }
+
+	/*
+	 * Resident targets and memory per internal format, in ascending enum order.
+	 */
+	std::vector<FormatUsage> usageByFormat() const;
+
+private:
+	struct KeyHash {
+		size_t operator()(const RenderTargetKey& key) const;
+	};
+	typedef std::list<RenderTarget*> IdleList;
+
+	RenderTarget* allocate(const RenderTargetKey& key, size_t bytes, GLsizei pageWidth, GLsizei pageHeight);
+	void destroy(RenderTarget* target);
+	void evictUntil(size_t bytes);
+	void commitPages(RenderTarget* target, GLint pageX, GLint pageY, GLsizei pages, bool commit);
+
+	IdleList idle;	/* most recently released first */
+	std::unordered_multimap<RenderTargetKey, IdleList::iterator, KeyHash> idleByKey;
+	std::unordered_set<RenderTarget*> inUse;
+	GLint maxSize;
+	Statistics stats;
+};
+
+#endif
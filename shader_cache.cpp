@@ -0,0 +1,354 @@
+/*
+ * Shader program binary cache.
+ *
+ * Cache file layout, native endianness:
+ *
+ *	char     magic[8]		"GLPROG\0\1"
+ *	uint32_t binaryFormat
+ *	uint32_t fingerprintLength, binaryLength
+ *	char     fingerprint[fingerprintLength]
+ *	uint8_t  binary[binaryLength]
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "shader_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capability_cache.h"
+#include "gl_extensions.h"
+
+using namespace std;
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char programMagic[8] = {'G', 'L', 'P', 'R', 'O', 'G', '\0', '\1'};
+
+struct ProgramHeader {
+	char magic[8];
+	uint32_t binaryFormat;
+	uint32_t fingerprintLength;
+	uint32_t binaryLength;
+};
+
+double millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+ * 64-bit FNV-1a, continued from hash.
+ */
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string infoLog(GLuint object, bool program) {
+	GLint length = 0;
+	if (program) {
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+	} else {
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+	}
+	std::string log(std::max(length, 1), '\0');
+	if (program) {
+		glGetProgramInfoLog(object, length, nullptr, &log[0]);
+	} else {
+		glGetShaderInfoLog(object, length, nullptr, &log[0]);
+	}
+	log.resize(strlen(log.c_str()));
+	return log;
+}
+
+/*
+ * Queue the compile and link of sources; the result is only checked by
+ * finishProgram(), so the driver can compile in the background.
+ */
+GLuint startProgram(const std::vector<ShaderSource>& sources, bool retrievable, std::vector<GLuint>& shaders) {
+	const GLuint program = glCreateProgram();
+	for (const ShaderSource& source : sources) {
+		const GLuint shader = glCreateShader(source.type);
+		const char* text = source.source.c_str();
+		glShaderSource(shader, 1, &text, nullptr);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		shaders.push_back(shader);
+	}
+	if (retrievable) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(program);
+	return program;
+}
+
+/*
+ * Wait for the link status, release the shaders and throw with the info
+ * log if the program failed to build.
+ */
+void finishProgram(const std::string& name, GLuint program, const std::vector<GLuint>& shaders) {
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	std::string log;
+	if (!linked) {
+		// The link log rarely says more than "failed"; the compile logs do.
+		for (GLuint shader : shaders) {
+			GLint compiled = GL_FALSE;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+			if (!compiled) {
+				log += infoLog(shader, false);
+			}
+		}
+		log += infoLog(program, true);
+	}
+
+	for (GLuint shader : shaders) {
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+	}
+	if (!linked) {
+		glDeleteProgram(program);
+		throw runtime_error("Shader program " + name + " failed to build:\n" + log);
+	}
+	assertOpenGLError("finishProgram");
+}
+
+}
+
+
+std::string defaultShaderCacheDirectory() {
+	return defaultCacheDirectory() + "/egl_opengl_test_shaders";
+}
+
+ShaderProgramCache::ShaderProgramCache(const std::string& directory, EGLDisplay display, GLuint compilerThreads)
+	: fingerprint(capabilityFingerprint(display)), parallelCompile(false), stats() {
+	GLint formats = 0;
+	if (isGlextSupported("GL_ARB_get_program_binary")) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	if (formats > 0 && !directory.empty()) {
+		binaryFormats.resize(formats);
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, binaryFormats.data());
+		this->directory = directory;
+		mkdir(directory.c_str(), 0755);
+	}
+
+	if (isGlextSupported("GL_ARB_parallel_shader_compile")) {
+		glMaxShaderCompilerThreadsARB(compilerThreads);
+		parallelCompile = compilerThreads > 0;
+	}
+	assertOpenGLError("ShaderProgramCache");
+}
+
+ShaderProgramCache::~ShaderProgramCache() {
+	for (Entry& entry : entries) {
+		for (GLuint shader : entry.shaders) {
+			glDeleteShader(shader);
+		}
+		glDeleteProgram(entry.program);
+	}
+}
+
+ShaderProgramCache::Handle ShaderProgramCache::submit(const std::string& name,
+													  const std::vector<ShaderSource>& sources) {
+	Entry entry;
+	entry.name = name;
+	entry.program = 0;
+	entry.cached = false;
+	entry.linked = false;
+	entry.submitted = Clock::now();
+	entry.readyMs = -1;
+	if (entries.empty()) {
+		firstSubmit = entry.submitted;
+	}
+
+	if (persistent()) {
+		entry.path = cachePath(sources);
+		entry.program = load(entry.path);
+	}
+	if (entry.program) {
+		entry.cached = true;
+		entry.linked = true;
+	} else {
+		entry.program = startProgram(sources, persistent(), entry.shaders);
+	}
+
+	entries.push_back(entry);
+	if (entry.cached) {
+		markReady(entries.back());
+	}
+	return entries.size() - 1;
+}
+
+bool ShaderProgramCache::ready(Handle handle) {
+	Entry& entry = entries.at(handle);
+	if (entry.readyMs < 0) {
+		GLint done = GL_TRUE;
+		if (parallelCompile) {
+			glGetProgramiv(entry.program, GL_COMPLETION_STATUS_ARB, &done);
+		}
+		if (!done) {
+			return false;
+		}
+		markReady(entry);
+	}
+	return true;
+}
+
+GLuint ShaderProgramCache::program(Handle handle) {
+	Entry& entry = entries.at(handle);
+	if (!entry.linked) {
+		entry.linked = true;
+		const std::vector<GLuint> shaders = entry.shaders;
+		entry.shaders.clear();
+		try {
+			finishProgram(entry.name, entry.program, shaders);
+		} catch (...) {
+			entry.program = 0;
+			throw;
+		}
+		markReady(entry);
+		stats.compiled++;
+		stats.compileMs += entry.readyMs;
+
+		if (!entry.path.empty()) {
+			store(entry.path, entry.program);
+		}
+	}
+	if (!entry.program) {
+		throw runtime_error("Shader program " + entry.name + " failed to build");
+	}
+	return entry.program;
+}
+
+GLuint ShaderProgramCache::program(const std::string& name, const std::vector<ShaderSource>& sources) {
+	return program(submit(name, sources));
+}
+
+std::vector<ShaderProgramCache::ProgramTiming> ShaderProgramCache::timings() const {
+	std::vector<ProgramTiming> result;
+	for (const Entry& entry : entries) {
+		const ProgramTiming timing = {entry.name, entry.cached, entry.readyMs};
+		result.push_back(timing);
+	}
+	return result;
+}
+
+void ShaderProgramCache::markReady(Entry& entry) {
+	if (entry.readyMs < 0) {
+		const Clock::time_point now = Clock::now();
+		entry.readyMs = std::chrono::duration<double, std::milli>(now - entry.submitted).count();
+		stats.wallMs = std::chrono::duration<double, std::milli>(now - firstSubmit).count();
+	}
+}
+
+std::string ShaderProgramCache::cachePath(const std::vector<ShaderSource>& sources) const {
+	uint64_t hash = fnv1a(fingerprint.data(), fingerprint.size());
+	for (const ShaderSource& source : sources) {
+		hash = fnv1a(&source.type, sizeof(source.type), hash);
+		hash = fnv1a(source.source.data(), source.source.size() + 1, hash);
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+	return directory + "/" + name;
+}
+
+/*
+ * Restore the program cached at path. Returns 0 if there is none, or the
+ * driver does not accept it any more.
+ */
+GLuint ShaderProgramCache::load(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return 0;
+	}
+
+	ProgramHeader header;
+	std::vector<unsigned char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, programMagic, 8) == 0 &&
+				 header.fingerprintLength == fingerprint.size();
+	if (valid) {
+		std::string stored(header.fingerprintLength, '\0');
+		binary.resize(header.binaryLength);
+		valid = fread(&stored[0], 1, stored.size(), file) == stored.size() && stored == fingerprint &&
+				fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	// An unknown format would raise GL_INVALID_ENUM; treat it like a rejected binary.
+	valid = valid && std::find(binaryFormats.begin(), binaryFormats.end(), (GLint)header.binaryFormat) !=
+						 binaryFormats.end();
+
+	GLuint program = 0;
+	if (valid) {
+		const Clock::time_point start = Clock::now();
+		program = glCreateProgram();
+		glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		stats.loadMs += millisecondsSince(start);
+		if (!linked) {
+			glDeleteProgram(program);
+			program = 0;
+			valid = false;
+		}
+	}
+
+	if (!valid) {
+		stats.rejected++;
+		unlink(path.c_str());
+		return 0;
+	}
+	assertOpenGLError("glProgramBinary");
+	stats.loaded++;
+	return program;
+}
+
+void ShaderProgramCache::store(const std::string& path, GLuint program) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<unsigned char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	assertOpenGLError("glGetProgramBinary");
+
+	// Write to a temporary file and rename, so concurrent readers never see a partial binary.
+	const std::string temporary = path + ".tmp." + std::to_string(getpid());
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		return;
+	}
+
+	ProgramHeader header;
+	memcpy(header.magic, programMagic, 8);
+	header.binaryFormat = format;
+	header.fingerprintLength = (uint32_t)fingerprint.size();
+	header.binaryLength = (uint32_t)length;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+				   fwrite(fingerprint.data(), 1, fingerprint.size(), file) == fingerprint.size() &&
+				   fwrite(binary.data(), 1, length, file) == (size_t)length;
+	written = fclose(file) == 0 && written;
+
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return;
+	}
+	stats.stored++;
+}
@@ -0,0 +1,129 @@
+/*
+ * Shader programs with a persistent cache of their linked binaries.
+ *
+ * Programs are built from GLSL sources. With GL_ARB_get_program_binary the
+ * linked program is saved with glGetProgramBinary to one file per program,
+ * named by a hash of the sources and the driver fingerprint (GL_RENDERER,
+ * GL_VERSION, EGL vendor). Later runs load it with glProgramBinary instead of
+ * compiling; a binary the driver rejects, e.g. after a driver update that
+ * kept the version string, is dropped and the program compiled from source
+ * and cached again.
+ *
+ * With GL_ARB_parallel_shader_compile, programs are submitted up front and
+ * compile on the driver's threads; ready() polls GL_COMPLETION_STATUS_ARB so
+ * the caller can keep rendering with the programs that are already done.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_SHADER_CACHE_H
+#define EGL_OFFSCREEN_SHADER_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gl_common.h"
+
+struct ShaderSource {
+	GLenum type;	/* GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_COMPUTE_SHADER, ... */
+	std::string source;
+};
+
+/*
+ * Default cache directory, in defaultCacheDirectory().
+ */
+std::string defaultShaderCacheDirectory();
+
+class ShaderProgramCache {
+public:
+	struct Statistics {
+		uint64_t loaded;	/* programs restored from a cached binary */
+		uint64_t compiled;	/* programs compiled from source */
+		uint64_t rejected;	/* cached binaries the driver refused */
+		uint64_t stored;	/* binaries written to the cache */
+		double loadMs;		/* time spent in glProgramBinary */
+		double compileMs;	/* submit to ready, summed over the compiled programs */
+		double wallMs;		/* first submit to last program ready */
+	};
+
+	struct ProgramTiming {
+		std::string name;
+		bool cached;		/* restored from a binary */
+		double ms;			/* submit to ready */
+	};
+
+	typedef size_t Handle;
+
+	/*
+	 * Cache binaries in directory, or only compile if it is empty or the
+	 * driver offers no program binary format. compilerThreads is handed to
+	 * glMaxShaderCompilerThreadsARB; 0 compiles on the calling thread, the
+	 * default leaves the count to the driver. Requires a current context.
+	 */
+	ShaderProgramCache(const std::string& directory, EGLDisplay display, GLuint compilerThreads = 0xFFFFFFFF);
+	~ShaderProgramCache();
+
+	ShaderProgramCache(const ShaderProgramCache&) = delete;
+	ShaderProgramCache& operator=(const ShaderProgramCache&) = delete;
+
+	/*
+	 * Start building the program for sources: restore it from the cache, or
+	 * start compiling it without waiting for the result.
+	 */
+	Handle submit(const std::string& name, const std::vector<ShaderSource>& sources);
+
+	/*
+	 * Non-blocking poll: true once the program can be used without stalling.
+	 * Always true without GL_ARB_parallel_shader_compile.
+	 */
+	bool ready(Handle handle);
+
+	/*
+	 * Return the linked program, waiting for the compile if necessary. The
+	 * program is owned by the cache. Throws with the info log if compiling or
+	 * linking failed.
+	 */
+	GLuint program(Handle handle);
+
+	/*
+	 * submit() and program() in one.
+	 */
+	GLuint program(const std::string& name, const std::vector<ShaderSource>& sources);
+
+	bool persistent() const { return !directory.empty(); }
+	bool parallel() const { return parallelCompile; }
+	const Statistics& statistics() const { return stats; }
+	std::vector<ProgramTiming> timings() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Entry {
+		std::string name;
+		std::string path;		/* cache file, empty if not cached */
+		GLuint program;
+		std::vector<GLuint> shaders;	/* attached while compiling */
+		bool cached;
+		bool linked;			/* link status checked and binary stored */
+		Clock::time_point submitted;
+		double readyMs;			/* < 0 until ready */
+	};
+
+	std::string cachePath(const std::vector<ShaderSource>& sources) const;
+	GLuint load(const std::string& path);
+	void store(const std::string& path, GLuint program);
+	void markReady(Entry& entry);
+
+	std::string directory;	/* empty if binaries are not cached */
+	std::string fingerprint;
+	std::vector<GLint> binaryFormats;
+	bool parallelCompile;
+	std::vector<Entry> entries;
+	Clock::time_point firstSubmit;
+	Statistics stats;
+};
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Asynchronous texture uploads on a shared context.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "texture_uploader.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "gl_debug.h"
+#include "gl_extensions.h"
+#include "metrics.h"
+
+using namespace std;
+
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}
+
+
+TextureUploader::TextureUploader(EGLDisplay display, EGLConfig config, EGLContext shareContext, size_t slotBytes,
+								 size_t depth)
+	: display(display), config(config), slotBytes(slotBytes), depth(depth), staging(0), mapped(nullptr),
+	  slotFences(depth, nullptr), outstanding(0), persistentMapping(false), started(false), stopping(false), stats() {
+	if (depth == 0 || slotBytes == 0) {
+		throw runtime_error("TextureUploader: needs at least one non-empty staging slot");
+	}
+	thread = std::thread(&TextureUploader::run, this, shareContext);
+
+	// Wait for the upload context, so setup errors surface here.
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return started; });
+	if (firstError) {
+		std::exception_ptr error = firstError;
+		stopping = true;
+		lock.unlock();
+		changed.notify_all();
+		thread.join();
+		std::rethrow_exception(error);
+	}
+}
+
+TextureUploader::~TextureUploader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void TextureUploader::submit(const UploadJob& job) {
+	if ((size_t)job.width * job.height * 4 > slotBytes) {
+		throw runtime_error("TextureUploader: image of " + to_string(job.width) + "x" + to_string(job.height) +
+							" exceeds the staging slot");
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+		outstanding++;
+	}
+	changed.notify_all();
+}
+
+TextureUploader::Texture TextureUploader::acquire() {
+	const Clock::time_point start = Clock::now();
+	Texture texture;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (outstanding == 0) {
+			throw runtime_error("TextureUploader: no upload pending");
+		}
+		changed.wait(lock, [this] { return !uploaded.empty() || firstError; });
+		if (firstError) {
+			std::rethrow_exception(firstError);
+		}
+		texture = uploaded.front();
+		uploaded.pop_front();
+		outstanding--;
+		stats.waitSeconds += secondsSince(start);
+	}
+	changed.notify_all();
+
+	// Order the render commands after the upload without blocking the CPU.
+	glWaitSync(texture.fence, 0, GL_TIMEOUT_IGNORED);
+	glDeleteSync(texture.fence);
+	texture.fence = nullptr;
+	assertOpenGLError("TextureUploader glWaitSync");
+	return texture;
+}
+
+void TextureUploader::release(const Texture& texture) {
+	const Released entry = {texture.texture, texture.width, texture.height,
+							glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+	// The upload context waits on this fence, so it has to reach the GPU.
+	glFlush();
+	assertOpenGLError("TextureUploader release");
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		released.push_back(entry);
+	}
+	changed.notify_all();
+}
+
+TextureUploader::Statistics TextureUploader::statistics() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void TextureUploader::fail(std::exception_ptr error) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!firstError) {
+		firstError = error;
+	}
+}
+
+/*
+ * Reuse a released texture of the requested size, once the render context
+ * is done with it, or create a new one.
+ */
+GLuint TextureUploader::takeTexture(GLsizei width, GLsizei height) {
+	Released entry = {0, 0, 0, nullptr};
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < released.size(); i++) {
+			if (released[i].width == width && released[i].height == height) {
+				entry = released[i];
+				released.erase(released.begin() + i);
+				stats.recycled++;
+				break;
+			}
+		}
+	}
+	if (entry.texture) {
+		glWaitSync(entry.fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(entry.fence);
+		return entry.texture;
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	return texture;
+}
+
+void TextureUploader::upload(const UploadJob& job, size_t slot) {
+	GlDebugGroup group("texture upload");
+	const size_t stride = (size_t)job.width * 4;
+
+	// The copy that last read this staging slot has to finish before it is overwritten.
+	if (slotFences[slot]) {
+		GLenum result;
+		do {
+			result = glClientWaitSync(slotFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(slotFences[slot]);
+		slotFences[slot] = nullptr;
+		if (result == GL_WAIT_FAILED) {
+			assertOpenGLError("TextureUploader glClientWaitSync");
+			throw runtime_error("TextureUploader: glClientWaitSync failed");
+		}
+	}
+
+	const Clock::time_point fillStart = Clock::now();
+	unsigned char* destination = mapped ? mapped + slot * slotBytes : hostStaging.data();
+	job.fill(job, destination, stride);
+	const double fillSeconds = secondsSince(fillStart);
+
+	const Clock::time_point uploadStart = Clock::now();
+	const GLuint texture = takeTexture(job.width, job.height);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (mapped) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job.width, job.height, GL_RGBA, GL_UNSIGNED_BYTE,
+						(const void*)(slot * slotBytes));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		slotFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job.width, job.height, GL_RGBA, GL_UNSIGNED_BYTE, destination);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	const Texture result = {job.id, texture, job.width, job.height, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+	// acquire() waits on the fence from the render context; submit it first.
+	glFlush();
+	assertOpenGLError("TextureUploader glTexSubImage2D");
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		uploaded.push_back(result);
+		stats.uploads++;
+		stats.bytes += stride * job.height;
+		stats.fillSeconds += fillSeconds;
+		stats.uploadSeconds += secondsSince(uploadStart);
+	}
+	changed.notify_all();
+}
+
+void TextureUploader::run(EGLContext shareContext) {
+	EGLContext context = EGL_NO_CONTEXT;
+
+	/*
+	 * Upload context and persistently mapped staging buffer.
+	 */
+	try {
+		StageTimer timer(METRIC_CONTEXT_SETUP);
+		eglBindAPI(EGL_OPENGL_API);
+		assertEGLError("uploader eglBindAPI");
+
+		const std::vector<EGLint> attributes = glContextAttributes();
+		context = eglCreateContext(display, config, shareContext, attributes.data());
+		assertEGLError("uploader eglCreateContext");
+
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+		assertEGLError("uploader eglMakeCurrent");
+		installGlDebugCallback();
+
+		if (isGlextSupported("GL_ARB_buffer_storage")) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glGenBuffers(1, &staging);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotBytes * depth, nullptr, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes * depth, flags);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		if (!mapped) {
+			hostStaging.resize(slotBytes);
+		}
+		assertOpenGLError("uploader setup");
+	} catch (...) {
+		fail(std::current_exception());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		persistentMapping = mapped != nullptr;
+		started = true;
+	}
+	changed.notify_all();
+
+	size_t nextSlot = 0;
+	for (;;) {
+		UploadJob job;
+		{
+			// Keep at most depth textures waiting, so uploads stay one step ahead of rendering.
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this] { return stopping || (!jobs.empty() && uploaded.size() < depth); });
+			if (stopping || firstError) {
+				break;
+			}
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		try {
+			if (context == EGL_NO_CONTEXT) {
+				throw runtime_error("uploader has no EGL context");
+			}
+			upload(job, nextSlot);
+			nextSlot = (nextSlot + 1) % depth;
+		} catch (...) {
+			fail(std::current_exception());
+			changed.notify_all();
+		}
+	}
+
+	/*
+	 * Textures are shared, so the upload context can delete the ones the
+	 * render context released or never acquired.
+	 */
+	if (context != EGL_NO_CONTEXT) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const Released& entry : released) {
+			glWaitSync(entry.fence, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(entry.fence);
+			glDeleteTextures(1, &entry.texture);
+		}
+		for (const Texture& texture : uploaded) {
+			glDeleteSync(texture.fence);
+			glDeleteTextures(1, &texture.texture);
+		}
+		released.clear();
+		uploaded.clear();
+		for (GLsync fence : slotFences) {
+			if (fence) {
+				glDeleteSync(fence);
+			}
+		}
+		if (staging) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &staging);
+		}
+		glFinish();
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	eglReleaseThread();
+}
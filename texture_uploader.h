@@ -0,0 +1,128 @@
+/*
+ * Asynchronous texture uploads on a dedicated thread.
+ *
+ * The upload thread owns an EGL context sharing objects with the render
+ * context. Source images are written into a persistently mapped staging
+ * buffer (GL_ARB_buffer_storage) and copied into textures with
+ * glTexSubImage2D from that buffer; a GL_ARB_sync fence hands each texture
+ * over to the render context, which waits for it on the GPU only. So the
+ * upload of job N+1 overlaps the rendering of job N. Released textures carry
+ * a fence of the render context and are recycled for uploads of their size.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_TEXTURE_UPLOADER_H
+#define EGL_OFFSCREEN_TEXTURE_UPLOADER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl_common.h"
+
+struct UploadJob {
+	typedef std::function<void(const UploadJob& job, unsigned char* rgba, size_t stride)> Source;
+
+	uint64_t id;
+	GLsizei width, height;
+	Source fill;	/* called on the upload thread, writes the RGBA8 rows bottom row first */
+};
+
+class TextureUploader {
+public:
+	struct Texture {
+		uint64_t id;
+		GLuint texture;		/* GL_TEXTURE_2D, GL_RGBA8 */
+		GLsizei width, height;
+		GLsync fence;		/* upload complete, consumed by acquire() */
+	};
+
+	struct Statistics {
+		uint64_t uploads;
+		uint64_t bytes;
+		uint64_t recycled;		/* uploads into a released texture */
+		double fillSeconds;		/* upload thread writing the source images */
+		double uploadSeconds;	/* upload thread issuing the copies */
+		double waitSeconds;		/* render thread blocked in acquire() */
+	};
+
+	/*
+	 * Start the upload thread with a context sharing shareContext's objects.
+	 * Images of up to slotBytes are staged in depth slots, and at most depth
+	 * uploaded textures wait to be acquired. Throws if the context cannot be
+	 * set up.
+	 */
+	TextureUploader(EGLDisplay display, EGLConfig config, EGLContext shareContext, size_t slotBytes,
+					size_t depth = 2);
+	~TextureUploader();
+
+	TextureUploader(const TextureUploader&) = delete;
+	TextureUploader& operator=(const TextureUploader&) = delete;
+
+	void submit(const UploadJob& job);
+
+	/*
+	 * Take the next texture in submission order, blocking until it was
+	 * uploaded, and make the current context wait for the upload on the GPU.
+	 * Rethrows the exception that stopped the uploads.
+	 */
+	Texture acquire();
+
+	/*
+	 * Hand the texture back once the commands using it have been issued on
+	 * the current context.
+	 */
+	void release(const Texture& texture);
+
+	/*
+	 * True if the staging buffer is persistently mapped, false if uploads
+	 * fall back to glTexSubImage2D from host memory.
+	 */
+	bool persistent() const { return persistentMapping; }
+	Statistics statistics() const;
+
+private:
+	struct Released {
+		GLuint texture;
+		GLsizei width, height;
+		GLsync fence;		/* last use on the render context */
+	};
+
+	void run(EGLContext shareContext);
+	void upload(const UploadJob& job, size_t slot);
+	GLuint takeTexture(GLsizei width, GLsizei height);
+	void fail(std::exception_ptr error);
+
+	EGLDisplay display;
+	EGLConfig config;
+	size_t slotBytes;
+	size_t depth;
+	std::thread thread;
+
+	// Only touched by the upload thread.
+	GLuint staging;
+	unsigned char* mapped;
+	std::vector<unsigned char> hostStaging;
+	std::vector<GLsync> slotFences;	/* copies still reading a staging slot */
+
+	mutable std::mutex mutex;		/* guards everything below */
+	std::condition_variable changed;
+	std::deque<UploadJob> jobs;
+	std::deque<Texture> uploaded;
+	std::vector<Released> released;
+	size_t outstanding;		/* submitted but not yet acquired */
+	bool persistentMapping;
+	bool started;
+	bool stopping;
+	std::exception_ptr firstError;
+	Statistics stats;
+};
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Tiled rendering with streamed output.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#include "tiled_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+
+#include "gl_common.h"
+#include "gl_debug.h"
+#include "metrics.h"
+#include "pbo_readback.h"
+#include "render_target_pool.h"
+
+using namespace std;
+
+
+size_t maxRenderTargetSize() {
+	GLint textureSize = 0, renderbufferSize = 0, viewport[2] = {0, 0};
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &textureSize);
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &renderbufferSize);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewport);
+	assertOpenGLError("maxRenderTargetSize");
+	return (size_t)std::min(std::min(textureSize, renderbufferSize), std::min(viewport[0], viewport[1]));
+}
+
+std::vector<ShaderSource> sceneShaderSources() {
+	const ShaderSource vertex = {GL_VERTEX_SHADER,
+		"#version 120\n"
+		"void main() {\n"
+		"	gl_FrontColor = gl_Color;\n"
+		"	gl_Position = ftransform();\n"
+		"}\n"};
+	const ShaderSource fragment = {GL_FRAGMENT_SHADER,
+		"#version 120\n"
+		"void main() {\n"
+		"	gl_FragColor = gl_Color;\n"
+		"}\n"};
+	return std::vector<ShaderSource>{vertex, fragment};
+}
+
+/*
+ * Draw the scene in image coordinates, with the origin in the bottom left
+ * corner of the whole image. The projection selects which part ends up in
+ * the current tile.
+ */
+static void drawScene(const TiledRenderOptions& options) {
+	const float* c = options.clearColor;
+	const double w = (double)options.width, h = (double)options.height;
+
+	glClearColor(c[0], c[1], c[2], c[3]);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	/*
+	 * A gradient inset from the borders, so misplaced tiles show as seams.
+	 * Drawn as triangles: colors stay affine when a tile clips them, where a
+	 * clipped quad would be re-triangulated and interpolated differently.
+	 */
+	const GLfloat corners[4][4] = {
+		{c[2], c[0], c[1], 1.0f},
+		{c[1], c[2], c[0], 1.0f},
+		{1.0f - c[0], 1.0f - c[1], 1.0f - c[2], 1.0f},
+		{c[0], c[1], c[2], 1.0f}
+	};
+	const GLdouble positions[4][2] = {{w / 8, h / 8}, {w * 7 / 8, h / 8}, {w * 7 / 8, h * 7 / 8}, {w / 8, h * 7 / 8}};
+	const int triangles[6] = {0, 1, 2, 0, 2, 3};
+	glBegin(GL_TRIANGLES);
+	for (int i = 0; i < 6; i++) {
+		glColor4fv(corners[triangles[i]]);
+		glVertex2dv(positions[triangles[i]]);
+	}
+	glEnd();
+}
+
+TiledRenderStatistics RenderTiled(RenderTargetPool& targets, GLuint sceneProgram, const TiledRenderOptions& options,
+								  const std::string& path, const ImageWriterOptions& image) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (options.width == 0 || options.height == 0) {
+		throw runtime_error("RenderTiled: empty image");
+	}
+
+	/*
+	 * Tiles span the full width where the limits allow, and are only as high
+	 * as one strip of host memory fits.
+	 */
+	size_t maxTile = maxRenderTargetSize();
+	if (options.tileSize > 0) {
+		maxTile = std::min(maxTile, options.tileSize);
+	}
+	const size_t rowBytes = options.width * 4;
+	const size_t tileWidth = std::min(maxTile, options.width);
+	const size_t tileHeight =
+		std::min(std::min(maxTile, options.height), std::max<size_t>(1, options.stripBytes / rowBytes));
+	const size_t columns = (options.width + tileWidth - 1) / tileWidth;
+	const size_t strips = (options.height + tileHeight - 1) / tileHeight;
+
+	TiledRenderStatistics stats = TiledRenderStatistics();
+	stats.tileWidth = tileWidth;
+	stats.tileHeight = tileHeight;
+	stats.strips = strips;
+	stats.tiles = columns * strips;
+
+	const RenderTargetKey key = renderTargetKey((GLsizei)tileWidth, (GLsizei)tileHeight, GL_RGBA8);
+	RenderTarget* target = targets.acquire(key);
+
+	try {
+		std::unique_ptr<ImageWriter> writer;
+		if (!path.empty()) {
+			ImageWriterOptions writerOptions = image;
+			writerOptions.format = imageFormatFromPath(path);
+			writer.reset(new ImageWriter(path, options.width, options.height, writerOptions));
+		}
+
+		// One strip, bottom-up like the tiles it is assembled from.
+		std::vector<unsigned char> strip(rowBytes * tileHeight);
+		PboReadback readback((GLsizei)tileWidth, (GLsizei)tileHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+							 options.readbackDepth);
+
+		/*
+		 * Copy the part of a finished tile that lies inside the image into the
+		 * strip, and write the strip out once its last tile has arrived.
+		 */
+		PboReadback::Consumer stitch = [&](uint64_t tile, const void* pixels, size_t) {
+			const size_t row = tile / columns, column = tile % columns;
+			const size_t x = column * tileWidth;
+			const size_t validWidth = std::min(tileWidth, options.width - x);
+			const size_t validHeight = std::min(tileHeight, options.height - row * tileHeight);
+
+			// The tile's top rows line up with the top of the strip.
+			const unsigned char* source = (const unsigned char*)pixels + (tileHeight - validHeight) * tileWidth * 4;
+			for (size_t y = 0; y < validHeight; y++) {
+				memcpy(&strip[y * rowBytes + x * 4], source + y * tileWidth * 4, validWidth * 4);
+			}
+
+			if (column + 1 == columns && writer) {
+				writer->writeRows(strip.data(), rowBytes, validHeight, true);
+			}
+		};
+
+		glViewport(0, 0, (GLsizei)tileWidth, (GLsizei)tileHeight);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		glMatrixMode(GL_PROJECTION);
+		glUseProgram(sceneProgram);
+
+		for (size_t row = 0; row < strips; row++) {
+			for (size_t column = 0; column < columns; column++) {
+				GlDebugGroup group("render tile");
+
+				// Strips run from the top of the image; GL coordinates from the bottom.
+				const double left = (double)(column * tileWidth);
+				const double top = (double)options.height - (double)(row * tileHeight);
+				{
+					StageTimer timer(METRIC_RENDER);
+					glLoadIdentity();
+					glOrtho(left, left + tileWidth, top - tileHeight, top, -1.0, 1.0);
+					drawScene(options);
+				}
+
+				while (readback.tryRetrieve(stitch)) {
+				}
+				if (readback.full()) {
+					readback.retrieve(stitch);
+				}
+				readback.queue(row * columns + column);
+			}
+		}
+		while (!readback.empty()) {
+			readback.retrieve(stitch);
+		}
+		glLoadIdentity();
+		glUseProgram(0);
+		assertOpenGLError("RenderTiled");
+
+		if (writer) {
+			writer->finish();
+		}
+		stats.stalled = readback.statistics().stalled;
+	} catch (...) {
+		targets.release(target);
+		throw;
+	}
+	targets.release(target);
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
@@ -0,0 +1,63 @@
+/*
+ * Tiled rendering of images larger than a single render target.
+ *
+ * The output is split into strips of full image width, and every strip into
+ * tiles no larger than GL_MAX_TEXTURE_SIZE, GL_MAX_VIEWPORT_DIMS and
+ * GL_MAX_RENDERBUFFER_SIZE allow. Each tile is rendered with a projection
+ * restricted to its part of the image and read back through the PBO ring, so
+ * the next tile renders while the previous ones are transferred. Finished
+ * strips are handed to the ImageWriter right away: host memory holds one
+ * strip, never the whole image.
+ *
+ * The MIT License (MIT)
+ * Copyright (c) 2014 Sven-Kristofer Pilz
+ */
+
+#ifndef EGL_OFFSCREEN_TILED_RENDERER_H
+#define EGL_OFFSCREEN_TILED_RENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image_writer.h"
+#include "shader_cache.h"
+
+class RenderTargetPool;
+
+struct TiledRenderOptions {
+	size_t width, height;		/* size of the whole image */
+	size_t tileSize = 0;		/* largest tile edge, 0 for the GL limits */
+	size_t stripBytes = 64 << 20;	/* host memory for one strip of tiles */
+	size_t readbackDepth = 3;	/* PBOs in the readback ring */
+	float clearColor[4];
+};
+
+struct TiledRenderStatistics {
+	size_t tileWidth, tileHeight;
+	size_t tiles;
+	size_t strips;
+	uint64_t stalled;	/* tile readbacks that had to wait on their fence */
+	double seconds;
+};
+
+/*
+ * Largest render target edge the current context supports.
+ */
+size_t maxRenderTargetSize();
+
+/*
+ * GLSL sources of the program drawing the tiled scene.
+ */
+std::vector<ShaderSource> sceneShaderSources();
+
+/*
+ * Render a width x height image tile by tile on the current context with
+ * the scene program, and stream it to path (format by extension), or
+ * discard it if path is empty.
+ */
+TiledRenderStatistics RenderTiled(RenderTargetPool& targets, GLuint sceneProgram, const TiledRenderOptions& options,
+								  const std::string& path, const ImageWriterOptions& image);
+
+#endif